@@ -0,0 +1,156 @@
+//
+//  compress_bench.c
+//  XprobePlugin
+//
+//  Size and throughput of the compressed framing xwriteCompressed()
+//  uses for output sent to the console: five bytes of header (raw
+//  length and algorithm) followed by the compressed payload, sent only
+//  when that is smaller than the plain frame. Payloads are generated
+//  to look like the markup Xprobe sends when opening objects.
+//
+//  For each frame the bytes saved and the latency saved are shown for
+//  a link of LINK_MBITS (Wi-Fi to a device, or pass Mbit/s as the
+//  argument): time to send the plain frame less the time to encode,
+//  send and decode the compressed one. Negative means slower.
+//
+//  On macOS every algorithm is timed using libcompression as Xprobe
+//  does. Elsewhere only ZLIB is available, via zlib's raw deflate at
+//  level 5 which is what COMPRESSION_ZLIB produces.
+//
+//  make -C Benchmarks compress && Benchmarks/compress_bench [Mbit/s]
+//
+//  $Id: //depot/XprobePlugin/Benchmarks/compress_bench.c#1 $
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __APPLE__
+#include <compression.h>
+
+static const struct { const char *name; compression_algorithm algorithm; } algorithms[] = {
+    {"LZ4", COMPRESSION_LZ4}, {"LZFSE", COMPRESSION_LZFSE}, {"ZLIB", COMPRESSION_ZLIB},
+};
+
+static size_t encode( int a, uint8_t *dst, size_t dstLength, const uint8_t *src, size_t srcLength ) {
+    return compression_encode_buffer( dst, dstLength, src, srcLength, NULL, algorithms[a].algorithm );
+}
+
+static size_t decode( int a, uint8_t *dst, size_t dstLength, const uint8_t *src, size_t srcLength ) {
+    return compression_decode_buffer( dst, dstLength, src, srcLength, NULL, algorithms[a].algorithm );
+}
+#else
+#include <zlib.h>
+
+static const struct { const char *name; } algorithms[] = {
+    {"ZLIB"},
+};
+
+static size_t encode( int a, uint8_t *dst, size_t dstLength, const uint8_t *src, size_t srcLength ) {
+    z_stream stream = {0};
+    (void)a;
+    if ( deflateInit2( &stream, 5, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+        return 0;
+    stream.next_in = (Bytef *)src;
+    stream.avail_in = (uInt)srcLength;
+    stream.next_out = dst;
+    stream.avail_out = (uInt)dstLength;
+    size_t encoded = deflate( &stream, Z_FINISH ) == Z_STREAM_END ? stream.total_out : 0;
+    deflateEnd( &stream );
+    return encoded;
+}
+
+static size_t decode( int a, uint8_t *dst, size_t dstLength, const uint8_t *src, size_t srcLength ) {
+    z_stream stream = {0};
+    (void)a;
+    if ( inflateInit2( &stream, -15 ) != Z_OK )
+        return 0;
+    stream.next_in = (Bytef *)src;
+    stream.avail_in = (uInt)srcLength;
+    stream.next_out = dst;
+    stream.avail_out = (uInt)dstLength;
+    size_t decoded = inflate( &stream, Z_FINISH ) == Z_STREAM_END ? stream.total_out : 0;
+    inflateEnd( &stream );
+    return decoded;
+}
+#endif
+
+#define FRAME_HEADER (sizeof(uint32_t) + 1)
+#define LINK_MBITS 50.
+
+static double now() {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// links and ivar rows much as -xopenPathID:into: renders them
+static size_t payload( char *buff, size_t length ) {
+    static const char *classes[] = {"NSView", "NSTextField", "UIButton", "NSMutableArray", "CALayer", "NSWindow"};
+    static const char *ivars[] = {"_frame", "_delegate", "_subviews", "_layer", "_target", "_title"};
+    size_t used = 0;
+    for ( unsigned row = 0 ; used + 400 < length ; row++ )
+        used += sprintf( buff + used, "<span onclick=\\'this.id =\"I%u\"; sendClient( \"ivar:\", \"%u\", "
+                        "\"%s\" ); event.cancelBubble = true;\\'>%s</span> = <a href=\\'#\\' onclick=\\'"
+                        "sendClient( \"open:\", \"%u\" ); event.cancelBubble = true; return false;\\'>"
+                        "&lt;%s&#160;%p&gt;</a><br/>", row, rand() % 5000, ivars[row % 6], ivars[row % 6],
+                        rand() % 5000, classes[rand() % 6], (void *)(uintptr_t)(0x600000000000 + rand() * 16L) );
+    while ( used < length )
+        buff[used++] = ' ';
+    return used;
+}
+
+int main( int argc, char *argv[] ) {
+    static const size_t lengths[] = {4096, 65536, 1 << 20};
+    double bytesPerSecond = (argc > 1 ? atof( argv[1] ) : LINK_MBITS) * 1e6 / 8;
+    srand( 1 );
+
+    printf( "%-6s %8s %8s %7s %10s %10s %9s %9s\n", "algo", "bytes", "frame", "ratio",
+           "enc MB/s", "dec MB/s", "saved KB", "saved ms" );
+    for ( unsigned l = 0 ; l < sizeof lengths / sizeof *lengths ; l++ ) {
+        size_t length = lengths[l];
+        char *raw = malloc( length );
+        uint8_t *frame = malloc( FRAME_HEADER + length ), *decoded = malloc( length );
+        payload( raw, length );
+
+        for ( int a = 0 ; a < (int)(sizeof algorithms / sizeof *algorithms) ; a++ ) {
+            int iterations = (int)(64 * 1024 * 1024 / length);
+            size_t compressed = 0;
+
+            double start = now();
+            for ( int i = 0 ; i < iterations ; i++ )
+                compressed = encode( a, frame + FRAME_HEADER, length, (const uint8_t *)raw, length );
+            double encoding = now() - start;
+
+            start = now();
+            for ( int i = 0 ; i < iterations ; i++ )
+                if ( decode( a, decoded, length, frame + FRAME_HEADER, compressed ) != length ) {
+                    fprintf( stderr, "%s failed to round trip %zu bytes\n", algorithms[a].name, length );
+                    return 1;
+                }
+            double decoding = now() - start;
+
+            if ( memcmp( raw, decoded, length ) != 0 ) {
+                fprintf( stderr, "%s corrupted %zu bytes\n", algorithms[a].name, length );
+                return 1;
+            }
+
+            // frame sent plain when compressing doesn't save space
+            size_t sent = compressed ? FRAME_HEADER + compressed : length;
+            double plain = length / bytesPerSecond, framed = sent / bytesPerSecond +
+                (compressed ? (encoding + decoding) / iterations : 0);
+            printf( "%-6s %8zu %8zu %6.1f%% %10.0f %10.0f %9.1f %9.3f\n", algorithms[a].name, length, sent,
+                   100. * sent / length, iterations * length / encoding / 1e6, iterations * length / decoding / 1e6,
+                   ((double)length - sent) / 1024, (plain - framed) * 1e3 );
+        }
+
+        free( raw );
+        free( frame );
+        free( decoded );
+    }
+
+    return 0;
+}
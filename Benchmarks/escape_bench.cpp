@@ -0,0 +1,92 @@
+//
+//  escape_bench.cpp
+//  XprobePlugin
+//
+//  Compares the single pass escaper in XprobeEscape.h with the seven
+//  chained replace-all passes -xhtmlEscape used to make, and checks
+//  both produce the same output. The chain is modelled with std::string
+//  as NSString isn't available everywhere, each pass allocating a new
+//  string as -stringByReplacingOccurrencesOfString:withString: did.
+//
+//  make -C Benchmarks escape && Benchmarks/escape_bench
+//
+//  $Id: //depot/XprobePlugin/Benchmarks/escape_bench.cpp#1 $
+//
+
+#include "../Sources/Xprobe/XprobeEscape.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+static std::string replaceAll( const std::string &in, const char *from, const char *to ) {
+    std::string out;
+    size_t fromLength = strlen( from ), pos = 0, next;
+    while ( (next = in.find( from, pos )) != std::string::npos ) {
+        out.append( in, pos, next - pos );
+        out += to;
+        pos = next + fromLength;
+    }
+    out.append( in, pos, std::string::npos );
+    return out;
+}
+
+static std::string chained( const std::string &in ) {
+    return replaceAll( replaceAll( replaceAll( replaceAll( replaceAll( replaceAll( replaceAll( in,
+           "&", "&amp;" ), "<", "&lt;" ), "\n", "<br/>" ), "\\", "\\\\" ), "'", "\\'" ),
+           "  ", " &#160;" ), "\t", " &#160; &#160;" );
+}
+
+static std::string singlePass( const std::string &in ) {
+    std::string out;
+    out.reserve( in.size() + in.size() / 8 );
+    xescapeHTML( in.data(), in.size(), [&out]( const char *run, size_t length ) {
+        out.append( run, length );
+    } );
+    return out;
+}
+
+// mostly clean text like -description output with the odd special
+static std::string sample( size_t length, int specialsPer1000 ) {
+    static const char specials[] = "&<\n\\'\t ", clean[] = "abcdefghijklmnopqrstuvwxyz0123456789 =;:{}()";
+    std::string out;
+    for ( size_t i = 0 ; i < length ; i++ )
+        out += rand() % 1000 < specialsPer1000 ? specials[rand() % (sizeof specials - 1)] :
+            clean[rand() % (sizeof clean - 1)];
+    return out;
+}
+
+template <typename Escape>
+static double nsPerByte( Escape escape, const std::string &in, size_t &sink ) {
+    size_t iterations = 1 + (64u << 20) / (in.size() + 1);
+    auto start = std::chrono::steady_clock::now();
+    for ( size_t i = 0 ; i < iterations ; i++ )
+        sink += escape( in ).size();
+    std::chrono::duration<double,std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (iterations * in.size());
+}
+
+int main() {
+    srand( 1 );
+    size_t sink = 0;
+
+    for ( int check = 0 ; check < 10000 ; check++ ) {
+        std::string in = sample( rand() % 100, 200 );
+        if ( chained( in ) != singlePass( in ) ) {
+            fprintf( stderr, "Mismatch escaping \"%s\"\n", in.c_str() );
+            return 1;
+        }
+    }
+
+    printf( "%10s %12s %12s %10s\n", "bytes", "chained ns/B", "single ns/B", "speedup" );
+    const size_t lengths[] = {64, 4096, 1 << 20};
+    for ( size_t length : lengths ) {
+        std::string in = sample( length, 10 );
+        double before = nsPerByte( chained, in, sink ), after = nsPerByte( singlePass, in, sink );
+        printf( "%10zu %12.3f %12.3f %9.1fx\n", length, before, after, before / after );
+    }
+
+    return sink == 0;
+}
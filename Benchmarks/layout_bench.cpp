@@ -0,0 +1,86 @@
+//
+//  layout_bench.cpp
+//  XprobePlugin
+//
+//  Times the in process graph layout of XprobeLayout.h on random
+//  graphs in the dot Xprobe.mm generates, reporting the ranks and
+//  layered vertices (nodes plus the dummies of long edges) it used.
+//  Edges join random nodes so, like the graphs of a deep sweep, many
+//  of them span a large number of ranks.
+//
+//  make -C Benchmarks layout && Benchmarks/layout_bench [nodes edges]...
+//
+//  $Id: //depot/XprobePlugin/Benchmarks/layout_bench.cpp#1 $
+//
+
+#include "../Sources/XprobeUI/XprobeLayout.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+static std::string sweepGraph( int nodeCount, int edgeCount ) {
+    static const char *classes[] = {"NSView", "NSTextField", "NSWindow", "NSMutableArray", "CALayer"};
+    static const char *ivars[] = {"_subviews", "_superview", "_layer", "_delegate", "_window"};
+    std::string dot = "digraph sweep {\n"
+        "    node [href=\"javascript:void(click_node('\\N'))\" id=\"ID\\N\" fontname=\"Arial\"];\n";
+    char buff[256];
+
+    for ( int n = 0 ; n < nodeCount ; n++ ) {
+        snprintf( buff, sizeof buff, "    %d [label=\"%s\" tooltip=\"<%s %p> #%d\"%s color=\"#000000\"];\n",
+                 n, classes[n % 5], classes[n % 5], (void *)(uintptr_t)(0x600000000000 + n * 64L), n,
+                 n % 3 ? "" : " shape=box" );
+        dot += buff;
+    }
+    for ( int e = 0 ; e < edgeCount ; e++ ) {
+        int from = e < nodeCount - 1 ? e / 2 : rand() % nodeCount, to = e < nodeCount - 1 ? e + 1 : rand() % nodeCount;
+        snprintf( buff, sizeof buff, "    %d -> %d [label=\"%s\" color=\"#000000\" eid=\"%d\"];\n",
+                 from, to, ivars[e % 5], e + 1 );
+        dot += buff;
+    }
+
+    return dot + "}\n";
+}
+
+// parse() must refuse these rather than lay out something made up
+static const char *malformed[] = {
+    "digraph", "digraph sweep", "digraph sweep { 0 -> 1;", "digraph { 0 -> }",
+    "digraph { 0 -> ; }", "digraph { 0 -> -> 1 }", "digraph { ] }",
+};
+
+int main( int argc, const char *argv[] ) {
+    for ( const char *dot : malformed ) {
+        XprobeLayout layout;
+        if ( layout.parse( dot, strlen( dot ) ) ) {
+            fprintf( stderr, "Parsed malformed graph: %s\n", dot );
+            return 1;
+        }
+    }
+
+    std::vector<std::pair<int,int> > sizes;
+    for ( int arg = 1 ; arg + 1 < argc ; arg += 2 )
+        sizes.push_back( std::make_pair( atoi( argv[arg] ), atoi( argv[arg+1] ) ) );
+    if ( sizes.empty() )
+        sizes = {{100, 200}, {500, 1000}, {2000, 4000}, {5000, 10000}, {10000, 20000}};
+
+    printf( "%8s %8s %8s %10s %10s %10s\n", "nodes", "edges", "ranks", "vertices", "layout ms", "xdot KB" );
+    for ( auto &size : sizes ) {
+        srand( 1 );
+        std::string dot = sweepGraph( size.first, size.second ), xdot;
+        XprobeLayout layout;
+
+        auto start = std::chrono::steady_clock::now();
+        if ( !layout.parse( dot.data(), dot.size() ) ) {
+            fprintf( stderr, "Could not parse graph of %d nodes\n", size.first );
+            return 1;
+        }
+        layout.layout();
+        layout.xdot( xdot );
+        std::chrono::duration<double,std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        printf( "%8d %8d %8zu %10zu %10.1f %10zu\n", size.first, size.second,
+               layout.rankCount(), layout.vertexCount(), elapsed.count(), xdot.size() / 1024 );
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+//
+//  literals_check.cpp
+//  XprobePlugin
+//
+//  Checks the literal runs XprobeLiterals.h extracts from patterns
+//  against the regular expression engine: each subject must match
+//  its pattern and contain every run, otherwise the trigram indexes
+//  would drop lines or names the filter should have shown. On macOS
+//  this is built as Objective-C++ and matches with NSRegularExpression
+//  as Xprobe does, elsewhere std::regex stands in for the patterns
+//  ECMAScript shares with ICU.
+//
+//  make -C Benchmarks literals && Benchmarks/literals_check
+//
+//  $Id: //depot/XprobePlugin/Benchmarks/literals_check.cpp#1 $
+//
+
+#include "../Sources/Xprobe/XprobeLiterals.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef __OBJC__
+#import <Foundation/Foundation.h>
+#else
+#include <regex>
+#endif
+
+static const struct {
+    const char *pattern, *subject, *literals;
+    bool icuOnly;
+} cases[] = {
+    {"abc", "xABCx", "abc", false},
+    {"ab{2}c", "abbc", "a c", false},
+    {"a{2,3}b", "aab", "b", false},
+    {"\\x41bc", "Abc", "bc", false},
+    {"\\x{41}bc", "Abc", "bc", true},
+    {"\\u0041bc", "abc", "bc", false},
+    {"\\U00000041bc", "abc", "bc", true},
+    {"\\0101bc", "abc", "bc", true},
+    {"\\N{LATIN SMALL LETTER A}bc", "abc", "bc", true},
+    {"a\\p{L}c", "abc", "a c", true},
+    {"a\\P{Lu}c", "abc", "a c", true},
+    {"\\d{5}x", "12345x", "x", false},
+    {"\\cAx", "\001x", "x", true},
+    {"foo\\.bar", "FOO.BAR", "foo.bar", false},
+    {"foo\\.?bar", "foobar", "foo bar", false},
+    {"a(bc)+d", "abcd", "a d", false},
+    {"[xyz\\]]+abc*", "]abd", "ab", false},
+    {"[[:upper:]]abc", "Xabc", "abc", false},
+    {"[[:alpha:][:digit:]]+x", "a1x", "x", false},
+    {"[a[bc]]de", "bde", "de", true},
+    {"^Get\\w+:$", "getFoo:", "get :", false},
+    {"(a)b\\1c", "abac", "b c", false},
+    {"(?<n>x)a\\k<n>b", "xaxb", "a b", true},
+    {"ab\\Qc.d\\E*e", "abc.e", "abc. e", true},
+    {"ab\\Qc.d", "abc.d", "abc.d", true},
+    {"ab*?c", "ac", "a c", false},
+    {"a|b", "b", "", false},
+};
+
+static bool matches( const char *pattern, const char *subject ) {
+#ifdef __OBJC__
+    NSRegularExpression *regexp = [NSRegularExpression regularExpressionWithPattern:@(pattern)
+                                                            options:NSRegularExpressionCaseInsensitive error:NULL];
+    NSString *string = @(subject);
+    return regexp && [regexp rangeOfFirstMatchInString:string options:0
+                                                 range:NSMakeRange(0, [string length])].location != NSNotFound;
+#else
+    return std::regex_search( subject, std::regex( pattern, std::regex::ECMAScript | std::regex::icase ) );
+#endif
+}
+
+int main() {
+    int failed = 0, checked = 0;
+
+    for ( const auto &test : cases ) {
+#ifndef __OBJC__
+        if ( test.icuOnly )
+            continue;
+#endif
+        std::vector<std::string> literals;
+        xregexLiterals( test.pattern, literals );
+
+        std::string joined, lower;
+        for ( const std::string &literal : literals )
+            joined += (joined.empty() ? "" : " ") + literal;
+        for ( const char *ptr = test.subject ; *ptr ; ptr++ )
+            lower += tolower( (unsigned char)*ptr );
+
+        bool contained = true;
+        for ( const std::string &literal : literals )
+            contained = contained && lower.find( literal ) != std::string::npos;
+
+        if ( !matches( test.pattern, test.subject ) || !contained || joined != test.literals ) {
+            fprintf( stderr, "%s: literals \"%s\" expected \"%s\" for subject \"%s\"\n",
+                    test.pattern, joined.c_str(), test.literals, test.subject );
+            failed++;
+        }
+        checked++;
+    }
+
+    printf( "%d of %d patterns checked\n", checked - failed, checked );
+    return failed != 0;
+}
@@ -0,0 +1,118 @@
+//
+//  xtrace_bench.mm
+//  XprobePlugin
+//
+//  Per call overhead of the Xtrace trampolines on a method taking an
+//  integer, a double and a struct: called directly, traced but not
+//  logged for this instance (the cost of the trampoline bound to the
+//  method and checking the instance), traced with each call formatted
+//  for a delegate that discards it and recorded in binary, to memory
+//  and to a file which is then formatted offline. The sum of the
+//  results is checked so arguments the trampolines don't pass through
+//  correctly are reported. Recordings are drained between batches of calls small
+//  enough not to overflow the ring and that time isn't counted.
+//  Finally the class is disabled with setTracing:forClass: and then
+//  untraced to compare what is left of the trampoline with original.
+//
+//  Xtrace needs the Objective-C runtime so this is macOS only:
+//  make -C Benchmarks xtrace && Benchmarks/xtrace_bench
+//
+//  $Id: //depot/XprobePlugin/Benchmarks/xtrace_bench.mm#1 $
+//
+
+#import "../Classes/Xtrace.h"
+#import <mach/mach_time.h>
+
+@interface XtraceBench : NSObject
+@end
+
+@implementation XtraceBench
+
+- (NSInteger)add:(NSInteger)value scaled:(double)scale inRect:(NSRect)rect {
+    return value + (NSInteger)(scale * rect.size.width);
+}
+
+@end
+
+@interface XtraceBenchDelegate : NSObject <XtraceDelegate>
+@end
+
+@implementation XtraceBenchDelegate {
+@public
+    int lines;
+}
+
+- (void)xtrace:(NSString *)trace forInstance:(void *)obj indent:(int)indent {
+    lines++;
+}
+
+@end
+
+#define BATCH 2048 // calls, each recording a call and a return event
+
+static void timeCalls( const char *label, XtraceBench *bench, int calls, BOOL drain = NO ) {
+    static mach_timebase_info_data_t timebase;
+    if ( !timebase.denom )
+        mach_timebase_info( &timebase );
+
+    NSRect rect = NSMakeRect( 0, 0, 2, 3 );
+    NSInteger sum = 0;
+    uint64_t elapsed = 0;
+    for ( int batch = 0 ; batch < calls ; batch += BATCH ) {
+        uint64_t start = mach_absolute_time();
+        for ( int i = batch ; i < MIN( batch + BATCH, calls ) ; i++ )
+            sum += [bench add:i scaled:.5 inRect:rect];
+        elapsed += mach_absolute_time() - start;
+        if ( drain )
+            [Xtrace drainRecording];
+    }
+
+    if ( sum != (NSInteger)calls * (calls - 1) / 2 + calls ) {
+        fprintf( stderr, "%s: arguments not passed through, sum %ld\n", label, (long)sum );
+        exit( 1 );
+    }
+    printf( "%-24s %10.1f\n", label, (double)elapsed * timebase.numer / timebase.denom / calls );
+}
+
+int main() {
+    @autoreleasepool {
+        XtraceBench *bench = [XtraceBench new], *other = [XtraceBench new];
+        XtraceBenchDelegate *delegate = [XtraceBenchDelegate new];
+        [Xtrace setDelegate:delegate];
+        [Xtrace showCaller:NO];
+
+        printf( "%-24s %10s\n", "", "ns/call" );
+        timeCalls( "original", bench, 10000000 );
+
+        // swizzles the class but only logs calls to "other"
+        [Xtrace traceInstance:other class:[XtraceBench class]];
+        timeCalls( "traced, not logged", bench, 10000000 );
+
+        [Xtrace traceInstance:bench class:[XtraceBench class]];
+        timeCalls( "traced and logged", bench, 100000 );
+
+        [Xtrace record:YES];
+        timeCalls( "traced and recorded", bench, 1000000, YES );
+
+        NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"xtrace_bench.dump"];
+        [Xtrace recordToFile:path];
+        timeCalls( "recorded to a file", bench, 1000000, YES );
+        [Xtrace record:NO];
+        [Xtrace recordToFile:nil];
+
+        delegate->lines = 0;
+        if ( ![Xtrace formatRecording:path] || delegate->lines != 2 * 1000000 ) {
+            fprintf( stderr, "Formatted %d lines of %s\n", delegate->lines, [path UTF8String] );
+            return 1;
+        }
+        [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+
+        [Xtrace setTracing:NO forClass:[XtraceBench class]];
+        timeCalls( "traced, disabled", bench, 10000000 );
+
+        [Xtrace untraceClass:[XtraceBench class]];
+        timeCalls( "untraced", bench, 10000000 );
+    }
+
+    return 0;
+}
@@ -79,9 +79,15 @@
 typedef void (*XTRACE_VIMP)( XTRACE_UNSAFE id obj, SEL sel, ... );
 typedef void (^XTRACE_BIMP)( XTRACE_UNSAFE id obj, SEL sel, ... );
 
+// arguments as received by a trampoline (see Xtrace.mm)
+struct _xtrace_args;
+
+typedef BOOL (*XTRACE_FORMATTER)( const char *type, struct _xtrace_args *args, NSMutableString *out, BOOL recorded );
+
 struct _xtrace_arg {
     const char *name, *type;
     int stackOffset;
+    XTRACE_FORMATTER formatter; // compiled from type
 };
 
 // information about original implementations
@@ -89,20 +95,26 @@ struct _xtrace_info {
     int depth;
     void *caller;
     void *lastObj;
-    const char *color;
+    const char *color, *selectorColor;
 
     XTRACE_VIMP before, original, after;
+    XTRACE_VIMP implementation, trampoline; // as swizzled, the trampoline is bound to this info
+    XTRACE_FORMATTER returnFormatter;
     XTRACE_UNSAFE XTRACE_BIMP beforeBlock, afterBlock;
 
     Method method;
+    SEL sel;
+    XTRACE_UNSAFE Class aClass; // intercepted on, less any KVO subclass
     const char *name, *type, *mtype;
     struct _xtrace_arg args[XTRACE_ARGS_SUPPORTED+1];
 
     struct _stats {
-        NSTimeInterval entered, elapsed;
+        NSTimeInterval elapsed, exclusive; // inclusive and self time
+        NSTimeInterval p50, p99, max; // per call latencies
         unsigned callCount;
-    } stats;
-    BOOL callingBack;
+    } stats; // summed over threads when read
+    unsigned slot;
+    BOOL enabled; // accessed with __atomic builtins
 };
 
 @interface NSObject(Xtrace)
@@ -140,7 +152,7 @@ struct _xtrace_info {
 @public
     Class aClass;
     struct _xtrace_info *info;
-    NSTimeInterval elapsed;
+    NSTimeInterval elapsed, exclusive;
     int callCount;
 }
 
@@ -162,6 +174,18 @@ struct _xtrace_info {
 // log values's "description"
 + (void)describeValues:(BOOL)desc;
 
+// prefix calls and returns with thread number
++ (void)showThread:(BOOL)show;
+
+// log only 1 in "every" calls to each method
++ (void)sampleEvery:(unsigned)every;
+
+// log at most "perSecond" calls to each method per thread
++ (void)rateLimit:(double)perSecond;
+
+// log only calls taking longer than "seconds" as they return
++ (void)slowerThan:(NSTimeInterval)seconds;
+
 // property methods filtered out by default
 + (void)includeProperties:(BOOL)include;
 
@@ -201,6 +225,14 @@ struct _xtrace_info {
 // stop tracing messages to instance
 + (void)notrace:(id)instance;
 
+// skip logging and stats without unswizzling
++ (void)setTracing:(BOOL)enabled forClass:(Class)aClass;
+
+// restore original implementations
++ (void)untraceClass:(Class)aClass;
++ (void)untraceBundle:(NSBundle *)theBundle;
++ (void)untraceAll;
+
 // dump runtime class info
 + (void)dumpClass:(Class)aClass;
 
@@ -219,10 +251,24 @@ struct _xtrace_info {
 // name the caller of the specified method
 + (const char *)callerFor:(Class)aClass sel:(SEL)sel;
 
+// record calls in binary formatting them on a background thread
++ (void)record:(BOOL)enable;
++ (void)drainRecording;
+
+// write the recording to a file instead, nil to close it
++ (BOOL)recordToFile:(NSString *)path;
+
+// format a file written by recordToFile: on the same architecture
++ (BOOL)formatRecording:(NSString *)path;
+
 // simple profiling interface
 + (NSArray *)profile;
 + (void)dumpProfile:(unsigned)count dp:(int)decimalPlaces;
 
+// call paths per thread as folded stacks or a pprof profile
++ (NSString *)foldedStacks;
++ (NSData *)pprofProfile;
+
 @end
 #endif
 #endif
@@ -26,11 +26,20 @@
 //  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
-#if DEBUG && !__LP64__
+#if DEBUG
 
 #import "Xtrace.h"
 #import <dlfcn.h>
+#import <pthread.h>
+#import <mach/mach_time.h>
+#import <mach-o/dyld.h>
+#import <mach-o/nlist.h>
 #import <map>
+#import <string>
+#import <vector>
+#import <deque>
+#import <algorithm>
+#import <atomic>
 
 #ifdef __IPHONE_OS_VERSION_MIN_REQUIRED
 #import <UIKit/UIKit.h>
@@ -72,7 +81,8 @@
 
 // Not sure this is even C..
 static struct { BOOL showCaller = YES, showActual = YES, showReturns = YES, showArguments = YES,
-    showSignature = NO, includeProperties = NO, describeValues = NO, logToDelegate; } params;
+    showSignature = NO, includeProperties = NO, describeValues = NO, showThread = YES, recording, logToDelegate; } params;
+static struct { unsigned every; double perSecond; NSTimeInterval slowerThan; } sampling;
 static int indentScale = 2;
 static id delegate;
 
@@ -115,6 +125,22 @@ static inline bool exists( const _M &map, const _K &key ) {
     params.describeValues = desc;
 }
 
++ (void)showThread:(BOOL)show {
+    params.showThread = show;
+}
+
++ (void)sampleEvery:(unsigned)every {
+    sampling.every = every;
+}
+
++ (void)rateLimit:(double)perSecond {
+    sampling.perSecond = perSecond;
+}
+
++ (void)slowerThan:(NSTimeInterval)seconds {
+    sampling.slowerThan = seconds;
+}
+
 static std::map<XTRACE_UNSAFE Class,std::map<SEL,struct _xtrace_info> > originals;
 static std::map<XTRACE_UNSAFE Class,const char *> tracedClasses; // trace color
 static std::map<XTRACE_UNSAFE Class,BOOL> swizzledClasses, excludedClasses;
@@ -122,22 +148,413 @@ static std::map<XTRACE_UNSAFE Class,int> tracingInstances;
 static std::map<XTRACE_UNSAFE id,BOOL> tracedInstances;
 static std::map<SEL,const char *> selectorColors;
 
+// the tables are only changed under this lock which traced threads
+// take only when the instances traced need to be checked
+static pthread_mutex_t tableLock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER;
+
+struct _xtrace_locked {
+    _xtrace_locked() { pthread_mutex_lock( &tableLock ); }
+    ~_xtrace_locked() { pthread_mutex_unlock( &tableLock ); }
+};
+
+// color and instance tracing of receivers' classes copied from the tables
+// above into an open addressed table the trampolines read without locking.
+// Entries are never removed and a table that fills is replaced by a larger
+// one which is published atomically, the old one is left for any readers.
+struct _xtrace_class {
+    std::atomic<const void *> aClass;
+    std::atomic<const char *> color;
+    std::atomic<BOOL> tracingInstances;
+};
+
+struct _xtrace_classes {
+    unsigned size, used;
+    struct _xtrace_class *entries;
+};
+
+static std::atomic<struct _xtrace_classes *> classStates;
+
+static struct _xtrace_class *classEntry( struct _xtrace_classes *table, const void *aClass ) {
+    uintptr_t hash = (uintptr_t)aClass >> 3;
+    for ( unsigned i = 0 ; ; i++ ) {
+        struct _xtrace_class &entry = table->entries[(hash + i) & (table->size - 1)];
+        const void *key = entry.aClass.load( std::memory_order_acquire );
+        if ( key == aClass || !key )
+            return &entry;
+    }
+}
+
+static const struct _xtrace_class *findClass( Class aClass ) {
+    struct _xtrace_classes *table = classStates.load( std::memory_order_acquire );
+    if ( !table )
+        return NULL;
+    struct _xtrace_class *entry = classEntry( table, XTRACE_BRIDGE(const void *)aClass );
+    return entry->aClass.load( std::memory_order_relaxed ) ? entry : NULL;
+}
+
+static void storeClass( struct _xtrace_classes *table, const void *aClass, const char *color, BOOL tracingInstances ) {
+    struct _xtrace_class *entry = classEntry( table, aClass );
+    entry->color.store( color, std::memory_order_relaxed );
+    entry->tracingInstances.store( tracingInstances, std::memory_order_relaxed );
+    if ( !entry->aClass.load( std::memory_order_relaxed ) ) {
+        entry->aClass.store( aClass, std::memory_order_release );
+        table->used++;
+    }
+}
+
+// copies the state of a class from the tables, called with tableLock held
+static void publishClass( Class aClass ) {
+    struct _xtrace_classes *table = classStates.load( std::memory_order_relaxed );
+    if ( !table || (table->used + 1) * 2 > table->size ) {
+        struct _xtrace_classes *grown = new struct _xtrace_classes();
+        grown->size = table ? table->size * 2 : 256;
+        grown->entries = new struct _xtrace_class[grown->size]();
+        for ( unsigned i = 0 ; table && i < table->size ; i++ )
+            if ( const void *key = table->entries[i].aClass.load( std::memory_order_relaxed ) )
+                storeClass( grown, key, table->entries[i].color.load( std::memory_order_relaxed ),
+                           table->entries[i].tracingInstances.load( std::memory_order_relaxed ) );
+        classStates.store( table = grown, std::memory_order_release );
+    }
+
+    auto color = tracedClasses.find( aClass );
+    storeClass( table, XTRACE_BRIDGE(const void *)aClass, color != tracedClasses.end() ? color->second : NULL,
+               exists( tracingInstances, aClass ) );
+}
+
+static void publishClasses() {
+    if ( struct _xtrace_classes *table = classStates.load( std::memory_order_relaxed ) )
+        for ( unsigned i = 0 ; i < table->size ; i++ )
+            if ( const void *key = table->entries[i].aClass.load( std::memory_order_relaxed ) )
+                publishClass( XTRACE_BRIDGE(Class)(void *)key );
+}
+
+// call state and stats are kept per thread indexed by the info's
+// slot without locking and only summed when the profile is read.
+// Methods beyond the slots available are not traced.
+#define XTRACE_SLOTS_PER_CHUNK 256
+#define XTRACE_SLOT_CHUNKS 256
+
+// latencies in mach ticks, four linear buckets per power of two
+#define XTRACE_BUCKETS 256
+
+static inline unsigned histogramBucket( uint64_t ticks ) {
+    if ( ticks < 4 )
+        return (unsigned)ticks;
+    unsigned power = 63 - __builtin_clzll( ticks );
+    return power * 4 + (unsigned)(ticks >> (power - 2) & 3);
+}
+
+static inline uint64_t bucketLimit( unsigned bucket ) {
+    if ( bucket < 4 )
+        return bucket;
+    return ((uint64_t)(4 + bucket % 4 + 1) << (bucket / 4 - 2)) - 1;
+}
+
+struct _xtrace_local {
+    uint64_t inclusive, exclusive, max;
+    unsigned callCount, active;
+    unsigned histogram[XTRACE_BUCKETS];
+    double tokens;
+    uint64_t refilled;
+    const char *color;
+    BOOL callingBack;
+};
+
+// entry times so recursion and callees are accounted for
+#define XTRACE_MAX_DEPTH 512
+
+// calling context tree, appended to only by the owning thread
+struct _xtrace_node {
+    struct _xtrace_info *orig;
+    XTRACE_UNSAFE Class aClass;
+    struct _xtrace_node *parent, *sibling;
+    std::atomic<struct _xtrace_node *> children;
+    uint64_t calls, inclusive, exclusive;
+};
+
+struct _xtrace_frame {
+    uint64_t entered, children;
+    struct _xtrace_node *node;
+    const char *slowColor;
+};
+
+static struct _xtrace_node *childNode( struct _xtrace_node *parent, struct _xtrace_info *orig, Class aClass ) {
+    struct _xtrace_node *first = parent->children.load( std::memory_order_acquire );
+    for ( struct _xtrace_node *child = first ; child ; child = child->sibling )
+        if ( child->orig == orig && child->aClass == aClass )
+            return child;
+
+    struct _xtrace_node *child = new struct _xtrace_node();
+    child->orig = orig;
+    child->aClass = aClass;
+    child->parent = parent;
+    child->sibling = first;
+    parent->children.store( child, std::memory_order_release );
+    return child;
+}
+
+// trampolines take ten words of arguments (and eight doubles on 64 bit)
+// passing them on unchanged to the original implementation. On 64 bit
+// the first words are argument registers followed by the stack so the
+// formatters read them back following the architecture's conventions.
+// Methods whose arguments need more of the stack than the words after
+// the registers are not traced (see xstackFits() below).
+#define XTRACE_ARG_WORDS 10
+#ifndef __LP64__
+#define ARG_DEFS void *a0, void *a1, void *a2, void *a3, void *a4, void *a5, void *a6, void *a7, void *a8, void *a9
+#define ARG_COPY a0, a1, a2, a3, a4, a5, a6, a7, a8, a9
+#define ARG_CAPTURE {a0, a1, a2, a3, a4, a5, a6, a7, a8, a9}
+#define XTRACE_REG_WORDS 0
+#else
+#define ARG_DEFS void *a0, void *a1, void *a2, void *a3, void *a4, void *a5, void *a6, void *a7, void *a8, void *a9, double d0, double d1, double d2, double d3, double d4, double d5, double d6, double d7
+#define ARG_COPY a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, d0, d1, d2, d3, d4, d5, d6, d7
+#define ARG_CAPTURE {a0, a1, a2, a3, a4, a5, a6, a7, a8, a9}, {d0, d1, d2, d3, d4, d5, d6, d7}
+#define XTRACE_ARG_DOUBLES 8
+#ifdef __arm64__
+#define XTRACE_REG_WORDS 6 // x2-x7 after self and _cmd
+#else
+#define XTRACE_REG_WORDS 4 // rdx, rcx, r8 & r9
+#endif
+#endif
+
+#ifdef __x86_64__
+// the address of a struct returned in memory takes the first register
+#define XTRACE_STRET( _size ) ((_size) > 2 * sizeof(void *))
+#else
+#define XTRACE_STRET( _size ) 0
+#endif
+#define XTRACE_REGS( _type ) (XTRACE_REG_WORDS - XTRACE_STRET( sizeof(_type) ))
+
+struct _xtrace_args {
+    void *words[XTRACE_ARG_WORDS];
+#ifdef __LP64__
+    double doubles[XTRACE_ARG_DOUBLES];
+#endif
+    int word, stack, fp; // next register word, stack offset and double to read
+    int regs; // words received in registers, XTRACE_REGS() of the return type
+    BOOL value; // a return value copied into words, read as bytes from "word"
+};
+
+// the original implementations and callbacks are called with the
+// arguments in the registers and stack slots they were received in
+typedef void (*XTRACE_AIMP)( XTRACE_UNSAFE id obj, SEL sel, ARG_DEFS );
+typedef void (*XTRACE_DIMP)( XTRACE_UNSAFE id delegate, SEL sel, XTRACE_UNSAFE id obj, ARG_DEFS );
+typedef void (^XTRACE_ABIMP)( XTRACE_UNSAFE id obj, SEL sel, ARG_DEFS );
+
+// binary record of a call or return formatted later by the consumer
+#define XTRACE_RING_SIZE 8192 // events per thread, power of two
+
+struct _xtrace_event {
+    uint64_t time;
+    struct _xtrace_info *orig;
+    XTRACE_UNSAFE Class aClass, implementingClass;
+    void *obj, *caller;
+    const char *color;
+    int indent;
+    BOOL returned;
+    struct _xtrace_args args;
+};
+
+struct _xtrace_thread {
+    int number, indent;
+    BOOL describing;
+    struct _xtrace_thread *next;
+    std::atomic<bool> inUse;
+    std::atomic<struct _xtrace_local *> slots[XTRACE_SLOT_CHUNKS];
+    struct _xtrace_event *ring;
+    std::atomic<unsigned> ringHead, ringTail, dropped;
+    struct _xtrace_frame stack[XTRACE_MAX_DEPTH];
+    struct _xtrace_node root;
+    int depth;
+};
+
+// threads are never unlinked so the consumer and profiles can walk the
+// list without locking, a thread's state is released when it exits and
+// taken over with its stats, call tree and ring by the next new thread
+static std::atomic<struct _xtrace_thread *> traceThreads;
+static std::atomic<int> traceThreadCount;
+static __thread struct _xtrace_thread *traceThread;
+static pthread_key_t traceThreadKey;
+static unsigned slotsAllocated;
+
+static void releaseThread( void *thread ) {
+    traceThread = NULL; // in case anything traced runs in a later destructor
+    ((struct _xtrace_thread *)thread)->inUse.store( false, std::memory_order_release );
+}
+
+static struct _xtrace_thread &currentThread() {
+    if ( !traceThread ) {
+        static dispatch_once_t once;
+        dispatch_once( &once, ^{
+            pthread_key_create( &traceThreadKey, releaseThread );
+        } );
+
+        struct _xtrace_thread *thread = traceThreads.load();
+        for ( ; thread ; thread = thread->next ) {
+            bool released = false;
+            if ( thread->inUse.compare_exchange_strong( released, true, std::memory_order_acquire ) )
+                break;
+        }
+
+        if ( thread ) {
+            thread->indent = thread->depth = 0;
+            thread->describing = NO;
+        }
+        else {
+            thread = new struct _xtrace_thread();
+            thread->number = ++traceThreadCount;
+            thread->inUse = true;
+            thread->next = traceThreads.load();
+            while ( !traceThreads.compare_exchange_weak( thread->next, thread ) )
+                ;
+        }
+
+        pthread_setspecific( traceThreadKey, thread );
+        traceThread = thread;
+    }
+    return *traceThread;
+}
+
+static struct _xtrace_local &threadLocal( struct _xtrace_thread &thread, const struct _xtrace_info &orig ) {
+    std::atomic<struct _xtrace_local *> &chunk = thread.slots[orig.slot / XTRACE_SLOTS_PER_CHUNK];
+    struct _xtrace_local *locals = chunk.load( std::memory_order_acquire );
+    if ( !locals ) {
+        locals = (struct _xtrace_local *)calloc( XTRACE_SLOTS_PER_CHUNK, sizeof *locals );
+        chunk.store( locals, std::memory_order_release );
+    }
+    return locals[orig.slot % XTRACE_SLOTS_PER_CHUNK];
+}
+
+// reserve the next event in this thread's ring, NULL when the consumer is behind
+static struct _xtrace_event *recordEvent( struct _xtrace_thread &thread ) {
+    if ( !thread.ring )
+        thread.ring = (struct _xtrace_event *)calloc( XTRACE_RING_SIZE, sizeof *thread.ring );
+    unsigned head = thread.ringHead.load( std::memory_order_relaxed );
+    if ( head - thread.ringTail.load( std::memory_order_acquire ) >= XTRACE_RING_SIZE ) {
+        thread.dropped++;
+        return NULL;
+    }
+    struct _xtrace_event &event = thread.ring[head % XTRACE_RING_SIZE];
+    event.time = mach_absolute_time();
+    return &event;
+}
+
+static void commitEvent( struct _xtrace_thread &thread ) {
+    thread.ringHead.store( thread.ringHead.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+}
+
+static NSTimeInterval tickSeconds() {
+    static NSTimeInterval seconds;
+    if ( !seconds ) {
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info( &timebase );
+        seconds = (NSTimeInterval)timebase.numer / timebase.denom / 1e9;
+    }
+    return seconds;
+}
+
+// 1 in N and token bucket sampling decided before anything is formatted
+static BOOL sampled( struct _xtrace_local &local ) {
+    if ( sampling.every > 1 && local.callCount % sampling.every )
+        return NO;
+    if ( sampling.perSecond > 0 ) {
+        uint64_t now = mach_absolute_time();
+        local.tokens = MIN( sampling.perSecond, local.tokens +
+                           (now - local.refilled) * tickSeconds() * sampling.perSecond );
+        local.refilled = now;
+        if ( local.tokens < 1 )
+            return NO;
+        local.tokens -= 1;
+    }
+    return YES;
+}
+
+// totals across threads optionally zeroing them
+static void aggregateStats( struct _xtrace_info &orig, BOOL reset ) {
+    uint64_t inclusive = 0, exclusive = 0, max = 0;
+    unsigned callCount = 0, histogram[XTRACE_BUCKETS] = {0};
+
+    for ( struct _xtrace_thread *thread = traceThreads.load() ; thread ; thread = thread->next ) {
+        struct _xtrace_local *locals = thread->slots[orig.slot / XTRACE_SLOTS_PER_CHUNK].load( std::memory_order_acquire );
+        if ( !locals )
+            continue;
+        struct _xtrace_local &local = locals[orig.slot % XTRACE_SLOTS_PER_CHUNK];
+        inclusive += local.inclusive;
+        exclusive += local.exclusive;
+        max = MAX( max, local.max );
+        callCount += local.callCount;
+        for ( int i=0 ; i<XTRACE_BUCKETS ; i++ )
+            histogram[i] += local.histogram[i];
+        if ( reset ) {
+            local.inclusive = local.exclusive = local.max = 0;
+            local.callCount = 0;
+            memset( local.histogram, 0, sizeof local.histogram );
+        }
+    }
+
+    NSTimeInterval seconds = tickSeconds();
+    orig.stats.elapsed = inclusive * seconds;
+    orig.stats.exclusive = exclusive * seconds;
+    orig.stats.max = max * seconds;
+    orig.stats.callCount = callCount;
+    orig.stats.p50 = orig.stats.p99 = 0;
+
+    unsigned timed = 0, seen = 0;
+    for ( int i=0 ; i<XTRACE_BUCKETS ; i++ )
+        timed += histogram[i];
+    for ( int i=0 ; i<XTRACE_BUCKETS && seen < timed ; i++ ) {
+        if ( !histogram[i] )
+            continue;
+        seen += histogram[i];
+        NSTimeInterval limit = MIN( bucketLimit( i ), max ) * seconds;
+        if ( !orig.stats.p50 && seen * 2 >= timed )
+            orig.stats.p50 = limit;
+        if ( !orig.stats.p99 && seen * 100 >= timed * 99 )
+            orig.stats.p99 = limit;
+    }
+}
+
 + (void)dontTrace:(Class)aClass {
+    struct _xtrace_locked locked;
     Class metaClass = object_getClass(aClass);
     excludedClasses[metaClass] = 1;
     excludedClasses[aClass] = 1;
 }
 
+// class names by image path, extended as images are loaded
+static pthread_mutex_t classIndexLock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<std::string,std::vector<const char *> > imageClasses;
+
+static void indexImageClasses( const struct mach_header *header, intptr_t slide ) {
+    Dl_info info;
+    if ( !dladdr( header, &info ) || !info.dli_fname )
+        return;
+
+    unsigned count = 0;
+    const char **names = objc_copyClassNamesForImage( info.dli_fname, &count );
+    pthread_mutex_lock( &classIndexLock );
+    std::vector<const char *> &classes = imageClasses[info.dli_fname];
+    classes.assign( names, names + count );
+    pthread_mutex_unlock( &classIndexLock );
+    free( names );
+}
+
+static void indexClasses() {
+    static dispatch_once_t once;
+    dispatch_once( &once, ^{
+        _dyld_register_func_for_add_image( indexImageClasses );
+    } );
+}
+
 + (void)traceBundle:(NSBundle *)theBundle {
-    unsigned nc;
-    Class *classes = objc_copyClassList( &nc );
-    for ( unsigned i =0 ; i < nc ; i++ ) {
-        Class aClass = classes[i];
-        NSString *className = NSStringFromClass(aClass);
-        if ( ![className hasPrefix:@"_T"] && [NSBundle bundleForClass:aClass] == theBundle ) {
-            [self traceClass: aClass levels: 1];
-        }
-    }
+    const char *executable = [[theBundle executablePath] fileSystemRepresentation];
+    unsigned nc = 0;
+    const char **names = executable ? objc_copyClassNamesForImage( executable, &nc ) : NULL;
+    for ( unsigned i =0 ; i < nc ; i++ )
+        if ( strncmp( names[i], "_T", 2 ) != 0 )
+            if ( Class aClass = objc_getClass( names[i] ) )
+                [self traceClass: aClass levels: 1];
+    free( names );
 }
 
 + (void)traceClass:(Class)aClass {
@@ -149,57 +566,117 @@ static std::map<SEL,const char *> selectorColors;
         NSLog( @"Tracing NSObject will not trace all classes" );
         return;
     }
-#ifdef __arm64__
-    #warning Xtrace will not work on an ARM64 build. Rebuild for $(ARCHS_STANDARD_32_BIT).
-    NSLog( @"Xtrace will not work on an ARM64 build. Rebuild for $(ARCHS_STANDARD_32_BIT)." );
-#else
     Class metaClass = object_getClass(aClass);
     [self traceClass:metaClass mtype:"+" levels:levels];
     [self traceClass:aClass mtype:"" levels:levels];
-#endif
 }
 
 + (void)traceInstance:(id)instance class:(Class)aClass {
+    struct _xtrace_locked locked;
     [self traceClass:aClass levels:1];
     tracedInstances[instance] = YES;
     tracingInstances[aClass]++;
+    publishClass( aClass );
 }
 
 + (void)traceInstance:(id)instance {
+    struct _xtrace_locked locked;
     Class aClass = [instance class];
     [self traceClass:aClass];
     tracedInstances[instance] = YES;
     tracingInstances[aClass]++;
+    publishClass( aClass );
 }
 
 + (void)notrace:(id)instance {
+    struct _xtrace_locked locked;
     auto i = tracedInstances.find(instance);
     if ( i != tracedInstances.end() )
         tracedInstances.erase(i);
 
 }
 
+// trampolines check this first so disabled methods only pay for the lookup
++ (void)setTracing:(BOOL)enabled forClass:(Class)aClass {
+    struct _xtrace_locked locked;
+    for ( Class cls : {aClass, object_getClass(aClass)} ) {
+        auto byClass = originals.find( cls );
+        if ( byClass != originals.end() )
+            for ( auto &bySel : byClass->second )
+                __atomic_store_n( &bySel.second.enabled, enabled, __ATOMIC_RELEASE );
+    }
+}
+
+// puts back the implementation swizzled unless something else has replaced it since
+static void restoreOriginal( struct _xtrace_info &orig ) {
+    __atomic_store_n( &orig.enabled, NO, __ATOMIC_RELEASE );
+    if ( orig.method && orig.trampoline &&
+        method_getImplementation( orig.method ) == (IMP)orig.trampoline )
+        method_setImplementation( orig.method, (IMP)orig.implementation );
+}
+
++ (void)untraceClass:(Class)aClass {
+    struct _xtrace_locked locked;
+    for ( Class cls : {aClass, object_getClass(aClass)} ) {
+        auto byClass = originals.find( cls );
+        if ( byClass != originals.end() )
+            for ( auto &bySel : byClass->second )
+                restoreOriginal( bySel.second );
+        swizzledClasses.erase( cls );
+        tracedClasses.erase( cls );
+        tracingInstances.erase( cls );
+        publishClass( cls );
+    }
+}
+
++ (void)untraceBundle:(NSBundle *)theBundle {
+    const char *executable = [[theBundle executablePath] fileSystemRepresentation];
+    unsigned nc = 0;
+    const char **names = executable ? objc_copyClassNamesForImage( executable, &nc ) : NULL;
+    for ( unsigned i =0 ; i < nc ; i++ )
+        if ( Class aClass = objc_getClass( names[i] ) )
+            [self untraceClass:aClass];
+    free( names );
+}
+
++ (void)untraceAll {
+    struct _xtrace_locked locked;
+    for ( auto &byClass : originals )
+        for ( auto &bySel : byClass.second )
+            restoreOriginal( bySel.second );
+    swizzledClasses.clear();
+    tracedClasses.clear();
+    tracedInstances.clear();
+    tracingInstances.clear();
+    publishClasses();
+}
+
 + (void)forClass:(Class)aClass before:(SEL)sel callback:(SEL)callback {
+    struct _xtrace_locked locked;
     if ( !(originals[aClass][sel].before = [self forClass:aClass intercept:sel callback:callback]) )
         NSLog( @"Xtrace: ** Could not setup before callback for: [%s %s]", class_getName(aClass), sel_getName(sel) );
 }
 
 + (void)forClass:(Class)aClass replace:(SEL)sel callback:(SEL)callback {
+    struct _xtrace_locked locked;
     if ( !(originals[aClass][sel].original = [self forClass:aClass intercept:sel callback:callback]) )
         NSLog( @"Xtrace: ** Could not setup replace callback for: [%s %s]", class_getName(aClass), sel_getName(sel) );
 }
 
 + (void)forClass:(Class)aClass after:(SEL)sel callback:(SEL)callback {
+    struct _xtrace_locked locked;
     if ( !(originals[aClass][sel].after = [self forClass:aClass intercept:sel callback:callback]) )
         NSLog( @"Xtrace: ** Could not setup after callback for: [%s %s]", class_getName(aClass), sel_getName(sel) );
 }
 
 + (void)forClass:(Class)aClass before:(SEL)sel callbackBlock:callback {
+    struct _xtrace_locked locked;
     [self intercept:aClass method:class_getInstanceMethod(aClass, sel) mtype:NULL
               depth:[self depth:aClass]]->beforeBlock = XTRACE_BRIDGE(XTRACE_BIMP)CFRetain( XTRACE_BRIDGE(CFTypeRef)callback );
 }
 
 + (void)forClass:(Class)aClass after:(SEL)sel callbackBlock:callback {
+    struct _xtrace_locked locked;
     [self intercept:aClass method:class_getInstanceMethod(aClass, sel) mtype:NULL
               depth:[self depth:aClass]]->afterBlock = XTRACE_BRIDGE(XTRACE_BIMP)CFRetain( XTRACE_BRIDGE(CFTypeRef)callback );
 }
@@ -218,13 +695,17 @@ static std::map<SEL,const char *> selectorColors;
 }
 
 static NSRegularExpression *includeMethods, *excludeMethods, *excludeTypes;
+static std::map<SEL,BOOL> methodsIncluded; // by selector for current patterns
 
+// method patterns are matched per line against all names of a class at once
 + (BOOL)includeMethods:(NSString *)pattern {
-    return (includeMethods = [self getRegexp:pattern]) != NULL;
+    methodsIncluded.clear();
+    return (includeMethods = [self getRegexp:pattern options:NSRegularExpressionAnchorsMatchLines]) != NULL;
 }
 
 + (BOOL)excludeMethods:(NSString *)pattern {
-    return (excludeMethods = [self getRegexp:pattern]) != NULL;
+    methodsIncluded.clear();
+    return (excludeMethods = [self getRegexp:pattern options:NSRegularExpressionAnchorsMatchLines]) != NULL;
 }
 
 + (BOOL)excludeTypes:(NSString *)pattern {
@@ -232,10 +713,14 @@ static NSRegularExpression *includeMethods, *excludeMethods, *excludeTypes;
 }
 
 + (NSRegularExpression *)getRegexp:(NSString *)pattern {
+    return [self getRegexp:pattern options:0];
+}
+
++ (NSRegularExpression *)getRegexp:(NSString *)pattern options:(NSRegularExpressionOptions)options {
     if ( !pattern )
         return nil;
     NSError *error = nil;
-    NSRegularExpression *regexp = [[NSRegularExpression alloc] initWithPattern:pattern options:0 error:&error];
+    NSRegularExpression *regexp = [[NSRegularExpression alloc] initWithPattern:pattern options:options error:&error];
     if ( error )
         NSLog( @"Xtrace: Filter compilation error: %@, in pattern: \"%@\"", [error localizedDescription], pattern );
     return regexp;
@@ -249,29 +734,39 @@ static const char *noColor = "", *traceColor = noColor;
 }
 
 + (void)useColor:(const char *)color forSelector:(SEL)sel {
+    struct _xtrace_locked locked;
     if ( !color ) color = noColor;
     selectorColors[sel] = color;
+    for ( auto &byClass : originals ) {
+        auto bySel = byClass.second.find( sel );
+        if ( bySel != byClass.second.end() )
+            bySel->second.selectorColor = color;
+    }
 }
 
 + (void)useColor:(const char *)color forClass:(Class)aClass {
+    struct _xtrace_locked locked;
     if ( !color ) color = noColor;
     Class metaClass = object_getClass(aClass);
     tracedClasses[metaClass] = color;
     tracedClasses[aClass] = color;
+    publishClass( metaClass );
+    publishClass( aClass );
 }
 
 + (void)traceClass:(Class)aClass mtype:(const char *)mtype levels:(int)levels {
+    struct _xtrace_locked locked;
 
     if ( !tracedClasses[aClass] )
         tracedClasses[aClass] = traceColor;
     swizzledClasses[aClass] = NO;
+    publishClass( aClass );
 
     // yes, this is a hack
     if ( !excludeMethods )
         [self excludeMethods:@XTRACE_EXCLUSIONS];
 
     Class nsObject = [NSObject class], nsObjectMeta = object_getClass( nsObject );
-    NSMutableString *nameStr = [NSMutableString new];
     int depth = [self depth:aClass];
 
     for ( int l=0 ; l<levels ; l++ ) {
@@ -280,35 +775,33 @@ static const char *noColor = "", *traceColor = noColor;
             unsigned mc = 0;
             const char *className = class_getName(aClass);
             Method *methods = class_copyMethodList(aClass, &mc);
+            [self filterMethods:methods count:mc];
 
            for( unsigned i=0; methods && i<mc; i++ ) {
                 const char *type = method_getTypeEncoding(methods[i]);
-                const char *name = sel_getName(method_getName(methods[i]));
-                [nameStr appendFormat:@"%s", name];
+                SEL sel = method_getName(methods[i]);
+                const char *name = sel_getName(sel);
 
-                if ( ((includeMethods && ![self string:nameStr matches:includeMethods]) ||
-                      (excludeMethods && [self string:nameStr matches:excludeMethods])) )
+                if ( !methodsIncluded[sel] )
                    ;//NSLog( @"Xtrace: filters exclude: %s[%s %s] %s", mtype, className, name, type );
 
                 else if ( (excludeTypes && [self string:[NSString stringWithUTF8String:type] matches:excludeTypes]) )
                     NSLog( @"Xtrace: type filter excludes: %s[%s %s] %s", mtype, className, name, type );
 
                 else if ( name[0] == '.' ||
-                         [nameStr isEqualToString:@"_isDeallocating"] || [nameStr isEqualToString:@"_tryRetain"] ||
-                         [nameStr isEqualToString:@"description"] || [nameStr hasPrefix:@"_description"] ||
-                         [nameStr isEqualToString:@"retain"] || [nameStr isEqualToString:@"release"] /*||
-                         [nameStr isEqualToString:@"dealloc"] || [nameStr hasPrefix:@"_dealloc"]*/ )
+                         strcmp(name, "_isDeallocating") == 0 || strcmp(name, "_tryRetain") == 0 ||
+                         strcmp(name, "description") == 0 || strncmp(name, "_description", 12) == 0 ||
+                         strcmp(name, "retain") == 0 || strcmp(name, "release") == 0 /*||
+                         strcmp(name, "dealloc") == 0 || strncmp(name, "_dealloc", 8) == 0*/ )
                     ; // best avoided
 
 #ifdef __IPHONE_OS_VERSION_MIN_REQUIRED
-                else if ( aClass == [UIView class] && [nameStr isEqualToString:@"drawRect:"] )
+                else if ( aClass == [UIView class] && strcmp(name, "drawRect:") == 0 )
                     ; // no idea why this is a problem...
 #endif
 
                 else if (params.includeProperties || !class_getProperty( aClass, name ))
                     [self intercept:aClass method:methods[i] mtype:mtype depth:depth];
-
-               [nameStr setString:@""];
             }
 
             swizzledClasses[aClass] = YES;
@@ -321,16 +814,61 @@ static const char *noColor = "", *traceColor = noColor;
     }
 }
 
+// decides inclusion of any selectors not seen before in one pass of each pattern
++ (void)filterMethods:(Method *)methods count:(unsigned)mc {
+    NSMutableString *names = [NSMutableString new];
+    std::vector<SEL> pending;
+    std::vector<NSUInteger> starts;
+
+    for ( unsigned i=0 ; methods && i<mc ; i++ ) {
+        SEL sel = method_getName(methods[i]);
+        if ( exists( methodsIncluded, sel ) )
+            continue;
+        methodsIncluded[sel] = NO;
+        starts.push_back( [names length] );
+        pending.push_back( sel );
+        [names appendFormat:@"%s\n", sel_getName(sel)];
+    }
+
+    if ( pending.empty() )
+        return;
+
+    std::vector<BOOL> included( pending.size(), !includeMethods ), excluded( pending.size(), NO );
+    NSUInteger *lineStarts = starts.data(), lines = starts.size();
+    NSRange all = NSMakeRange( 0, [names length] );
+
+    BOOL *includedLines = included.data(), *excludedLines = excluded.data();
+    [includeMethods enumerateMatchesInString:names options:0 range:all
+                                  usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
+        includedLines[std::upper_bound( lineStarts, lineStarts + lines, result.range.location ) - lineStarts - 1] = YES;
+    }];
+    [excludeMethods enumerateMatchesInString:names options:0 range:all
+                                  usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
+        excludedLines[std::upper_bound( lineStarts, lineStarts + lines, result.range.location ) - lineStarts - 1] = YES;
+    }];
+
+    for ( size_t i=0 ; i<pending.size() ; i++ )
+        methodsIncluded[pending[i]] = included[i] && !excluded[i];
+}
+
 + (void)traceClassPattern:(NSString *)pattern excluding:(NSString *)exclusions {
     NSRegularExpression *include = [self getRegexp:pattern], *exclude = [self getRegexp:exclusions];
-    unsigned ccount;
-    Class *classes = objc_copyClassList( &ccount );
-    for ( unsigned i=0 ; i<ccount ; i++ ) {
-        NSString *className = [NSString stringWithUTF8String:class_getName(classes[i])];
-        if ( [self string:className matches:include] && (!exclude || ![self string:className matches:exclude]) )
-            [self traceClass:classes[i]];
+    indexClasses();
+
+    pthread_mutex_lock( &classIndexLock );
+    std::vector<const char *> names;
+    for ( auto &image : imageClasses )
+        names.insert( names.end(), image.second.begin(), image.second.end() );
+    pthread_mutex_unlock( &classIndexLock );
+
+    for ( const char *name : names ) {
+        @autoreleasepool {
+            NSString *className = [NSString stringWithUTF8String:name];
+            if ( [self string:className matches:include] && (!exclude || ![self string:className matches:exclude]) )
+                if ( Class aClass = objc_getClass( name ) )
+                    [self traceClass:aClass];
+        }
     }
-    free( classes );
 }
 
 + (BOOL)string:(NSString *)name matches:(NSRegularExpression *)regexp {
@@ -338,321 +876,1149 @@ static const char *noColor = "", *traceColor = noColor;
 }
 
 + (struct _xtrace_info *)infoFor:(Class)aClass sel:(SEL)sel {
-    return &originals[aClass][sel];
+    struct _xtrace_locked locked;
+    struct _xtrace_info *info = &originals[aClass][sel];
+    aggregateStats( *info, NO );
+    return info;
 }
 
-+ (const char *)callerFor:(void *)caller {
-    static std::map<void *,const char *> callers;
+// symbol tables are read once per image, sorted and searched
+// under a lock shared by traced threads and the consumer
+struct _xtrace_symbol {
+    uintptr_t address;
+    const char *name;
+    bool operator < ( const struct _xtrace_symbol &other ) const {
+        return address < other.address;
+    }
+};
+
+#ifdef __LP64__
+typedef struct mach_header_64 xtrace_mach_header;
+typedef struct segment_command_64 xtrace_segment_command;
+typedef struct nlist_64 xtrace_nlist;
+#define XTRACE_LC_SEGMENT LC_SEGMENT_64
+#else
+typedef struct mach_header xtrace_mach_header;
+typedef struct segment_command xtrace_segment_command;
+typedef struct nlist xtrace_nlist;
+#define XTRACE_LC_SEGMENT LC_SEGMENT
+#endif
+
+struct _xtrace_image {
+    uintptr_t start, end;
+    const struct mach_header *header;
+    intptr_t slide;
+    std::vector<struct _xtrace_symbol> *symbols;
+};
+
+static pthread_mutex_t symbolLock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<struct _xtrace_image> images;
+static std::map<void *,const char *> callers;
+static uint32_t imagesIndexed;
+
+static void indexImages() {
+    uint32_t imageCount = _dyld_image_count();
+    if ( imageCount == imagesIndexed )
+        return;
+
+    for ( ; imagesIndexed < imageCount ; imagesIndexed++ ) {
+        struct _xtrace_image image = { 0, 0, _dyld_get_image_header( imagesIndexed ),
+            _dyld_get_image_vmaddr_slide( imagesIndexed ), NULL };
+        const struct load_command *cmd = (const struct load_command *)((const xtrace_mach_header *)image.header + 1);
+        for ( uint32_t i=0 ; image.header && i<image.header->ncmds ; i++ ) {
+            const xtrace_segment_command *segment = (const xtrace_segment_command *)cmd;
+            if ( cmd->cmd == XTRACE_LC_SEGMENT && strcmp( segment->segname, SEG_TEXT ) == 0 ) {
+                image.start = segment->vmaddr + image.slide;
+                image.end = image.start + segment->vmsize;
+                images.push_back( image );
+                break;
+            }
+            cmd = (const struct load_command *)((const char *)cmd + cmd->cmdsize);
+        }
+    }
+
+    std::sort( images.begin(), images.end(), []( const struct _xtrace_image &a, const struct _xtrace_image &b ) {
+        return a.start < b.start;
+    } );
+}
+
+static void loadSymbols( struct _xtrace_image &image ) {
+    image.symbols = new std::vector<struct _xtrace_symbol>();
+    const xtrace_segment_command *linkedit = NULL;
+    const struct symtab_command *symtab = NULL;
+
+    const struct load_command *cmd = (const struct load_command *)((const xtrace_mach_header *)image.header + 1);
+    for ( uint32_t i=0 ; i<image.header->ncmds ; i++ ) {
+        if ( cmd->cmd == XTRACE_LC_SEGMENT && strcmp( ((const xtrace_segment_command *)cmd)->segname, SEG_LINKEDIT ) == 0 )
+            linkedit = (const xtrace_segment_command *)cmd;
+        else if ( cmd->cmd == LC_SYMTAB )
+            symtab = (const struct symtab_command *)cmd;
+        cmd = (const struct load_command *)((const char *)cmd + cmd->cmdsize);
+    }
+    if ( !linkedit || !symtab )
+        return;
 
-    if ( !exists( callers, caller ) ) {
-        Dl_info info;
-        if ( dladdr(caller, &info) && info.dli_sname )
-            callers[caller] = strdup(info.dli_sname);
+    const char *base = (const char *)(linkedit->vmaddr + image.slide - linkedit->fileoff);
+    const xtrace_nlist *symbols = (const xtrace_nlist *)(base + symtab->symoff);
+    const char *strings = base + symtab->stroff;
+
+    for ( uint32_t i=0 ; i<symtab->nsyms ; i++ ) {
+        const xtrace_nlist &symbol = symbols[i];
+        if ( symbol.n_type & N_STAB || (symbol.n_type & N_TYPE) != N_SECT || !symbol.n_un.n_strx )
+            continue;
+        const char *name = strings + symbol.n_un.n_strx;
+        struct _xtrace_symbol entry = { (uintptr_t)(symbol.n_value + image.slide), name[0] == '_' ? name+1 : name };
+        image.symbols->push_back( entry );
     }
 
-    return callers[caller];
+    std::sort( image.symbols->begin(), image.symbols->end() );
+}
+
+// call with symbolLock held
+static const char *symbolFor( void *address ) {
+    auto cached = callers.find( address );
+    if ( cached != callers.end() )
+        return cached->second;
+
+    const char *name = NULL;
+    uintptr_t pc = (uintptr_t)address;
+    auto image = std::upper_bound( images.begin(), images.end(), pc,
+                                  []( uintptr_t value, const struct _xtrace_image &entry ) {
+                                      return value < entry.start;
+                                  } );
+
+    if ( image != images.begin() && pc < (--image)->end ) {
+        if ( !image->symbols )
+            loadSymbols( *image );
+        struct _xtrace_symbol key = { pc, NULL };
+        auto symbol = std::upper_bound( image->symbols->begin(), image->symbols->end(), key );
+        if ( symbol != image->symbols->begin() )
+            name = (--symbol)->name;
+    }
+
+    Dl_info info;
+    if ( !name && dladdr( address, &info ) && info.dli_sname )
+        name = strdup( info.dli_sname );
+
+    return callers[address] = name;
+}
+
+// resolves a batch of addresses taking the lock only once
+static void symbolicate( std::vector<void *> &addresses ) {
+    std::sort( addresses.begin(), addresses.end() );
+    pthread_mutex_lock( &symbolLock );
+    indexImages();
+    for ( void *address : addresses )
+        symbolFor( address );
+    pthread_mutex_unlock( &symbolLock );
+}
+
++ (const char *)callerFor:(void *)caller {
+    pthread_mutex_lock( &symbolLock );
+    indexImages();
+    const char *symbol = symbolFor( caller );
+    pthread_mutex_unlock( &symbolLock );
+    return symbol;
 }
 
 + (const char *)callerFor:(Class)aClass sel:(SEL)sel {
+    struct _xtrace_locked locked;
     return [self callerFor:originals[aClass][sel].caller];
 }
 
-// should really be per-thread but can deadlock
-static struct { int indent;  BOOL describing; } state;
+// callers resolved for live logging, read by traced threads without a lock.
+// Slots are claimed once per address and named later on a background queue
+#define XTRACE_RESOLVED_SIZE 4096
+#define XTRACE_RESOLVED_PROBES 16
 
-#define APPEND_TYPE( _enc, _fmt, _type ) case _enc: [args appendFormat:_fmt, va_arg(*argp,_type)]; return YES;
+struct _xtrace_resolved {
+    std::atomic<void *> address;
+    std::atomic<const char *> name; // NULL until resolved
+};
 
-static BOOL formatValue( const char *type, void *valptr, va_list *argp, NSMutableString *args ) {
-    switch ( type[0] == 'r' ? type[1] : type[0] ) {
-        case 'V': case 'v':
+static struct _xtrace_resolved resolvedCallers[XTRACE_RESOLVED_SIZE];
+
+static const char *resolvedCaller( void *caller ) {
+    static dispatch_queue_t symbolQueue;
+    static dispatch_once_t once;
+    dispatch_once( &once, ^{
+        symbolQueue = dispatch_queue_create( "Xtrace.symbols", DISPATCH_QUEUE_SERIAL );
+    } );
+
+    uintptr_t hash = (uintptr_t)caller >> 2;
+    for ( int probe=0 ; probe<XTRACE_RESOLVED_PROBES ; probe++ ) {
+        struct _xtrace_resolved *slot = &resolvedCallers[(hash + probe) % XTRACE_RESOLVED_SIZE];
+        void *address = slot->address.load( std::memory_order_acquire );
+        if ( !address && slot->address.compare_exchange_strong( address, caller ) ) {
+            dispatch_async( symbolQueue, ^{
+                const char *name = [Xtrace callerFor:caller];
+                slot->name.store( name ? name : "", std::memory_order_release );
+            } );
+            return NULL;
+        }
+        if ( address == caller )
+            return slot->name.load( std::memory_order_acquire );
+    }
+
+    return NULL;
+}
+
+// readers of the arguments captured by a trampoline in the order they
+// were passed. Return values are copied into the words and read as bytes
+static void xargValue( struct _xtrace_args *args, void *dest, size_t size ) {
+    size_t offset = MIN( (size_t)args->word, sizeof args->words );
+    memset( dest, 0, size );
+    memcpy( dest, (char *)args->words + offset, MIN( size, sizeof args->words - offset ) );
+    args->word += (int)size;
+}
+
+// arguments beyond the registers, packed by natural alignment on arm64
+static void xargStack( struct _xtrace_args *args, void *dest, size_t size ) {
+#ifdef __arm64__
+    size_t align = MIN( size, sizeof(void *) ), used = size;
+#else
+    size_t align = sizeof(void *), used = (size + align - 1) / align * align;
+#endif
+    size_t offset = (args->stack + align - 1) / align * align,
+        limit = (XTRACE_ARG_WORDS - args->regs) * sizeof(void *);
+    memset( dest, 0, size );
+    if ( offset < limit )
+        memcpy( dest, (char *)&args->words[args->regs] + offset, MIN( size, limit - offset ) );
+    args->stack = (int)(offset + used);
+}
+
+// integers, pointers and small structs are passed in registers when they all fit
+static void xargWords( struct _xtrace_args *args, void *dest, size_t size ) {
+    if ( args->value ) {
+        xargValue( args, dest, size );
+        return;
+    }
+
+    int words = (int)((size + sizeof(void *) - 1) / sizeof(void *));
+    if ( args->word + words <= args->regs ) {
+        memcpy( dest, &args->words[args->word], size );
+        args->word += words;
+        return;
+    }
+
+#ifdef __arm64__
+    args->word = args->regs; // nothing more is passed in registers
+#endif
+    xargStack( args, dest, size );
+}
+
+// floats and doubles (and structs of them) have registers of their own on 64 bit
+static void xargFloating( struct _xtrace_args *args, void *dest, size_t size, int count ) {
+    if ( args->value ) {
+        xargValue( args, dest, size * count );
+        return;
+    }
+
+#ifdef __LP64__
+    if ( args->fp + count <= XTRACE_ARG_DOUBLES ) {
+        for ( int i=0 ; i<count ; i++ )
+            memcpy( (char *)dest + i * size, &args->doubles[args->fp++], size );
+        return;
+    }
+#ifdef __arm64__
+    args->fp = XTRACE_ARG_DOUBLES;
+#endif
+#endif
+    xargStack( args, dest, size * count );
+}
+
+// structs of CGFloats, passed by reference on arm64 when more than four
+// and in memory on x86_64 when larger than two words
+static BOOL xargCGFloats( struct _xtrace_args *args, CGFloat *dest, int count, BOOL recorded ) {
+#ifdef __arm64__
+    if ( !args->value && count > 4 ) {
+        CGFloat *ref;
+        xargWords( args, &ref, sizeof ref );
+        if ( recorded || !ref )
             return NO;
+        memcpy( dest, ref, count * sizeof *dest );
+        return YES;
+    }
+#elif defined(__x86_64__)
+    if ( !args->value && count > 2 ) {
+        xargStack( args, dest, count * sizeof *dest );
+        return YES;
+    }
+#endif
+    xargFloating( args, dest, sizeof *dest, count );
+    return YES;
+}
+
+template <typename _type>
+static inline void xargRead( struct _xtrace_args *args, _type &value ) {
+    xargWords( args, &value, sizeof value );
+}
 
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wvarargs"
-        // warnings here are necessary evil
-        APPEND_TYPE( 'B', @"%d", bool )
-        APPEND_TYPE( 'c', @"%d", char )
-        APPEND_TYPE( 'C', @"%d", unsigned char )
-        APPEND_TYPE( 's', @"%d", short )
-        APPEND_TYPE( 'S', @"%d", unsigned short )
-        APPEND_TYPE( 'i', @"%d", int )
-        APPEND_TYPE( 'I', @"%u", unsigned )
-        APPEND_TYPE( 'f', @"%f", float )
-#pragma clang diagnostic pop
-        APPEND_TYPE( 'd', @"%f", double )
-        APPEND_TYPE( '^', @"%p", void * )
-        APPEND_TYPE( '*', @"\"%.100s\"", char * )
+static inline void xargRead( struct _xtrace_args *args, float &value ) {
+    xargFloating( args, &value, sizeof value, 1 );
+}
+
+static inline void xargRead( struct _xtrace_args *args, double &value ) {
+    xargFloating( args, &value, sizeof value, 1 );
+}
+
+// makes a return value readable by a formatter
+static void xargReturned( struct _xtrace_args &args, const void *value, size_t size ) {
+    memset( &args, 0, sizeof args );
+    args.value = YES;
+    if ( value )
+        memcpy( args.words, value, MIN( size, sizeof args.words ) );
+}
+
+// formatters are chosen once per argument when a method is intercepted
+// "recorded" values may no longer be valid so pointers are not followed
+#define FORMATTER( _name, _fmt, _type ) \
+static BOOL _name( const char *type, struct _xtrace_args *args, NSMutableString *out, BOOL recorded ) { \
+    _type value; \
+    xargRead( args, value ); \
+    [out appendFormat:_fmt, value]; \
+    return YES; \
+}
+
+FORMATTER( formatBool, @"%d", bool )
+FORMATTER( formatChar, @"%d", char )
+FORMATTER( formatUChar, @"%d", unsigned char )
+FORMATTER( formatShort, @"%d", short )
+FORMATTER( formatUShort, @"%d", unsigned short )
+FORMATTER( formatInt, @"%d", int )
+FORMATTER( formatUInt, @"%u", unsigned )
+FORMATTER( formatFloat, @"%f", float )
+FORMATTER( formatDouble, @"%f", double )
+FORMATTER( formatPointer, @"%p", void * )
 #ifndef __LP64__
-        APPEND_TYPE( 'q', @"%lldLL", long long )
+FORMATTER( formatLongLong, @"%lldLL", long long )
+FORMATTER( formatULongLong, @"%lluLL", unsigned long long )
+#endif
+FORMATTER( formatLong, @"%ldL", long )
+FORMATTER( formatULong, @"%luL", unsigned long )
+
+static BOOL formatVoid( const char *type, struct _xtrace_args *args, NSMutableString *out, BOOL recorded ) {
+    return NO;
+}
+
+static BOOL formatUnknown( const char *type, struct _xtrace_args *args, NSMutableString *out, BOOL recorded ) {
+    [out appendFormat:@"<?? %.50s>", type];
+    return NO;
+}
+
+static BOOL formatCString( const char *type, struct _xtrace_args *args, NSMutableString *out, BOOL recorded ) {
+    const char *str;
+    xargRead( args, str );
+    if ( recorded )
+        [out appendFormat:@"(char *)%p", str];
+    else
+        [out appendFormat:@"\"%.100s\"", str];
+    return YES;
+}
+
+static BOOL formatSelector( const char *type, struct _xtrace_args *args, NSMutableString *out, BOOL recorded ) {
+    SEL sel;
+    xargRead( args, sel );
+    if ( recorded )
+        [out appendFormat:@"(SEL)%p", (void *)sel];
+    else
+        [out appendFormat:@"@selector(%s)", sel_getName(sel)];
+    return YES;
+}
+
+static BOOL formatObject( const char *type, struct _xtrace_args *args, NSMutableString *out, BOOL recorded ) {
+    void *ptr;
+    xargRead( args, ptr );
+    XTRACE_UNSAFE id obj = XTRACE_BRIDGE(id)ptr;
+    if ( recorded )
+        [out appendFormat:@"<id %p>", ptr];
+    else if ( [obj isKindOfClass:[NSString class]] )
+        [out appendFormat:@"@\"%@\"", obj];
+    else if ( params.describeValues ) {
+        struct _xtrace_thread &thread = currentThread();
+        thread.describing = YES;
+        [out appendString:obj?[obj description]:@"<nil>"];
+        thread.describing = NO;
+    }
+    else
+        [out appendFormat:@"<%s %p>", class_getName(object_getClass(obj)), ptr];
+    return YES;
+}
+
+#define STRUCT_FORMATTER( _name, _type, _toString ) \
+static BOOL _name( const char *type, struct _xtrace_args *args, NSMutableString *out, BOOL recorded ) { \
+    _type value; \
+    if ( xargCGFloats( args, (CGFloat *)&value, (int)(sizeof value / sizeof(CGFloat)), recorded ) ) \
+        [out appendString:_toString( value )]; \
+    else \
+        [out appendString:@"<" #_type " by reference>"]; \
+    return YES; \
+}
+
+#ifdef __IPHONE_OS_VERSION_MIN_REQUIRED
+STRUCT_FORMATTER( formatRect, CGRect, NSStringFromCGRect )
+STRUCT_FORMATTER( formatPoint, CGPoint, NSStringFromCGPoint )
+STRUCT_FORMATTER( formatSize, CGSize, NSStringFromCGSize )
+STRUCT_FORMATTER( formatTransform, CGAffineTransform, NSStringFromCGAffineTransform )
+STRUCT_FORMATTER( formatInsets, UIEdgeInsets, NSStringFromUIEdgeInsets )
+STRUCT_FORMATTER( formatOffset, UIOffset, NSStringFromUIOffset )
 #else
-        case 'q':
+STRUCT_FORMATTER( formatRect, NSRect, NSStringFromRect )
+STRUCT_FORMATTER( formatPoint, NSPoint, NSStringFromPoint )
+STRUCT_FORMATTER( formatSize, NSSize, NSStringFromSize )
 #endif
-        APPEND_TYPE( 'l', @"%ldL", long )
+
+static BOOL formatNSRange( const char *type, struct _xtrace_args *args, NSMutableString *out, BOOL recorded ) {
+    NSRange value;
+    xargRead( args, value );
+    [out appendString:NSStringFromRange( value )];
+    return YES;
+}
+
+static XTRACE_FORMATTER compileFormatter( const char *type ) {
+    if ( !type )
+        return NULL;
+
+    switch ( type[0] == 'r' ? type[1] : type[0] ) {
+        case 'V': case 'v': return formatVoid;
+        case 'B': return formatBool;
+        case 'c': return formatChar;
+        case 'C': return formatUChar;
+        case 's': return formatShort;
+        case 'S': return formatUShort;
+        case 'i': return formatInt;
+        case 'I': return formatUInt;
+        case 'f': return formatFloat;
+        case 'd': return formatDouble;
+        case '^': return formatPointer;
+        case '*': return formatCString;
 #ifndef __LP64__
-        APPEND_TYPE( 'Q', @"%lluLL", unsigned long long )
+        case 'q': return formatLongLong;
+        case 'Q': return formatULongLong;
 #else
+        case 'q':
+#endif
+        case 'l': return formatLong;
+#ifdef __LP64__
         case 'Q':
 #endif
-        APPEND_TYPE( 'L', @"%luL", unsigned long )
-        case ':':
-            [args appendFormat:@"@selector(%s)", sel_getName(va_arg(*argp,SEL))];
-            return YES;
-        case '#': case '@': {
-            XTRACE_UNSAFE id obj = va_arg(*argp,XTRACE_UNSAFE id);
-            if ( [obj isKindOfClass:[NSString class]] )
-                [args appendFormat:@"@\"%@\"", obj];
-            else if ( params.describeValues ) {
-                state.describing = YES;
-                [args appendString:obj?[obj description]:@"<nil>"];
-                state.describing = NO;
-            }
-            else
-                [args appendFormat:@"<%s %p>", class_getName(object_getClass(obj)), obj];
-            return YES;
-        }
+        case 'L': return formatULong;
+        case ':': return formatSelector;
+        case '#': case '@': return formatObject;
         case '{':
 #ifdef __IPHONE_OS_VERSION_MIN_REQUIRED
             if ( strncmp(type,"{CGRect=",8) == 0 )
-                [args appendString:NSStringFromCGRect( va_arg(*argp,CGRect) )];
+                return formatRect;
             else if ( strncmp(type,"{CGPoint=",9) == 0 )
-                [args appendString:NSStringFromCGPoint( va_arg(*argp,CGPoint) )];
+                return formatPoint;
             else if ( strncmp(type,"{CGSize=",8) == 0 )
-                [args appendString:NSStringFromCGSize( va_arg(*argp,CGSize) )];
+                return formatSize;
             else if ( strncmp(type,"{CGAffineTransform=",19) == 0 )
-                [args appendString:NSStringFromCGAffineTransform( va_arg(*argp,CGAffineTransform) )];
+                return formatTransform;
             else if ( strncmp(type,"{UIEdgeInsets=",14) == 0 )
-                [args appendString:NSStringFromUIEdgeInsets( va_arg(*argp,UIEdgeInsets) )];
+                return formatInsets;
             else if ( strncmp(type,"{UIOffset=",10) == 0 )
-                [args appendString:NSStringFromUIOffset( va_arg(*argp,UIOffset) )];
+                return formatOffset;
 #else
             if ( strncmp(type,"{_NSRect=",9) == 0 || strncmp(type,"{CGRect=",8) == 0 )
-                [args appendString:NSStringFromRect( va_arg(*argp,NSRect) )];
+                return formatRect;
             else if ( strncmp(type,"{_NSPoint=",10) == 0 || strncmp(type,"{CGPoint=",9) == 0 )
-                [args appendString:NSStringFromPoint( va_arg(*argp,NSPoint) )];
+                return formatPoint;
             else if ( strncmp(type,"{_NSSize=",9) == 0 || strncmp(type,"{CGSize=",8) == 0 )
-                [args appendString:NSStringFromSize( va_arg(*argp,NSSize) )];
+                return formatSize;
 #endif
             else if ( strncmp(type,"{_NSRange=",10) == 0 )
-                [args appendString:NSStringFromRange( va_arg(*argp,NSRange) )];
-            else
-                break;
-            return YES;
+                return formatNSRange;
     }
 
-    [args appendFormat:@"<?? %.50s>", type];
-    return NO;
+    return formatUnknown;
 }
 
-struct _xtrace_depth {
-    XTRACE_UNSAFE id obj; SEL sel; int depth;
-};
-
-static id nullImpl( XTRACE_UNSAFE __unused id obj, __unused SEL sel, ... ) {
-    return nil;
+static bool instanceTraced( XTRACE_UNSAFE id obj ) {
+    struct _xtrace_locked locked;
+    return exists( tracedInstances, obj );
 }
 
-// find original implmentation for message and log call
-static struct _xtrace_info &findOriginal( struct _xtrace_depth *info, SEL sel, ... ) {
-    va_list argp; va_start(argp, sel);
-    Class aClass = object_getClass( info->obj );
+// log call to the original implementation the trampoline was bound to
+static struct _xtrace_local &findOriginal( struct _xtrace_info &orig, XTRACE_UNSAFE id obj, void *caller, struct _xtrace_args *args ) {
+    Class aClass = object_getClass( obj );
     const char *className = class_getName( aClass );
+    Class implementingClass = orig.aClass;
+    orig.lastObj = XTRACE_BRIDGE(void*)obj;
+    orig.caller = caller;
 
-    while ( aClass && (!exists( originals[aClass], sel ) ||
-                       originals[aClass][sel].depth != info->depth) )
-        aClass = class_getSuperclass( aClass );
-
-    struct _xtrace_info &orig = originals[aClass][sel];
-    orig.lastObj = XTRACE_BRIDGE(void*)info->obj;
-    orig.caller = __builtin_return_address(1);
-
-    if ( !aClass ) {
-        NSLog( @"Xtrace: could not find original implementation for [%s %s]", className, sel_getName(sel) );
-        orig.original = (XTRACE_VIMP)nullImpl;
-    }
-
-    static char KVO_prefix[] = "NSKVONotifying_";
-    while ( aClass && strncmp( class_getName(aClass), KVO_prefix, sizeof(KVO_prefix)-1 ) == 0 )
-        aClass = class_getSuperclass(aClass);
-
-    Class implementingClass = aClass;
-    aClass = object_getClass( info->obj );
+    struct _xtrace_thread &thread = currentThread();
+    struct _xtrace_local &local = threadLocal( thread, orig );
 
     // add custom filtering of logging here..
-    if ( !state.describing && orig.mtype &&
-        (exists( tracingInstances, aClass ) ?
-         exists( tracedInstances, info->obj ) :
-         tracedClasses[aClass] != nil) )
-        orig.color = exists( selectorColors, sel ) ?
-                selectorColors[sel] : tracedClasses[aClass];
+    const struct _xtrace_class *traced = findClass( aClass );
+    const char *color = traced ? traced->color.load( std::memory_order_relaxed ) : NULL;
+    if ( color && orig.selectorColor )
+        color = orig.selectorColor;
+    if ( !thread.describing && orig.mtype && color &&
+        (!traced->tracingInstances.load( std::memory_order_relaxed ) || instanceTraced( obj )) )
+        local.color = color;
     else
-        orig.color = NULL;
-
-    if ( orig.color ) {
-        NSMutableString *args = [NSMutableString string];
+        local.color = NULL;
 
-        const char *symbol;
-        if ( params.showCaller && state.indent == 0 &&
-            (symbol = [Xtrace callerFor:orig.caller]) && symbol[0] != '<' ) {
-            [args appendFormat:@"From: %s", symbol];
-            [params.logToDelegate ? delegate : [Xtrace class] xtrace:args forInstance:orig.lastObj indent:-2];
-            [args setString:@""];
+    const char *slowColor = NULL;
+    if ( local.color && sampling.slowerThan > 0 ) {
+        slowColor = local.color;
+        local.color = NULL;
+    }
+    else if ( local.color && !sampled( local ) )
+        local.color = NULL;
+
+    if ( local.color && params.recording ) {
+        if ( struct _xtrace_event *event = recordEvent( thread ) ) {
+            event->orig = &orig;
+            event->aClass = aClass;
+            event->implementingClass = implementingClass;
+            event->caller = thread.indent == 0 ? orig.caller : NULL;
+            event->obj = XTRACE_BRIDGE(void *)obj;
+            event->color = local.color;
+            event->indent = thread.indent;
+            event->returned = NO;
+            event->args = *args;
+            commitEvent( thread );
+        }
+        thread.indent++;
+    }
+    else if ( local.color ) {
+        NSMutableString *out = [NSMutableString string];
+
+        // symbols are looked up in the background, the address is shown until then
+        const char *symbol = NULL;
+        if ( params.showCaller && thread.indent == 0 &&
+            (!(symbol = resolvedCaller( orig.caller )) || (symbol[0] && symbol[0] != '<')) ) {
+            if ( symbol )
+                [out appendFormat:@"From: %s", symbol];
+            else
+                [out appendFormat:@"From: %p", orig.caller];
+            [params.logToDelegate ? delegate : [Xtrace class] xtrace:out forInstance:orig.lastObj indent:-2];
+            [out setString:@""];
         }
 
-        if ( orig.color && orig.color[0] )
-            [args appendFormat:@"%s", orig.color];
+        if ( local.color[0] )
+            [out appendFormat:@"%s", local.color];
+        if ( params.showThread )
+            [out appendFormat:@"T%d ", thread.number];
 
         if ( orig.mtype[0] == '+' )
-            [args appendFormat:@"%*s%s[%s",
-             state.indent++*indentScale, "", orig.mtype, className];
+            [out appendFormat:@"%*s%s[%s",
+             thread.indent++*indentScale, "", orig.mtype, className];
         else
-            [args appendFormat:@"%*s%s[<%s %p>",
-             state.indent++*indentScale, "", orig.mtype, className, info->obj];
+            [out appendFormat:@"%*s%s[<%s %p>",
+             thread.indent++*indentScale, "", orig.mtype, className, obj];
 
         if ( params.showActual && implementingClass != aClass )
-            [args appendFormat:@"/%s", class_getName(implementingClass)];
+            [out appendFormat:@"/%s", class_getName(implementingClass)];
 
         if ( !params.showArguments )
-            [args appendFormat:@" %s", orig.name];
+            [out appendFormat:@" %s", orig.name];
         else {
-            const char *frame = (char *)(void *)&info+sizeof info;
-            void *valptr = NULL;
-
             BOOL typesKnown = YES;
             for ( struct _xtrace_arg *aptr = orig.args ; *aptr->name ; aptr++ ) {
-                [args appendFormat:@" %.*s", (int)(aptr[1].name-aptr->name), aptr->name];
+                [out appendFormat:@" %.*s", (int)(aptr[1].name-aptr->name), aptr->name];
                 if ( !aptr->type )
                     break;
 
-                valptr = (void *)(frame+aptr[1].stackOffset);
                 typesKnown = typesKnown &&
-                    formatValue( aptr->type, valptr, &argp, args );
+                    aptr->formatter( aptr->type, args, out, NO );
             }
         }
 
-        [args appendString:@"]"];
+        [out appendString:@"]"];
         if ( params.showSignature )
-            [args appendFormat:@" %.100s %p", orig.type, orig.original];
-        if ( orig.color && orig.color[0] )
-            [args appendString:@"\033[;"];
-        [params.logToDelegate ? delegate : [Xtrace class] xtrace:args forInstance:orig.lastObj indent:state.indent];
+            [out appendFormat:@" %.100s %p", orig.type, orig.original];
+        if ( local.color[0] )
+            [out appendString:@"\033[;"];
+        [params.logToDelegate ? delegate : [Xtrace class] xtrace:out forInstance:orig.lastObj indent:thread.indent];
     }
 
-    orig.stats.entered = [NSDate timeIntervalSinceReferenceDate];
-    orig.stats.callCount++;
-    return orig;
+    local.callCount++;
+    local.active++;
+    if ( thread.depth < XTRACE_MAX_DEPTH ) {
+        struct _xtrace_frame &frame = thread.stack[thread.depth];
+        frame.children = 0;
+        frame.node = childNode( thread.depth ? thread.stack[thread.depth-1].node : &thread.root,
+                               &orig, implementingClass );
+        frame.slowColor = slowColor;
+        frame.entered = mach_absolute_time();
+    }
+    thread.depth++;
+    return local;
 }
 
 // log returning value
-static void returning( struct _xtrace_info *orig, ... ) {
-    va_list argp; va_start(argp, orig);
-    if ( state.indent > 0 )
-        state.indent--;
-
-    orig->stats.elapsed += [NSDate timeIntervalSinceReferenceDate] - orig->stats.entered;
+static void returning( struct _xtrace_info *orig, struct _xtrace_local *local, const void *value, size_t size ) {
+    struct _xtrace_thread &thread = currentThread();
+    if ( thread.indent > 0 )
+        thread.indent--;
+
+    uint64_t now = mach_absolute_time();
+    if ( local->active )
+        local->active--;
+    if ( thread.depth > 0 && --thread.depth < XTRACE_MAX_DEPTH ) {
+        struct _xtrace_frame &frame = thread.stack[thread.depth];
+        uint64_t inclusive = now - frame.entered;
+        // outermost activation only so recursion isn't counted twice
+        if ( !local->active )
+            local->inclusive += inclusive;
+        local->exclusive += inclusive - MIN( frame.children, inclusive );
+        local->max = MAX( local->max, inclusive );
+        local->histogram[histogramBucket( inclusive )]++;
+        frame.node->calls++;
+        frame.node->inclusive += inclusive;
+        frame.node->exclusive += inclusive - MIN( frame.children, inclusive );
+        if ( thread.depth > 0 )
+            thread.stack[thread.depth-1].children += inclusive;
+
+        if ( frame.slowColor && inclusive * tickSeconds() >= sampling.slowerThan && sampled( *local ) ) {
+            NSMutableString *slow = [NSMutableString stringWithUTF8String:frame.slowColor];
+            if ( params.showThread )
+                [slow appendFormat:@"T%d ", thread.number];
+            [slow appendFormat:@"%*s%s[%s %s] %.3fms", thread.indent*indentScale, "", orig->mtype,
+             class_getName(frame.node->aClass), orig->name, inclusive * tickSeconds() * 1000.];
+            if ( frame.slowColor[0] )
+                [slow appendString:@"\033[;"];
+            [params.logToDelegate ? delegate : [Xtrace class] xtrace:slow forInstance:orig->lastObj indent:thread.indent];
+        }
+    }
 
-    if ( orig->color && params.showReturns ) {
+    if ( local->color && params.showReturns && params.recording ) {
+        if ( struct _xtrace_event *event = recordEvent( thread ) ) {
+            event->orig = orig;
+            event->obj = orig->lastObj;
+            event->caller = NULL;
+            event->color = local->color;
+            event->indent = thread.indent;
+            event->returned = YES;
+            xargReturned( event->args, value, size );
+            commitEvent( thread );
+        }
+    }
+    else if ( local->color && params.showReturns ) {
         NSMutableString *val = [NSMutableString string];
-        [val appendFormat:@"%s%*s-> ", orig->color, state.indent*indentScale, ""];
-        if ( formatValue(orig->type, NULL, &argp, val) ) {
+        [val appendFormat:@"%s", local->color];
+        if ( params.showThread )
+            [val appendFormat:@"T%d ", thread.number];
+        [val appendFormat:@"%*s-> ", thread.indent*indentScale, ""];
+        struct _xtrace_args result;
+        xargReturned( result, value, size );
+        if ( orig->returnFormatter( orig->type, &result, val, NO ) ) {
             [val appendFormat:@" (%s)", orig->name];
-            if ( orig->color && orig->color[0] )
+            if ( local->color[0] )
                 [val appendString:@"\033[;"];
             [params.logToDelegate ? delegate : [Xtrace class] xtrace:val forInstance:orig->lastObj indent:-1];
         }
     }
 }
 
-#define ARG_SIZE (sizeof(id) + sizeof(SEL) + sizeof(void *)*9) // approximate to say the least..
-#ifndef __LP64__
-#define ARG_DEFS void *a0, void *a1, void *a2, void *a3, void *a4, void *a5, void *a6, void *a7, void *a8, void *a9
-#define ARG_COPY a0, a1, a2, a3, a4, a5, a6, a7, a8, a9
-#else
-#define ARG_DEFS void *a0, void *a1, void *a2, void *a3, void *a4, void *a5, void *a6, void *a7, void *a8, void *a9, double d0, double d1, double d2, double d3, double d4, double d5, double d6, double d7
-#define ARG_COPY a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, d0, d1, d2, d3, d4, d5, d6, d7
-#endif
+static uint64_t recordingStarted;
+
+// formats recorded arguments as they were received by the trampoline,
+// class names are passed in as the event may have been read from a file
+static void formatRecorded( const struct _xtrace_event *event, struct _xtrace_info &orig, const char *className,
+                           const char *actualName, double seconds, int thread, NSMutableString *out ) {
+    struct _xtrace_args args = event->args;
+
+    if ( event->color[0] )
+        [out appendString:@(event->color)];
+    if ( params.showThread )
+        [out appendFormat:@"T%d ", thread];
+    [out appendFormat:@"%.6f ", seconds];
+
+    if ( event->returned ) {
+        [out appendFormat:@"%*s-> ", event->indent*indentScale, ""];
+        if ( !orig.returnFormatter( orig.type, &args, out, YES ) )
+            [out setString:@""];
+        else
+            [out appendFormat:@" (%s)", orig.name];
+    }
+    else {
+        if ( orig.mtype[0] == '+' )
+            [out appendFormat:@"%*s%s[%s", event->indent*indentScale, "",
+             orig.mtype, className];
+        else
+            [out appendFormat:@"%*s%s[<%s %p>", event->indent*indentScale, "",
+             orig.mtype, className, event->obj];
+
+        if ( params.showActual && actualName )
+            [out appendFormat:@"/%s", actualName];
+
+        if ( !params.showArguments )
+            [out appendFormat:@" %s", orig.name];
+        else
+            for ( struct _xtrace_arg *aptr = orig.args ; *aptr->name ; aptr++ ) {
+                [out appendFormat:@" %.*s", (int)(aptr[1].name-aptr->name), aptr->name];
+                if ( !aptr->type || !aptr->formatter( aptr->type, &args, out, YES ) )
+                    break;
+            }
+
+        [out appendString:@"]"];
+    }
+
+    if ( out.length && event->color[0] )
+        [out appendString:@"\033[;"];
+}
+
+// recordings can instead be written to a file as they are drained and
+// formatted later, possibly by another process of the same architecture.
+// Classes, methods and callers are written once, before the first event
+// to refer to them, as records of a tag byte, an id and strings.
+#define XTRACE_DUMP_MAGIC "Xtrace1"
 
-// replacement implmentations "swizzled" onto class
-// "_depth" is number of levels down from NSObject
-// (used to detect calls to super)
-template <typename _type, int _depth>
-static void xtrace( XTRACE_UNSAFE id obj, SEL sel, ARG_DEFS ) {
-    struct _xtrace_depth info = { obj, sel, _depth };
-    struct _xtrace_info &orig = findOriginal( &info, sel, ARG_COPY );
+struct _xtrace_dump_header {
+    char magic[8];
+    uint32_t pointerSize, argsSize; // must match the reader's
+    uint32_t numer, denom; // mach timebase of the recording
+};
 
-    if ( !orig.callingBack ) {
+struct _xtrace_dumped {
+    int64_t time; // since recording started
+    uint64_t obj;
+    uint32_t method, aClass, implementingClass, caller; // ids of records above
+    int32_t thread, indent;
+    BOOL returned;
+    struct _xtrace_args args;
+};
+
+static FILE *dumpFile;
+static std::map<const void *,uint32_t> dumpIds;
+
+static uint32_t dumpRecord( const void *key, char tag, std::initializer_list<const char *> strings ) {
+    if ( !key )
+        return 0;
+    uint32_t &id = dumpIds[key];
+    if ( !id ) {
+        id = (uint32_t)dumpIds.size();
+        fputc( tag, dumpFile );
+        fwrite( &id, sizeof id, 1, dumpFile );
+        for ( const char *str : strings )
+            fwrite( str ? str : "", 1, strlen( str ? str : "" ) + 1, dumpFile );
+    }
+    return id;
+}
+
+static void dumpEvent( const struct _xtrace_event *event, int thread, const char *symbol ) {
+    struct _xtrace_dumped dumped = {};
+    dumped.time = (int64_t)(event->time - recordingStarted);
+    dumped.obj = (uintptr_t)event->obj;
+    dumped.method = dumpRecord( event->orig, 'M', {event->orig->mtype, event->orig->name, event->orig->type} );
+    if ( !event->returned ) {
+        dumped.aClass = dumpRecord( XTRACE_BRIDGE(const void *)event->aClass, 'S',
+                                   {class_getName( event->aClass )} );
+        dumped.implementingClass = dumpRecord( XTRACE_BRIDGE(const void *)event->implementingClass, 'S',
+                                              {class_getName( event->implementingClass )} );
+    }
+    dumped.caller = dumpRecord( symbol, 'S', {symbol} );
+    dumped.thread = thread;
+    dumped.indent = event->indent;
+    dumped.returned = event->returned;
+    dumped.args = event->args;
+    fputc( 'E', dumpFile );
+    fwrite( &dumped, sizeof dumped, 1, dumpFile );
+}
+
++ (BOOL)recordToFile:(NSString *)path {
+    [self drainRecording];
+    @synchronized ( self ) {
+        if ( dumpFile ) {
+            fclose( dumpFile );
+            dumpFile = NULL;
+            dumpIds.clear();
+        }
+        if ( !path )
+            return YES;
+        if ( !(dumpFile = fopen( [path fileSystemRepresentation], "wb" )) ) {
+            NSLog( @"Xtrace: could not open %@: %s", path, strerror( errno ) );
+            return NO;
+        }
+
+        struct _xtrace_dump_header header = { XTRACE_DUMP_MAGIC, sizeof(void *), sizeof(struct _xtrace_args) };
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info( &timebase );
+        header.numer = timebase.numer;
+        header.denom = timebase.denom;
+        fwrite( &header, sizeof header, 1, dumpFile );
+    }
+    [self record:YES];
+    return YES;
+}
+
++ (BOOL)formatRecording:(NSString *)path {
+    FILE *file = fopen( [path fileSystemRepresentation], "rb" );
+    if ( !file ) {
+        NSLog( @"Xtrace: could not open %@: %s", path, strerror( errno ) );
+        return NO;
+    }
+
+    struct _xtrace_dump_header header, expected = { XTRACE_DUMP_MAGIC, sizeof(void *), sizeof(struct _xtrace_args) };
+    if ( fread( &header, sizeof header, 1, file ) != 1 ||
+        memcmp( &header, &expected, offsetof(struct _xtrace_dump_header, numer) ) != 0 || !header.denom ) {
+        NSLog( @"Xtrace: %@ is not a recording made on this architecture", path );
+        fclose( file );
+        return NO;
+    }
+
+    std::deque<std::string> strings; // referred to by names and methods
+    std::map<uint32_t,const char *> names;
+    std::map<uint32_t,struct _xtrace_info> methods;
+    auto readString = [&]() -> const char * {
+        std::string str;
+        int ch;
+        while ( (ch = getc( file )) != EOF && ch )
+            str += (char)ch;
+        strings.push_back( str );
+        return strings.back().c_str();
+    };
+
+    BOOL complete = YES;
+    uint32_t id;
+    struct _xtrace_dumped dumped;
+    for ( int tag ; (tag = getc( file )) != EOF ; ) {
+        if ( tag == 'S' && fread( &id, sizeof id, 1, file ) == 1 )
+            names[id] = readString();
+        else if ( tag == 'M' && fread( &id, sizeof id, 1, file ) == 1 ) {
+            struct _xtrace_info &orig = methods[id];
+            orig.mtype = readString();
+            orig.name = readString();
+            orig.type = readString();
+            [self compileFormatters:&orig];
+        }
+        else if ( tag == 'E' && fread( &dumped, sizeof dumped, 1, file ) == 1 && exists( methods, dumped.method ) ) {
+            if ( params.showCaller && dumped.caller && names[dumped.caller][0] != '<' )
+                [params.logToDelegate ? delegate : [Xtrace class]
+                 xtrace:[NSString stringWithFormat:@"From: %s", names[dumped.caller]]
+                 forInstance:(void *)(uintptr_t)dumped.obj indent:-2];
+
+            struct _xtrace_event event = {};
+            event.obj = (void *)(uintptr_t)dumped.obj;
+            event.color = noColor;
+            event.indent = dumped.indent;
+            event.returned = dumped.returned;
+            event.args = dumped.args;
+
+            NSMutableString *out = [NSMutableString string];
+            formatRecorded( &event, methods[dumped.method], names[dumped.aClass],
+                           dumped.implementingClass != dumped.aClass ? names[dumped.implementingClass] : NULL,
+                           (double)dumped.time * header.numer / header.denom / 1e9, dumped.thread, out );
+            if ( out.length )
+                [params.logToDelegate ? delegate : [Xtrace class] xtrace:out forInstance:event.obj
+                                                                  indent:event.returned ? -1 : event.indent+1];
+        }
+        else {
+            NSLog( @"Xtrace: %@ is truncated or corrupt", path );
+            complete = NO;
+            break;
+        }
+    }
+
+    fclose( file );
+    return complete;
+}
+
+static std::atomic<bool> consuming;
+
+// calls are recorded in binary and only formatted when drained
++ (void)record:(BOOL)enable {
+    if ( enable && !params.recording )
+        recordingStarted = mach_absolute_time();
+    params.recording = enable;
+    if ( enable && !consuming.exchange( true ) )
+        [NSThread detachNewThreadSelector:@selector(consumeRecording) toTarget:self withObject:nil];
+}
+
+// drains until recording stops and then once more for what is left
++ (void)consumeRecording {
+    do {
+        while ( params.recording ) {
+            @autoreleasepool {
+                [self drainRecording];
+            }
+            [NSThread sleepForTimeInterval:.05];
+        }
+        @autoreleasepool {
+            [self drainRecording];
+        }
+        consuming = false;
+        // unless recording restarted before the flag was cleared
+    } while ( params.recording && !consuming.exchange( true ) );
+}
+
++ (void)drainRecording {
+    @synchronized ( self ) {
+        for ( struct _xtrace_thread *thread = traceThreads.load() ; thread ; thread = thread->next ) {
+            unsigned tail = thread->ringTail.load( std::memory_order_relaxed ),
+                head = thread->ringHead.load( std::memory_order_acquire );
+
+            std::vector<void *> pending;
+            for ( unsigned next = tail ; params.showCaller && next != head ; next++ )
+                if ( void *caller = thread->ring[next % XTRACE_RING_SIZE].caller )
+                    pending.push_back( caller );
+            if ( !pending.empty() )
+                symbolicate( pending );
+
+            for ( ; tail != head ; tail++ ) {
+                struct _xtrace_event *event = &thread->ring[tail % XTRACE_RING_SIZE];
+                const char *symbol = params.showCaller && !event->returned && event->caller ?
+                    [self callerFor:event->caller] : NULL;
+                if ( dumpFile ) {
+                    dumpEvent( event, thread->number, symbol );
+                    continue;
+                }
+
+                if ( symbol && symbol[0] != '<' )
+                    [params.logToDelegate ? delegate : [Xtrace class]
+                     xtrace:[NSString stringWithFormat:@"From: %s", symbol] forInstance:event->obj indent:-2];
+
+                NSMutableString *out = [NSMutableString string];
+                formatRecorded( event, *event->orig, event->returned ? NULL : class_getName( event->aClass ),
+                               !event->returned && event->implementingClass != event->aClass ?
+                               class_getName( event->implementingClass ) : NULL,
+                               (int64_t)(event->time - recordingStarted) * tickSeconds(), thread->number, out );
+                if ( out.length )
+                    [params.logToDelegate ? delegate : [Xtrace class] xtrace:out forInstance:event->obj
+                                                                      indent:event->returned ? -1 : event->indent+1];
+            }
+
+            thread->ringTail.store( tail, std::memory_order_release );
+            if ( dumpFile )
+                fflush( dumpFile );
+            if ( unsigned dropped = thread->dropped.exchange( 0 ) )
+                [params.logToDelegate ? delegate : [Xtrace class]
+                 xtrace:[NSString stringWithFormat:@"T%d dropped %u events", thread->number, dropped]
+                 forInstance:NULL indent:-1];
+        }
+    }
+}
+
+// replacement implmentations "swizzled" onto class, each a block bound
+// to the information about the method it replaces so calls to super
+// and subclasses overriding a traced method need no lookup
+template <typename _type>
+static void xtrace( struct _xtrace_info &orig, XTRACE_UNSAFE id obj, void *caller, ARG_DEFS ) {
+    SEL sel = orig.sel;
+    if ( !__atomic_load_n( &orig.enabled, __ATOMIC_ACQUIRE ) ) {
+        ((XTRACE_AIMP)orig.original)( obj, sel, ARG_COPY );
+        return;
+    }
+
+    struct _xtrace_args args = { ARG_CAPTURE };
+    args.regs = XTRACE_REG_WORDS;
+    struct _xtrace_local &local = findOriginal( orig, obj, caller, &args );
+
+    if ( !local.callingBack ) {
         if ( orig.before ) {
-            orig.callingBack = YES;
-            orig.before( delegate, sel, obj, ARG_COPY );
-            orig.callingBack = NO;
+            local.callingBack = YES;
+            ((XTRACE_DIMP)orig.before)( delegate, sel, obj, ARG_COPY );
+            local.callingBack = NO;
         }
         if ( orig.beforeBlock ) {
-            orig.callingBack = YES;
-            orig.beforeBlock( obj, sel, ARG_COPY );
-            orig.callingBack = NO;
+            local.callingBack = YES;
+            ((XTRACE_ABIMP)orig.beforeBlock)( obj, sel, ARG_COPY );
+            local.callingBack = NO;
         }
     }
 
-    orig.original( obj, sel, ARG_COPY );
+    ((XTRACE_AIMP)orig.original)( obj, sel, ARG_COPY );
 
-    if ( !orig.callingBack ) {
+    if ( !local.callingBack ) {
         if ( orig.after ) {
-            orig.callingBack = YES;
-            orig.after( delegate, sel, obj, ARG_COPY );
-            orig.callingBack = NO;
+            local.callingBack = YES;
+            ((XTRACE_DIMP)orig.after)( delegate, sel, obj, ARG_COPY );
+            local.callingBack = NO;
         }
         if ( orig.afterBlock ) {
-            orig.callingBack = YES;
-            orig.afterBlock( obj, sel, ARG_COPY );
-            orig.callingBack = NO;
+            local.callingBack = YES;
+            ((XTRACE_ABIMP)orig.afterBlock)( obj, sel, ARG_COPY );
+            local.callingBack = NO;
         }
     }
 
-    returning( &orig );
+    returning( &orig, &local, NULL, 0 );
 }
 
-template <typename _type, int _depth>
-static _type XTRACE_RETAINED xtrace_t( XTRACE_UNSAFE id obj, SEL sel, ARG_DEFS ) {
-    struct _xtrace_depth info = { obj, sel, _depth };
-    struct _xtrace_info &orig = findOriginal( &info, sel, ARG_COPY );
+template <typename _type>
+static _type XTRACE_RETAINED xtrace_t( struct _xtrace_info &orig, XTRACE_UNSAFE id obj, void *caller, ARG_DEFS ) {
+    typedef _type (*TIMP)( XTRACE_UNSAFE id obj, SEL sel, ARG_DEFS );
+    SEL sel = orig.sel;
+    if ( !__atomic_load_n( &orig.enabled, __ATOMIC_ACQUIRE ) )
+        return ((TIMP)orig.original)( obj, sel, ARG_COPY );
+
+    struct _xtrace_args args = { ARG_CAPTURE };
+    args.regs = XTRACE_REGS( _type );
+    struct _xtrace_local &local = findOriginal( orig, obj, caller, &args );
 
-    if ( !orig.callingBack ) {
+    if ( !local.callingBack ) {
         if ( orig.before ) {
-            orig.callingBack = YES;
-            orig.before( delegate, sel, obj, ARG_COPY );
-            orig.callingBack = NO;
+            local.callingBack = YES;
+            ((XTRACE_DIMP)orig.before)( delegate, sel, obj, ARG_COPY );
+            local.callingBack = NO;
         }
         if ( orig.beforeBlock ) {
-            orig.callingBack = YES;
-            orig.beforeBlock( obj, sel, ARG_COPY );
-            orig.callingBack = NO;
+            local.callingBack = YES;
+            ((XTRACE_ABIMP)orig.beforeBlock)( obj, sel, ARG_COPY );
+            local.callingBack = NO;
         }
     }
 
-    typedef _type (*TIMP)( XTRACE_UNSAFE id obj, SEL sel, ... );
     TIMP impl = (TIMP)orig.original;
     _type out = impl( obj, sel, ARG_COPY );
 
-    if ( !orig.callingBack ) {
+    if ( !local.callingBack ) {
         if ( orig.after ) {
-            orig.callingBack = YES;
-            impl = (TIMP)orig.after;
-            out = impl( delegate, sel, out, obj, ARG_COPY );
-            orig.callingBack = NO;
+            typedef _type (*ATIMP)( XTRACE_UNSAFE id delegate, SEL sel, _type out, XTRACE_UNSAFE id obj, ARG_DEFS );
+            local.callingBack = YES;
+            out = ((ATIMP)orig.after)( delegate, sel, out, obj, ARG_COPY );
+            local.callingBack = NO;
         }
         if ( orig.afterBlock ) {
-            typedef _type (^BTIMP)( XTRACE_UNSAFE id obj, SEL sel, _type out, ... );
-            orig.callingBack = YES;
+            typedef _type (^BTIMP)( XTRACE_UNSAFE id obj, SEL sel, _type out, ARG_DEFS );
+            local.callingBack = YES;
             BTIMP timpl = (BTIMP)orig.afterBlock;
             out = timpl( obj, sel, out, ARG_COPY );
-            orig.callingBack = NO;
+            local.callingBack = NO;
         }
     }
 
-    returning( &orig, out );
+    returning( &orig, &local, &out, sizeof out );
     return out;
 }
 
+// the block's IMP is entered with the receiver in place of _cmd and
+// jumps to it, leaving the arguments and return address as they were
+template <typename _type>
+static IMP xtraceBound( struct _xtrace_info *orig ) {
+    return imp_implementationWithBlock( ^( XTRACE_UNSAFE id obj, ARG_DEFS ) {
+        xtrace<_type>( *orig, obj, __builtin_return_address(0), ARG_COPY );
+    } );
+}
+
+template <typename _type>
+static IMP xtraceBound_t( struct _xtrace_info *orig ) {
+    return imp_implementationWithBlock( ^_type( XTRACE_UNSAFE id obj, ARG_DEFS ) {
+        return xtrace_t<_type>( *orig, obj, __builtin_return_address(0), ARG_COPY );
+    } );
+}
+
+// scalars of a type at their offsets, structs and arrays flattened
+static void xscalars( const char *type, size_t offset, std::vector<std::pair<size_t,char> > &out ) {
+    while ( *type && strchr( "rnNoORV", *type ) )
+        type++;
+
+    NSUInteger size, align;
+    if ( *type == '{' ) {
+        const char *field = type + 1;
+        while ( *field && *field != '=' && *field != '}' )
+            field++;
+        if ( *field == '=' )
+            field++;
+        for ( size_t fieldOffset = 0 ; *field && *field != '}' ; ) {
+            const char *next = NSGetSizeAndAlignment( field, &size, &align );
+            fieldOffset = (fieldOffset + align - 1) / align * align;
+            xscalars( field, offset + fieldOffset, out );
+            fieldOffset += size;
+            field = next;
+        }
+    }
+    else if ( *type == '[' ) {
+        const char *element = type + 1;
+        int count = atoi( element );
+        while ( isdigit( *element ) )
+            element++;
+        NSGetSizeAndAlignment( element, &size, &align );
+        for ( int i = 0 ; i < count ; i++ )
+            xscalars( element, offset + i * size, out );
+    }
+    else
+        out.push_back( {offset, *type} ); // unions and bitfields count as integers
+}
+
+// whether the stack the arguments of a method take on this architecture is
+// within the words the trampolines pass on after the argument registers
+static BOOL xstackFits( const char *type ) {
+    NSUInteger size, align;
+    type = NSGetSizeAndAlignment( type, &size, &align );
+    int regs = XTRACE_REG_WORDS - XTRACE_STRET( size ), fps = 0;
+    size_t stack = 0, limit = (XTRACE_ARG_WORDS - regs) * sizeof(void *);
+
+    for ( int arg = 0 ; ; arg++ ) {
+        while ( isdigit( *type ) || *type == '-' )
+            type++;
+        if ( !*type )
+            break;
+        const char *argType = type;
+        type = NSGetSizeAndAlignment( type, &size, &align );
+        if ( arg < 2 )
+            continue; // self and _cmd
+        while ( *argType && strchr( "rnNoORV", *argType ) )
+            argType++;
+
+        std::vector<std::pair<size_t,char> > scalars;
+        xscalars( argType, 0, scalars );
+        bool floating = !scalars.empty(), same = true;
+        for ( const auto &scalar : scalars ) {
+            floating = floating && (scalar.second == 'f' || scalar.second == 'd');
+            same = same && scalar.second == scalars[0].second;
+        }
+#if defined(__x86_64__)
+        // up to two eightbytes, each in a register of its class
+        int gp = 0, fp = 0;
+        bool memory = size > 2 * sizeof(void *) || *argType == 'D';
+        for ( size_t eightbyte = 0 ; !memory && eightbyte * 8 < size ; eightbyte++ ) {
+            bool sse = true;
+            for ( const auto &scalar : scalars )
+                if ( scalar.first / 8 == eightbyte )
+                    sse = sse && (scalar.second == 'f' || scalar.second == 'd');
+            sse ? fp++ : gp++;
+        }
+        if ( !memory && gp <= regs && fps + fp <= XTRACE_ARG_DOUBLES ) {
+            regs -= gp;
+            fps += fp;
+            continue;
+        }
+        align = MAX( align, sizeof(void *) );
+        size = (size + 7) / 8 * 8;
+#elif defined(__arm64__)
+        bool composite = strchr( "{[(", *argType ) != NULL;
+        if ( floating && same && scalars.size() <= 4 ) {
+            // homogeneous floating point aggregates and floating point scalars
+            if ( fps + (int)scalars.size() <= XTRACE_ARG_DOUBLES ) {
+                fps += (int)scalars.size();
+                continue;
+            }
+            fps = XTRACE_ARG_DOUBLES;
+        }
+        else {
+            if ( composite && size > 2 * sizeof(void *) )
+                size = align = sizeof(void *); // passed by reference
+            int words = (int)((size + sizeof(void *) - 1) / sizeof(void *));
+            if ( words <= regs ) {
+                regs -= words;
+                continue;
+            }
+            regs = 0;
+        }
+        // scalars are packed by natural alignment, composites take whole words
+        if ( composite ) {
+            align = MAX( align, sizeof(void *) );
+            size = (size + 7) / 8 * 8;
+        }
+#else
+        (void)fps;
+        align = sizeof(void *);
+        size = (size + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+#endif
+        stack = (stack + align - 1) / align * align + size;
+    }
+
+    return stack <= limit;
+}
+
 + (struct _xtrace_info *)intercept:(Class)aClass method:(Method)method mtype:(const char *)mtype depth:(int)depth {
+    struct _xtrace_locked locked;
     if ( !method )
         NSLog( @"Xtrace: unknown method" );
 
@@ -663,95 +2029,98 @@ static _type XTRACE_RETAINED xtrace_t( XTRACE_UNSAFE id obj, SEL sel, ARG_DEFS )
     if ( !type )
         return NULL;
 
-    IMP newImpl = NULL;
+    IMP (*bind)( struct _xtrace_info *orig ) = NULL;
     switch ( type[0] == 'r' ? type[1] : type[0] ) {
 
-#define IMPL_COUNT 10
-#define IMPLS( _func, _type ) \
-switch ( depth%IMPL_COUNT ) { \
-    case 0: newImpl = (IMP)_func<_type,0>; break; \
-    case 1: newImpl = (IMP)_func<_type,1>; break; \
-    case 2: newImpl = (IMP)_func<_type,2>; break; \
-    case 3: newImpl = (IMP)_func<_type,3>; break; \
-    case 4: newImpl = (IMP)_func<_type,4>; break; \
-    case 5: newImpl = (IMP)_func<_type,5>; break; \
-    case 6: newImpl = (IMP)_func<_type,6>; break; \
-    case 7: newImpl = (IMP)_func<_type,7>; break; \
-    case 8: newImpl = (IMP)_func<_type,8>; break; \
-    case 9: newImpl = (IMP)_func<_type,9>; break; \
-}
+#define IMPLS( _func, _type ) bind = _func<_type>;
         case 'V':
-        case 'v': IMPLS( xtrace, void ); break;
+        case 'v': IMPLS( xtraceBound, void ); break;
 
-        case 'B': IMPLS( xtrace_t, bool ); break;
+        case 'B': IMPLS( xtraceBound_t, bool ); break;
         case 'C':
-        case 'c': IMPLS( xtrace_t, char ); break;
+        case 'c': IMPLS( xtraceBound_t, char ); break;
         case 'S':
-        case 's': IMPLS( xtrace_t, short ); break;
+        case 's': IMPLS( xtraceBound_t, short ); break;
         case 'I':
-        case 'i': IMPLS( xtrace_t, int ); break;
+        case 'i': IMPLS( xtraceBound_t, int ); break;
         case 'Q':
         case 'q':
 #ifndef __LP64__
-            IMPLS( xtrace_t, long long ); break;
+            IMPLS( xtraceBound_t, long long ); break;
 #endif
         case 'L':
-        case 'l': IMPLS( xtrace_t, long ); break;
-        case 'f': IMPLS( xtrace_t, float ); break;
-        case 'd': IMPLS( xtrace_t, double ); break;
+        case 'l': IMPLS( xtraceBound_t, long ); break;
+        case 'f': IMPLS( xtraceBound_t, float ); break;
+        case 'd': IMPLS( xtraceBound_t, double ); break;
         case '#':
-        case '@': IMPLS( xtrace_t, id ) break;
-        case '^': IMPLS( xtrace_t, void * ); break;
-        case ':': IMPLS( xtrace_t, SEL ); break;
-        case '*': IMPLS( xtrace_t, char * ); break;
+        case '@': IMPLS( xtraceBound_t, id ) break;
+        case '^': IMPLS( xtraceBound_t, void * ); break;
+        case ':': IMPLS( xtraceBound_t, SEL ); break;
+        case '*': IMPLS( xtraceBound_t, char * ); break;
         case '{':
             if ( strncmp(type,"{_NSRange=",10) == 0 )
-                IMPLS( xtrace_t, NSRange )
+                IMPLS( xtraceBound_t, NSRange )
 #ifndef __IPHONE_OS_VERSION_MIN_REQUIRED
             else if ( strncmp(type,"{_NSRect=",9) == 0 )
-                IMPLS( xtrace_t, NSRect )
+                IMPLS( xtraceBound_t, NSRect )
             else if ( strncmp(type,"{_NSPoint=",10) == 0 )
-                IMPLS( xtrace_t, NSPoint )
+                IMPLS( xtraceBound_t, NSPoint )
             else if ( strncmp(type,"{_NSSize=",9) == 0 )
-                IMPLS( xtrace_t, NSSize )
+                IMPLS( xtraceBound_t, NSSize )
 #endif
             else if ( strncmp(type,"{CGRect=",8) == 0 )
-                IMPLS( xtrace_t, CGRect )
+                IMPLS( xtraceBound_t, CGRect )
             else if ( strncmp(type,"{CGPoint=",9) == 0 )
-                IMPLS( xtrace_t, CGPoint )
+                IMPLS( xtraceBound_t, CGPoint )
             else if ( strncmp(type,"{CGSize=",8) == 0 )
-                IMPLS( xtrace_t, CGSize )
+                IMPLS( xtraceBound_t, CGSize )
             else if ( strncmp(type,"{CGAffineTransform=",19) == 0 )
-                IMPLS( xtrace_t, CGAffineTransform )
+                IMPLS( xtraceBound_t, CGAffineTransform )
             break;
         default:
             NSLog(@"Xtrace: Unsupported return type: %s for: %s[%s %s]", type, mtype, className, name);
     }
 
-    const char *frameSize = type+1;
-    while ( !isdigit(*frameSize) )
-        frameSize++;
+    if ( !xstackFits( type ) )
+        NSLog( @"Xtrace: Arguments need too much stack to trace method: %s[%s %s]", mtype, className, name );
 
-    if ( atoi(frameSize) > (int)ARG_SIZE )
-        NSLog( @"Xtrace: Stack frame too large to trace method: %s[%s %s]", mtype, className, name );
-
-    else if ( newImpl ) {
+    else if ( bind ) {
 
         struct _xtrace_info &orig = originals[aClass][sel];
 
+        if ( !orig.slot ) {
+            if ( slotsAllocated + 1 >= XTRACE_SLOTS_PER_CHUNK * XTRACE_SLOT_CHUNKS ) {
+                NSLog( @"Xtrace: Too many methods traced to trace: %s[%s %s]", mtype, className, name );
+                originals[aClass].erase( sel );
+                return NULL;
+            }
+            orig.slot = ++slotsAllocated;
+        }
         orig.name = name;
         orig.type = type;
         orig.method = method;
-        orig.depth = depth%IMPL_COUNT;
+        orig.sel = sel;
+        orig.depth = depth;
         if ( mtype )
             orig.mtype = mtype;
 
-        [self extractSelector:name into:orig.args maxargs:XTRACE_ARGS_SUPPORTED];
-        [self extractOffsets:type into:orig.args maxargs:XTRACE_ARGS_SUPPORTED];
+        static char KVO_prefix[] = "NSKVONotifying_";
+        orig.aClass = aClass;
+        while ( orig.aClass && strncmp( class_getName(orig.aClass), KVO_prefix, sizeof(KVO_prefix)-1 ) == 0 )
+            orig.aClass = class_getSuperclass(orig.aClass);
 
+        auto selectorColor = selectorColors.find( sel );
+        orig.selectorColor = selectorColor != selectorColors.end() ? selectorColor->second : NULL;
+
+        [self compileFormatters:&orig];
+        __atomic_store_n( &orig.enabled, YES, __ATOMIC_RELEASE );
+
+        // created once per method, reinstalled if traced again
+        IMP newImpl = orig.trampoline ? (IMP)orig.trampoline : bind( &orig );
         IMP impl = method_getImplementation(method);
         if ( impl != newImpl ) {
-            orig.original = (XTRACE_VIMP)impl;
+            orig.original = orig.implementation = (XTRACE_VIMP)impl;
+            orig.trampoline = (XTRACE_VIMP)newImpl;
             method_setImplementation(method,newImpl);
             //NSLog( @"%d %s%s %s %s", depth, mtype, className, name, type );
         }
@@ -762,6 +2131,15 @@ switch ( depth%IMPL_COUNT ) { \
     return NULL;
 }
 
+// parse name and type into the arguments and their formatters
++ (void)compileFormatters:(struct _xtrace_info *)orig {
+    [self extractSelector:orig->name into:orig->args maxargs:XTRACE_ARGS_SUPPORTED];
+    [self extractOffsets:orig->type into:orig->args maxargs:XTRACE_ARGS_SUPPORTED];
+    for ( struct _xtrace_arg *aptr = orig->args ; *aptr->name ; aptr++ )
+        aptr->formatter = compileFormatter( aptr->type );
+    orig->returnFormatter = compileFormatter( orig->type );
+}
+
 // break up selector by argument
 + (int)extractSelector:(const char *)name into:(struct _xtrace_arg *)args maxargs:(int)maxargs {
 
@@ -852,7 +2230,7 @@ switch ( depth%IMPL_COUNT ) { \
     }
     @catch ( NSException *e ) {
         NSLog( @"Xtrace: exception %@ on signature: %s", e, type );
-        [self originalExtractOffsets:type into:args maxargs:maxargs];
+        return [self originalExtractOffsets:type into:args maxargs:maxargs];
     }
 }
 
@@ -968,6 +2346,7 @@ switch ( depth%IMPL_COUNT ) { \
 }
 
 + (NSArray *)profile {
+    struct _xtrace_locked locked;
     NSMutableArray *profile = [NSMutableArray array];
 
     for ( auto &byClass : originals )
@@ -975,10 +2354,10 @@ switch ( depth%IMPL_COUNT ) { \
             Xtrace *trace = [Xtrace new];
             trace->aClass = byClass.first;
             trace->info = &bySel.second;
+            aggregateStats( bySel.second, YES );
             trace->callCount = trace->info->stats.callCount;
             trace->elapsed = trace->info->stats.elapsed;
-            trace->info->stats.callCount = 0;
-            trace->info->stats.elapsed = 0;
+            trace->exclusive = trace->info->stats.exclusive;
             [profile addObject:trace];
         }
 
@@ -992,13 +2371,146 @@ switch ( depth%IMPL_COUNT ) { \
         Xtrace *trace = [profile objectAtIndex:i];
         if ( !trace->info->color )
             trace->info->color = noColor;
-        printf( "%s%.*f/%-4d %s[%s %s]%s\n",
-               trace->info->color, decimalPlaces, trace->elapsed, trace->callCount,
+        printf( "%s%.*f/%.*f/%-4d p50 %.3fms p99 %.3fms max %.3fms %s[%s %s]%s\n",
+               trace->info->color, decimalPlaces, trace->elapsed, decimalPlaces, trace->exclusive,
+               trace->callCount, trace->info->stats.p50*1000., trace->info->stats.p99*1000.,
+               trace->info->stats.max*1000.,
                trace->info->mtype, class_getName(trace->aClass), trace->info->name,
                trace->info->color[0] ? "\033[;" : "" );
     }
 }
 
+static void nodeName( struct _xtrace_node *node, std::string &out ) {
+    out += node->orig->mtype ? node->orig->mtype : "-";
+    out += "[";
+    out += class_getName( node->aClass );
+    out += " ";
+    out += node->orig->name;
+    out += "]";
+}
+
+static void foldNode( struct _xtrace_node *node, std::string path, NSMutableString *folded, double micros ) {
+    nodeName( node, path );
+    if ( uint64_t self = (uint64_t)(node->exclusive * micros) )
+        [folded appendFormat:@"%s %llu\n", path.c_str(), self];
+    path += ";";
+    for ( struct _xtrace_node *child = node->children.load( std::memory_order_acquire ) ; child ; child = child->sibling )
+        foldNode( child, path, folded, micros );
+}
+
+// one line per call path with self time in microseconds for flamegraph.pl
++ (NSString *)foldedStacks {
+    NSMutableString *folded = [NSMutableString string];
+    double micros = tickSeconds() * 1e6;
+    for ( struct _xtrace_thread *thread = traceThreads.load() ; thread ; thread = thread->next ) {
+        char prefix[20];
+        snprintf( prefix, sizeof prefix, "T%d;", thread->number );
+        for ( struct _xtrace_node *child = thread->root.children.load( std::memory_order_acquire ) ; child ; child = child->sibling )
+            foldNode( child, prefix, folded, micros );
+    }
+    return folded;
+}
+
+// minimal protobuf writer for the pprof profile.proto format
+static void pbVarint( std::string &out, uint64_t value ) {
+    while ( value >= 0x80 ) {
+        out += (char)(value | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+static void pbInt( std::string &out, int field, uint64_t value ) {
+    if ( !value )
+        return;
+    pbVarint( out, field << 3 );
+    pbVarint( out, value );
+}
+
+static void pbBytes( std::string &out, int field, const std::string &bytes ) {
+    pbVarint( out, field << 3 | 2 );
+    pbVarint( out, bytes.size() );
+    out += bytes;
+}
+
+struct _xtrace_pprof {
+    std::string profile;
+    std::map<std::string,uint64_t> strings;
+    std::map<std::pair<struct _xtrace_info *,void *>,uint64_t> functions;
+    double nanos;
+
+    uint64_t string( const std::string &str ) {
+        auto found = strings.find( str );
+        if ( found != strings.end() )
+            return found->second;
+        uint64_t index = strings.size();
+        strings[str] = index;
+        pbBytes( profile, 6, str );
+        return index;
+    }
+
+    uint64_t function( struct _xtrace_node *node ) {
+        auto key = std::make_pair( node->orig, XTRACE_BRIDGE(void *)node->aClass );
+        auto found = functions.find( key );
+        if ( found != functions.end() )
+            return found->second;
+
+        uint64_t id = functions.size() + 1;
+        functions[key] = id;
+
+        std::string name, func, line, location;
+        nodeName( node, name );
+        pbInt( func, 1, id );
+        pbInt( func, 2, string( name ) );
+        pbInt( func, 3, string( name ) );
+        pbBytes( profile, 5, func );
+
+        pbInt( line, 1, id );
+        pbInt( location, 1, id );
+        pbBytes( location, 4, line );
+        pbBytes( profile, 4, location );
+        return id;
+    }
+
+    void sample( struct _xtrace_node *node, int thread ) {
+        if ( node->calls ) {
+            std::string sample, locations, values, label;
+            for ( struct _xtrace_node *frame = node ; frame->orig ; frame = frame->parent )
+                pbVarint( locations, function( frame ) );
+            pbBytes( sample, 1, locations );
+            pbVarint( values, node->calls );
+            pbVarint( values, (uint64_t)(node->exclusive * nanos) );
+            pbBytes( sample, 2, values );
+            pbInt( label, 1, string( "thread" ) );
+            pbInt( label, 3, thread );
+            pbBytes( sample, 3, label );
+            pbBytes( profile, 2, sample );
+        }
+        for ( struct _xtrace_node *child = node->children.load( std::memory_order_acquire ) ; child ; child = child->sibling )
+            sample( child, thread );
+    }
+};
+
+// calls and self time per call path, readable by "go tool pprof"
++ (NSData *)pprofProfile {
+    struct _xtrace_pprof pprof;
+    pprof.nanos = tickSeconds() * 1e9;
+    pprof.string( "" );
+
+    std::string calls, time;
+    pbInt( calls, 1, pprof.string( "calls" ) );
+    pbInt( calls, 2, pprof.string( "count" ) );
+    pbBytes( pprof.profile, 1, calls );
+    pbInt( time, 1, pprof.string( "time" ) );
+    pbInt( time, 2, pprof.string( "nanoseconds" ) );
+    pbBytes( pprof.profile, 1, time );
+
+    for ( struct _xtrace_thread *thread = traceThreads.load() ; thread ; thread = thread->next )
+        pprof.sample( &thread->root, thread->number );
+
+    return [NSData dataWithBytes:pprof.profile.data() length:pprof.profile.size()];
+}
+
 - (NSComparisonResult)compareElapsed:(Xtrace *)other {
     return self->elapsed > other->elapsed ? NSOrderedAscending : self->elapsed == other->elapsed ? NSOrderedSame : NSOrderedDescending;
 }
@@ -60,6 +60,18 @@
 
 #import <Foundation/Foundation.h>
 #import <objc/runtime.h>
+#import "Xprobe.h"
+#import <pthread.h>
+#import <vector>
+#import <unordered_set>
+#import <unordered_map>
+#import <string>
+#import <algorithm>
+#import <chrono>
+#import <unistd.h>
+#ifdef __APPLE__
+#import <mach/mach.h>
+#endif
 
 #if TARGET_OS_IPHONE
 #import <UIKit/UIKit.h>
@@ -71,14 +83,20 @@
 @end
 
 extern const char *ivar_getTypeEncodingSwift( Ivar ivar, Class aClass );
+extern const struct _xtypeinfo *xtypeInfo( const char *type );
+extern const struct _xtypeinfo *xivarInfo( Ivar ivar, Class aClass );
 extern id xvalueForPointer( id self, const char *name, void *iptr, const char *type );
 extern id xvalueForIvarType( id self, Ivar ivar, const char *type, Class aClass );
 extern id xvalueForIvar( id self, Ivar ivar, Class aClass );
 extern id xvalueForMethod( id self, Method method );
+extern BOOL xrenderPointer( XprobeOutput *out, id self, const char *name, void *iptr, const char *type, BOOL json );
+extern BOOL xrenderIvar( XprobeOutput *out, id self, Ivar ivar, Class aClass, BOOL json );
 extern BOOL xvalueUpdateIvar( id self, Ivar ivar, NSString *value );
 extern NSString *xlinkForProtocol( NSString *protolName );
 extern NSString *utf8String( const char *chars );
 extern NSString *xtype( const char *type );
+extern BOOL xreadable( const void *ptr, size_t len );
+extern BOOL xvalidObject( const void *ptr );
 
 NSString *utf8String( const char *chars ) {
     return chars ? [NSString stringWithUTF8String:chars] : @"";
@@ -294,8 +312,8 @@ const char *ivar_getTypeEncodingSwift3( Ivar ivar, Class aClass ) {
         return typeInfoForClass( (__bridge Class)field, optionals );
 }
 
-// returned type string has "autorelease" scope
-const char *ivar_getTypeEncodingSwift( Ivar ivar, Class aClass ) {
+// returned type string has "autorelease" scope, it is interned below
+static const char *xderiveTypeEncoding( Ivar ivar, Class aClass ) {
     struct _swift_class *swiftClass = isSwift( aClass );
     if ( !swiftClass )
         return ivar_getTypeEncoding( ivar );
@@ -373,44 +391,377 @@ const char *ivar_getTypeEncodingSwift( Ivar ivar, Class aClass ) {
         return typeInfoForClass( (__bridge Class)field, optionals );
 }
 #else
-const char *ivar_getTypeEncodingSwift( Ivar ivar, Class aClass ) {
+static const char *xderiveTypeEncoding( Ivar ivar, Class aClass ) {
     return ivar_getTypeEncoding(ivar);
 }
 #endif // VERY_OBSOLETE_CODE
 
+#pragma mark interned type descriptors
+
+// Encodings are parsed once into a descriptor that is never freed. The
+// character before an encoding distinguishes Swift types ("Sa", "SS") so
+// it is kept in front of the interned copy to preserve type[-1].
+
+enum _xstructKind {
+    xstructValue, xstructRef, xstructOO, xstructUnknown, xstructDictionary, xstructCGFloat,
+    xstructInt8, xstructInt16, xstructInt32, xstructUInt8, xstructUInt16, xstructUInt32
+};
+
+struct _xtypeinfo {
+    std::string encoding; // preceded by the character before the original
+    const char *type;
+    char kind;
+    NSUInteger size; // 0 when NSGetSizeAndAlignment can't size it
+    enum _xstructKind structKind;
+    const char *ooType;
+    std::string cleanType; // struct encoding for valueWithBytes:objCType:
+    bool renderable; // fields can all be formatted by xrenderScalar()
+    __strong NSString *name; // xtype() markup, rendered on first use
+};
+
+struct _xivarKey {
+    uintptr_t aClass, ivar;
+    bool operator == ( const _xivarKey &other ) const {
+        return aClass == other.aClass && ivar == other.ivar;
+    }
+};
+
+struct _xivarHash {
+    size_t operator () ( const _xivarKey &key ) const {
+        return std::hash<uintptr_t>()( key.aClass * 31 + key.ivar );
+    }
+};
+
+static pthread_mutex_t typeLock = PTHREAD_MUTEX_INITIALIZER;
+static std::unordered_map<std::string,_xtypeinfo> typesByEncoding;
+static std::unordered_map<const char *,_xtypeinfo *> typesByPointer;
+static std::unordered_map<_xivarKey,const _xtypeinfo *,_xivarHash> typesByIvar;
+
+// remove names for valueWithBytes:objCType: and complete common Swift encodings
+static void xparseStruct( struct _xtypeinfo &info ) {
+    const char *type = info.type;
+    info.structKind = xstructValue;
+    if ( isNewRefType( type ) )
+        info.structKind = xstructRef;
+    else if ( xstrncmp( type+1, "Int8" ) == 0 )
+        info.structKind = xstructInt8;
+    else if ( xstrncmp( type+1, "Int16" ) == 0 )
+        info.structKind = xstructInt16;
+    else if ( xstrncmp( type+1, "Int32" ) == 0 )
+        info.structKind = xstructInt32;
+    else if ( xstrncmp( type+1, "UInt8" ) == 0 )
+        info.structKind = xstructUInt8;
+    else if ( xstrncmp( type+1, "UInt16" ) == 0 )
+        info.structKind = xstructUInt16;
+    else if ( xstrncmp( type+1, "UInt32" ) == 0 )
+        info.structKind = xstructUInt32;
+    else if ( xstrncmp( type, "{Dictionary}" ) == 0 )
+        info.structKind = xstructDictionary;
+    else if ( (info.ooType = isOOType( type )) ) {
+        info.structKind = xstructOO;
+        info.ooType += 5;
+    }
+    else if ( type[1] == '?' )
+        info.structKind = xstructUnknown;
+    if ( info.structKind != xstructValue )
+        return;
+
+    std::string &cleanType = info.cleanType;
+    while ( *type && *type != ',' ) {
+        if ( *type == '"' ) {
+            while ( *++type && *type != '"' )
+                ;
+            if ( *type )
+                type++;
+        }
+        else
+            cleanType += *type++;
+    }
+
+    const char *clean = cleanType.c_str();
+    if ( strchr( clean, '=' ) )
+        ;
+    else if ( xstrncmp( clean, "{CGFloat" ) == 0 )
+        info.structKind = xstructCGFloat;
+    else if ( xstrncmp( clean, "{CGPoint" ) == 0 )
+        cleanType = @encode(CGPoint);
+    else if ( xstrncmp( clean, "{CGSize" ) == 0 )
+        cleanType = @encode(CGSize);
+    else if ( xstrncmp( clean, "{CGRect" ) == 0 )
+        cleanType = @encode(CGRect);
+#if TARGET_OS_IPHONE
+    else if ( xstrncmp( clean, "{UIOffset" ) == 0 )
+        cleanType = @encode(UIOffset);
+    else if ( xstrncmp( clean, "{UIEdgeInsets" ) == 0 )
+        cleanType = @encode(UIEdgeInsets);
+#else
+    else if ( xstrncmp( clean, "{NSPoint" ) == 0 )
+        cleanType = @encode(NSPoint);
+    else if ( xstrncmp( clean, "{NSSize" ) == 0 )
+        cleanType = @encode(NSSize);
+    else if ( xstrncmp( clean, "{NSRect" ) == 0 )
+        cleanType = @encode(NSRect);
+#endif
+    else if ( xstrncmp( clean, "{CGAffineTransform" ) == 0 )
+        cleanType = @encode(CGAffineTransform);
+}
+
+static const char xscalarTypes[] = "cCsSiIlLqQfdB:#*^";
+
+// struct of scalars and structs of scalars, advances past the struct
+static bool xrenderableStruct( const char *&type ) {
+    const char *fields = strchr( type, '=' );
+    if ( !fields || strchr( type, '}' ) < fields )
+        return false;
+
+    for ( type = fields + 1 ; *type != '}' ; )
+        if ( *type == '{' ) {
+            if ( !xrenderableStruct( type ) )
+                return false;
+        }
+        else if ( *type && strchr( xscalarTypes, *type ) ) {
+            NSUInteger size, align;
+            type = NSGetSizeAndAlignment( type, &size, &align );
+        }
+        else
+            return false;
+
+    type++;
+    return true;
+}
+
+// call with typeLock held
+static _xtypeinfo *xinternType( const char *type ) {
+    std::string encoding( 1, type[-1] );
+    encoding += type;
+
+    auto found = typesByEncoding.find( encoding );
+    if ( found != typesByEncoding.end() )
+        return &found->second;
+
+    _xtypeinfo &info = typesByEncoding[encoding];
+    info.encoding = encoding;
+    info.type = info.encoding.c_str() + 1;
+    info.kind = type[0];
+    info.ooType = NULL;
+    info.structKind = xstructValue;
+    info.renderable = false;
+    if ( info.kind == '{' || info.kind == '(' ) {
+        xparseStruct( info );
+        const char *clean = info.cleanType.c_str();
+        @try {
+            info.renderable = info.structKind == xstructValue && info.kind == '{' && xrenderableStruct( clean );
+        }
+        @catch ( NSException *e ) {
+        }
+    }
+
+    @try {
+        NSUInteger align;
+        NSGetSizeAndAlignment( info.cleanType.empty() ? info.type : info.cleanType.c_str(), &info.size, &align );
+    }
+    @catch ( NSException *e ) {
+        info.size = 0;
+    }
+
+    typesByPointer[info.type] = &info;
+    return &info;
+}
+
+const struct _xtypeinfo *xtypeInfo( const char *type ) {
+    if ( !type )
+        return NULL;
+
+    pthread_mutex_lock( &typeLock );
+    auto found = typesByPointer.find( type );
+    _xtypeinfo *info = found != typesByPointer.end() ? found->second : xinternType( type );
+    pthread_mutex_unlock( &typeLock );
+    return info;
+}
+
+const struct _xtypeinfo *xivarInfo( Ivar ivar, Class aClass ) {
+    _xivarKey key = {(uintptr_t)(__bridge void *)aClass, (uintptr_t)ivar};
+    pthread_mutex_lock( &typeLock );
+    auto found = typesByIvar.find( key );
+    const _xtypeinfo *info = found != typesByIvar.end() ? found->second : NULL;
+    pthread_mutex_unlock( &typeLock );
+    if ( found != typesByIvar.end() )
+        return info;
+
+    // derived outside the lock as Swift metadata may call back into Xprobe
+    const char *type = xderiveTypeEncoding( ivar, aClass );
+    info = xtypeInfo( type );
+    pthread_mutex_lock( &typeLock );
+    typesByIvar[key] = info;
+    pthread_mutex_unlock( &typeLock );
+    return info;
+}
+
+const char *ivar_getTypeEncodingSwift( Ivar ivar, Class aClass ) {
+    const struct _xtypeinfo *info = xivarInfo( ivar, aClass );
+    return info ? info->type : NULL;
+}
+
 #pragma mark generic ivar/method access
 
 static NSString *trapped = @"#INVALID", *notype = @"#TYPE";
 
-static jmp_buf jmp_env;
-
-static void handler( int sig ) {
-    longjmp( jmp_env, sig );
+// getter of the property an ivar "name" or "name.storage" belongs to
+static Method xmethodForIvarName( id self, const char *name ) {
+    const char *suffix = strchr( name, '.' );
+    size_t len = suffix ? suffix - name : strlen( name );
+    char mname[len + 1];
+    memcpy( mname, name, len );
+    mname[len] = '\000';
+    return class_getInstanceMethod( object_getClass( self ), sel_registerName( mname ) );
 }
 
-static int xprotect( void (^blockToProtect)(void) ) {
-    void (*savetrap)(int) = signal( SIGTRAP, handler );
-    void (*savesegv)(int) = signal( SIGSEGV, handler );
-    void (*savebus )(int) = signal( SIGBUS,  handler );
+// Pointers are checked against a sorted map of the readable regions of the
+// address space rather than by trapping faults. The map and the set of
+// registered classes are refreshed when a lookup misses or they get stale.
 
-    int signum;
-    switch ( signum = setjmp( jmp_env ) ) {
-        case 0:
-            blockToProtect();
-            break;
-        default:
-#ifdef XPROBE_MAGIC
-            if ( [Xprobe respondsToSelector:@selector(writeString:)] )
-                [Xprobe writeString:[NSString stringWithFormat:@"SIGNAL: %d", signum]];
-            else
+#define XPROBE_REGIONS_TTL std::chrono::seconds(2)
+#define XPROBE_REFRESH_MIN std::chrono::milliseconds(50)
+
+#if (TARGET_OS_OSX || TARGET_OS_MACCATALYST) && __x86_64__
+#define XPROBE_TAG_MASK 1UL
+#elif __LP64__
+#define XPROBE_TAG_MASK (1UL<<63)
+#else
+#define XPROBE_TAG_MASK 0UL
 #endif
-                NSLog( @"SIGNAL: %d", signum );
+
+struct _xregion {
+    uintptr_t start, end;
+};
+
+static pthread_mutex_t regionLock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<_xregion> readableRegions;
+static std::unordered_set<uintptr_t> registeredClasses;
+static std::chrono::steady_clock::time_point regionsLoaded;
+
+static void xaddRegion( uintptr_t start, uintptr_t end ) {
+    if ( !readableRegions.empty() && readableRegions.back().end == start )
+        readableRegions.back().end = end;
+    else
+        readableRegions.push_back( {start, end} );
+}
+
+// call with regionLock held
+static void xloadRegions() {
+    readableRegions.clear();
+#ifdef __APPLE__
+    vm_address_t address = 0;
+    vm_size_t size = 0;
+    vm_region_basic_info_data_64_t info;
+    mach_msg_type_number_t count = VM_REGION_BASIC_INFO_COUNT_64;
+    mach_port_t object;
+    while ( vm_region_64( mach_task_self(), &address, &size, VM_REGION_BASIC_INFO_64,
+                          (vm_region_info_t)&info, &count, &object ) == KERN_SUCCESS ) {
+        if ( info.protection & VM_PROT_READ )
+            xaddRegion( address, address + size );
+        address += size;
+        count = VM_REGION_BASIC_INFO_COUNT_64;
+    }
+#else
+    if ( FILE *maps = fopen( "/proc/self/maps", "r" ) ) {
+        char line[1024], perms[5];
+        unsigned long start, end;
+        while ( fgets( line, sizeof line, maps ) )
+            if ( sscanf( line, "%lx-%lx %4s", &start, &end, perms ) == 3 && perms[0] == 'r' )
+                xaddRegion( start, end );
+        fclose( maps );
     }
+#endif
+
+    registeredClasses.clear();
+    unsigned classCount;
+    if ( Class *classes = objc_copyClassList( &classCount ) ) {
+        for ( unsigned i = 0 ; i < classCount ; i++ )
+            registeredClasses.insert( (uintptr_t)(__bridge void *)classes[i] );
+        free( classes );
+    }
+
+    regionsLoaded = std::chrono::steady_clock::now();
+}
+
+// call with regionLock held
+static BOOL xinRegion( uintptr_t ptr, size_t len ) {
+    auto region = std::upper_bound( readableRegions.begin(), readableRegions.end(), ptr,
+                                    []( uintptr_t address, const _xregion &region ) {
+        return address < region.start;
+    } );
+    return region != readableRegions.begin() && ptr + len <= (--region)->end;
+}
+
+// call with regionLock held, reloads on a miss unless the map is very recent
+static BOOL xlookup( BOOL (^lookup)(void) ) {
+    auto age = std::chrono::steady_clock::now() - regionsLoaded;
+    if ( age > XPROBE_REGIONS_TTL )
+        xloadRegions();
+    else if ( lookup() )
+        return YES;
+    else if ( age > XPROBE_REFRESH_MIN )
+        xloadRegions();
+    else
+        return NO;
+    return lookup();
+}
+
+BOOL xreadable( const void *ptr, size_t len ) {
+    pthread_mutex_lock( &regionLock );
+    BOOL readable = xlookup( ^BOOL{
+        return xinRegion( (uintptr_t)ptr, len );
+    } );
+    pthread_mutex_unlock( &regionLock );
+    return readable;
+}
+
+// readable, aligned and its isa is a registered class (or it is one)
+BOOL xvalidObject( const void *ptr ) {
+    uintptr_t uptr = (uintptr_t)ptr;
+    if ( !uptr )
+        return NO;
+
+    BOOL tagged = (uptr & XPROBE_TAG_MASK) != 0;
+    if ( !tagged && uptr % sizeof(void *) != 0 )
+        return NO;
+
+    pthread_mutex_lock( &regionLock );
+    BOOL valid = xlookup( ^BOOL{
+        if ( !tagged && !xinRegion( uptr, sizeof(void *) ) )
+            return NO;
+        if ( registeredClasses.count( uptr ) )
+            return YES;
+        Class isa = object_getClass( (__bridge id)ptr );
+        return (tagged || xinRegion( (uintptr_t)isa, sizeof(void *) )) &&
+            registeredClasses.count( (uintptr_t)isa ) != 0;
+    } );
+    pthread_mutex_unlock( &regionLock );
+    return valid;
+}
+
+static NSString *xtrapped( const void *ptr ) {
+    return [NSString stringWithFormat:@"%@ %p", trapped, ptr];
+}
+
+// object stored at iptr, nil or a placeholder when it does not look like one
+static id xobjectAt( void *iptr ) {
+    void *ptr = *(void **)iptr;
+    if ( !ptr )
+        return nil;
+    return xvalidObject( ptr ) ? *(const id *)iptr : xtrapped( ptr );
+}
 
-    signal( SIGBUS,  savebus  );
-    signal( SIGSEGV, savesegv );
-    signal( SIGTRAP, savetrap );
-    return signum;
+// C string readable up to its terminator, checking each page it crosses
+static BOOL xreadableString( const char *chars ) {
+    static uintptr_t pageMask = getpagesize() - 1;
+    if ( !xreadable( chars, 1 ) )
+        return NO;
+    for ( const char *ptr = chars ; *ptr ; ptr++ )
+        if ( ((uintptr_t)(ptr + 1) & pageMask) == 0 && !xreadable( ptr + 1, 1 ) )
+            return NO;
+    return YES;
 }
 
 id xvalueForPointer( id self, const char *name, void *iptr, const char *type ) {
@@ -431,9 +782,7 @@ id xvalueForPointer( id self, const char *name, void *iptr, const char *type ) {
         case 'a':
         case 'S':
             if ( type[-1] == 'S' ) {
-                const char *suffix = strchr( name, '.' );
-                const char *mname = suffix ? strndup( name, suffix-name ) : name;
-                Method m = class_getInstanceMethod( object_getClass( self ), sel_registerName( mname ) );
+                Method m = xmethodForIvarName( self, name );
                 signed char *cptr = (signed char *)iptr;
                 if ( m && method_getTypeEncoding( m )[0] == '@' ) {
                     id (*imp)( id, SEL ) = (id (*)( id, SEL ))method_getImplementation( m );
@@ -481,33 +830,14 @@ id xvalueForPointer( id self, const char *name, void *iptr, const char *type ) {
         case 'L': return @(*(unsigned long *)iptr);
 
         case '@': {
-            const char *suffix = strchr( name, '.' );
-            const char *mname = suffix ? strndup( name, suffix-name ) : name;
-            Method m = class_getInstanceMethod( object_getClass( self ), sel_registerName( mname ) );
+            Method m = xmethodForIvarName( self, name );
             if ( m && method_getTypeEncoding( m )[0] == '@' ) {
                 id (*imp)( id, SEL ) = (id (*)( id, SEL ))method_getImplementation( m );
                 if ( imp )
                     return imp( self, method_getName( m ) );
             }
 
-            __block id out = trapped;
-
-            xprotect( ^{
-                uintptr_t uptr = *(uintptr_t *)iptr;
-                if ( !uptr )
-                    out = nil;
-                else if (0x600000000000 <= uptr && uptr < 0x700000000000) {
-                    // Heap allocated object?
-                    id obj = *(const id *)iptr;
-#ifdef XPROBE_MAGIC
-                    //[obj description];
-#endif
-                    out = obj;
-                } else
-                    out = [NSString stringWithFormat:@"#INVALID %p", *(void **)iptr];
-            } );
-
-            return out;
+            return xobjectAt( iptr );
         }
         case ':': return [NSString stringWithFormat:@"@selector(%@)",
                           NSStringFromSelector( *(SEL *)iptr )];
@@ -524,91 +854,44 @@ id xvalueForPointer( id self, const char *name, void *iptr, const char *type ) {
                 strcpy(strchr(buff,'='),"\"");
                 return xvalueForPointer( self, name, iptr, buff );
             }
-            return [NSValue valueWithPointer:*(void **)iptr];
+            if ( void *ptr = *(void **)iptr )
+                return xreadable( ptr, 1 ) ? [NSValue valueWithPointer:ptr] : xtrapped( ptr );
+            return [NSValue valueWithPointer:NULL];
 
         case '{': case '(': @try {
-            if ( isNewRefType( type ) )
-                return *(const id *)iptr;
-            else if ( xstrncmp( type+1, "Int8" ) == 0 )
-                return @(*(char *)iptr);
-            else if ( xstrncmp( type+1, "Int16" ) == 0 )
-                return @(*(short *)iptr);
-            else if ( xstrncmp( type+1, "Int32" ) == 0 )
-                return @(*(int *)iptr);
-            if ( xstrncmp( type+1, "UInt8" ) == 0 )
-                return @(*(unsigned char *)iptr);
-            else if ( xstrncmp( type+1, "UInt16" ) == 0 )
-                return @(*(unsigned short *)iptr);
-            else if ( xstrncmp( type+1, "UInt32" ) == 0 )
-                return @(*(unsigned int *)iptr);
-            else if ( xstrncmp( type, "{Dictionary}" ) == 0 ) {
-                const char *suffix = strchr( name, '.' );
-                const char *mname = suffix ? strndup( name, suffix-name ) : name;
-                Method m = class_getInstanceMethod( object_getClass( self ), sel_registerName( mname ) );
-                if ( m && method_getTypeEncoding( m )[0] == '@' ) {
-                    id (*imp)( id, SEL ) = (id (*)( id, SEL ))method_getImplementation( m );
-                    return imp ? imp( self, method_getName( m ) ) : @"unavailable";
-                }
-                else
-                    return @"unavailable";
-            }
-
-            const char *ooType = isOOType( type );
-            if ( ooType )
-                return xvalueForPointer( self, name, iptr, ooType+5 );
-            else if ( type[1] == '?' )
-                return xvalueForPointer( self, name, iptr, "I" );
-
-            // remove names for valueWithBytes:objCType:
-            char cleanType[1000], *tptr = cleanType;
-            while ( *type ) {
-                if ( *type == ',' )
-                    break;
-                if ( *type == '"' ) {
-                    while ( *++type != '"' )
-                        ;
-                    type++;
+            const struct _xtypeinfo *info = xtypeInfo( type );
+            switch ( info->structKind ) {
+                case xstructRef: return xobjectAt( iptr );
+                case xstructInt8: return @(*(char *)iptr);
+                case xstructInt16: return @(*(short *)iptr);
+                case xstructInt32: return @(*(int *)iptr);
+                case xstructUInt8: return @(*(unsigned char *)iptr);
+                case xstructUInt16: return @(*(unsigned short *)iptr);
+                case xstructUInt32: return @(*(unsigned int *)iptr);
+                case xstructDictionary: {
+                    Method m = xmethodForIvarName( self, name );
+                    if ( m && method_getTypeEncoding( m )[0] == '@' ) {
+                        id (*imp)( id, SEL ) = (id (*)( id, SEL ))method_getImplementation( m );
+                        return imp ? imp( self, method_getName( m ) ) : @"unavailable";
+                    }
+                    else
+                        return @"unavailable";
                 }
-                else
-                    *tptr++ = *type++;
+                case xstructOO: return xvalueForPointer( self, name, iptr, info->ooType );
+                case xstructUnknown: return xvalueForPointer( self, name, iptr, "I" );
+                case xstructCGFloat: return @(*(CGFloat *)iptr);
+                default:
+                    return [NSValue valueWithBytes:iptr objCType:info->cleanType.c_str()];
             }
-            *tptr = '\000';
-
-            // for incomplete Swift encodings
-            if ( strchr( cleanType, '=' ) )
-                ;
-            else if ( xstrncmp( cleanType, "{CGFloat" ) == 0 )
-                return @(*(CGFloat *)iptr);
-            else if ( xstrncmp( cleanType, "{CGPoint" ) == 0 )
-                strcpy( cleanType, @encode(CGPoint) );
-            else if ( xstrncmp( cleanType, "{CGSize" ) == 0 )
-                strcpy( cleanType, @encode(CGSize) );
-            else if ( xstrncmp( cleanType, "{CGRect" ) == 0 )
-                strcpy( cleanType, @encode(CGRect) );
-#if TARGET_OS_IPHONE
-            else if ( xstrncmp( cleanType, "{UIOffset" ) == 0 )
-                strcpy( cleanType, @encode(UIOffset) );
-            else if ( xstrncmp( cleanType, "{UIEdgeInsets" ) == 0 )
-                strcpy( cleanType, @encode(UIEdgeInsets) );
-#else
-            else if ( xstrncmp( cleanType, "{NSPoint" ) == 0 )
-                strcpy( cleanType, @encode(NSPoint) );
-            else if ( xstrncmp( cleanType, "{NSSize" ) == 0 )
-                strcpy( cleanType, @encode(NSSize) );
-            else if ( xstrncmp( cleanType, "{NSRect" ) == 0 )
-                strcpy( cleanType, @encode(NSRect) );
-#endif
-            else if ( xstrncmp( cleanType, "{CGAffineTransform" ) == 0 )
-                strcpy( cleanType, @encode(CGAffineTransform) );
-
-            return [NSValue valueWithBytes:iptr objCType:cleanType];
         }
         @catch ( NSException *e ) {
             return @"raised exception";
         }
         case '*': {
             const char *ptr = *(const char **)iptr;
-            return ptr ? utf8String( ptr ) : @"NULL";
+            if ( !ptr )
+                return @"NULL";
+            return xreadableString( ptr ) ? utf8String( ptr ) : xtrapped( ptr );
         }
 #if 0
         case 'b':
@@ -632,8 +915,96 @@ id xvalueForIvar( id self, Ivar ivar, Class aClass ) {
 
 static NSString *invocationException;
 
+// Getters are called through their IMP by an invoker specialised on the
+// return type, cached by method type encoding. Anything else falls back
+// to NSInvocation.
+
+typedef void (*_xinvoke)( id self, SEL sel, IMP imp, void *result );
+
+template <typename T>
+static void xinvokeReturning( id self, SEL sel, IMP imp, void *result ) {
+    T value = ((T (*)( id, SEL ))imp)( self, sel );
+    memcpy( result, &value, sizeof value );
+}
+
+template <>
+void xinvokeReturning<void>( id self, SEL sel, IMP imp, void *result ) {
+    ((void (*)( id, SEL ))imp)( self, sel );
+}
+
+struct _xinvoker {
+    _xinvoke invoke;
+    NSUInteger size;
+    const char *returnType; // interned
+};
+
+static std::unordered_map<std::string,_xinvoker> invokersByEncoding;
+
+static _xinvoke xinvokerForType( const struct _xtypeinfo *info ) {
+    switch ( info->kind ) {
+        case 'v': case 'V': return xinvokeReturning<void>;
+        case 'c': case 'C': case 'B': return xinvokeReturning<uint8_t>;
+        case 's': case 'S': return xinvokeReturning<uint16_t>;
+        case 'i': case 'I': return xinvokeReturning<uint32_t>;
+        case 'l': case 'L': return xinvokeReturning<unsigned long>;
+        case 'q': case 'Q': return xinvokeReturning<uint64_t>;
+        case 'f': return xinvokeReturning<float>;
+        case 'd': return xinvokeReturning<double>;
+        case '@': case '#': case ':': case '*': case '^': return xinvokeReturning<void *>;
+        case '{':
+            if ( info->cleanType == @encode(CGRect) )
+                return xinvokeReturning<CGRect>;
+            else if ( info->cleanType == @encode(CGPoint) )
+                return xinvokeReturning<CGPoint>;
+            else if ( info->cleanType == @encode(CGSize) )
+                return xinvokeReturning<CGSize>;
+            else if ( info->cleanType == @encode(NSRange) )
+                return xinvokeReturning<NSRange>;
+            else if ( info->cleanType == @encode(CGAffineTransform) )
+                return xinvokeReturning<CGAffineTransform>;
+        default:
+            return NULL;
+    }
+}
+
+static struct _xinvoker xinvokerForMethod( Method method ) {
+    const char *encoding = method_getTypeEncoding( method );
+    pthread_mutex_lock( &typeLock );
+    auto found = invokersByEncoding.find( encoding );
+    if ( found != invokersByEncoding.end() ) {
+        struct _xinvoker invoker = found->second;
+        pthread_mutex_unlock( &typeLock );
+        return invoker;
+    }
+    pthread_mutex_unlock( &typeLock );
+
+    // leading nul as the descriptor keeps the character before the type
+    char returnType[257] = "";
+    method_getReturnType( method, returnType+1, sizeof returnType-1 );
+    const struct _xtypeinfo *info = xtypeInfo( returnType+1 );
+
+    struct _xinvoker invoker = {NULL, info->size, info->type};
+    if ( method_getNumberOfArguments( method ) == 2 )
+        invoker.invoke = xinvokerForType( info );
+
+    pthread_mutex_lock( &typeLock );
+    invokersByEncoding.emplace( encoding, invoker );
+    pthread_mutex_unlock( &typeLock );
+    return invoker;
+}
+
 id xvalueForMethod( id self, Method method ) {
     @try {
+        struct _xinvoker invoker = xinvokerForMethod( method );
+        if ( invoker.invoke ) {
+            SEL sel = method_getName( method );
+            char buffer[MAX( invoker.size, sizeof(void *) )];
+            invoker.invoke( self, sel, method_getImplementation( method ), buffer );
+            if ( invoker.returnType[0] == '@' )
+                return (__bridge id)*(void **)buffer;
+            return xvalueForPointer( self, sel_getName( sel ), buffer, invoker.returnType );
+        }
+
         const char *type = method_getTypeEncoding(method);
         NSMethodSignature *sig = [NSMethodSignature signatureWithObjCTypes:type];
         NSInvocation *invocation = [NSInvocation invocationWithMethodSignature:sig];
@@ -657,8 +1028,9 @@ id xvalueForMethod( id self, Method method ) {
 
 BOOL xvalueUpdateIvar( id self, Ivar ivar, NSString *value ) {
     char *iptr = (char *)(__bridge void *)self + ivar_getOffset(ivar);
-    const char *type = ivar_getTypeEncodingSwift( ivar, [self class] );
-    switch ( type[0] ) {
+    const struct _xtypeinfo *info = xivarInfo( ivar, [self class] );
+    const char *type = info ? info->type : "?";
+    switch ( info ? info->kind : '?' ) {
         case 'b': // Swift
         case 'B': *(bool *)iptr = [value boolValue]; break;
         case 'c': *(char *)iptr = [value intValue]; break;
@@ -691,6 +1063,173 @@ BOOL xvalueUpdateIvar( id self, Ivar ivar, NSString *value ) {
     return TRUE;
 }
 
+#pragma mark direct rendering of values
+
+// Scalars, selectors, classes and structs of them are formatted straight
+// into the output buffer. The text is the description of the object
+// xvalueForPointer() would return, structs are shown as {field, ...}.
+
+static void xappendFormatted( XprobeOutput *out, const char *format, ... ) __printflike(2, 3);
+static void xappendFormatted( XprobeOutput *out, const char *format, ... ) {
+    char buff[64];
+    va_list argp;
+    va_start(argp, format);
+    int len = vsnprintf( buff, sizeof buff, format, argp );
+    va_end(argp);
+    [out appendBytes:buff length:MIN( len, (int)sizeof buff - 1 )];
+}
+
+static void xrenderScalar( XprobeOutput *out, const void *iptr, char kind ) {
+    switch ( kind ) {
+        case 'B': [out appendInt:*(bool *)iptr]; break;
+        case 'c': [out appendInt:*(char *)iptr]; break;
+        case 's': [out appendInt:*(short *)iptr]; break;
+        case 'i': [out appendInt:*(int *)iptr]; break;
+        case 'q': [out appendInt:*(long long *)iptr]; break;
+        case 'l': [out appendInt:*(long *)iptr]; break;
+        case 'e': case 'O':
+            xappendFormatted( out, "%u", *(unsigned *)iptr ); break;
+        case 'Q': xappendFormatted( out, "%llu", *(unsigned long long *)iptr ); break;
+        case 'L': xappendFormatted( out, "%lu", *(unsigned long *)iptr ); break;
+        case 'C': xappendFormatted( out, "0x%x", *(unsigned char *)iptr ); break;
+        case 'a':
+        case 'S': xappendFormatted( out, "0x%x", *(unsigned short *)iptr ); break;
+        case 'I': xappendFormatted( out, "0x%x", *(unsigned *)iptr ); break;
+        case 'f': xappendFormatted( out, "%0.7g", *(float *)iptr ); break;
+        case 'd': xappendFormatted( out, "%0.16g", *(double *)iptr ); break;
+        case ':':
+            xappendLiteral( out, "@selector(" );
+            [out appendUTF8:*(SEL *)iptr ? sel_getName( *(SEL *)iptr ) : "(null)"];
+            xappendLiteral( out, ")" );
+            break;
+        case '#':
+            if ( Class aClass = *(const Class *)iptr ) {
+                xappendLiteral( out, "[" );
+                [out appendUTF8:class_getName( aClass )];
+                xappendLiteral( out, " class]" );
+            }
+            else
+                xappendLiteral( out, "Nil" );
+            break;
+        case '*': case '^':
+            [out appendPointer:*(void **)iptr];
+            break;
+    }
+}
+
+static void xrenderStruct( XprobeOutput *out, const char *&type, const char *base ) {
+    NSUInteger offset = 0, size, align;
+    xappendLiteral( out, "{" );
+    for ( type = strchr( type, '=' ) + 1 ; *type != '}' ; ) {
+        const char *next = NSGetSizeAndAlignment( type, &size, &align );
+        if ( type[-1] != '=' )
+            xappendLiteral( out, ", " );
+        offset = (offset + align - 1) / align * align;
+        if ( *type == '{' )
+            xrenderStruct( out, type, base + offset );
+        else {
+            xrenderScalar( out, base + offset, *type );
+            type = next;
+        }
+        offset += size;
+    }
+    xappendLiteral( out, "}" );
+    type++;
+}
+
+// NO when the value is an object that needs xvalueForPointer()
+BOOL xrenderPointer( XprobeOutput *out, id self, const char *name, void *iptr, const char *type, BOOL json ) {
+    if ( !type )
+        return NO;
+
+    char kind = type[0];
+    const struct _xtypeinfo *info = NULL;
+    unsigned widened;
+    switch ( kind ) {
+        case 'a':
+        case 'S':
+            if ( type[-1] == 'S' )
+                return NO;
+            break;
+        case 'i':
+#ifdef __LP64__
+            if ( isSwift( [self class] ) )
+                kind = 'l';
+#endif
+            break;
+        case '^':
+            // CF objects and pointers to unreadable memory are shown by xvalueForPointer()
+            if ( isCFType( type ) )
+                return NO;
+            if ( void *ptr = *(void **)iptr )
+                if ( !xreadable( ptr, 1 ) )
+                    return NO;
+            break;
+        case '*':
+            if ( const char *chars = *(const char **)iptr ) {
+                if ( !xreadableString( chars ) )
+                    return NO;
+                if ( json )
+                    [out appendJSON:chars length:strlen( chars ) unescapingQuotes:NO];
+                else
+                    [out appendEscaped:chars length:strlen( chars )];
+            }
+            else if ( json )
+                xappendLiteral( out, "\"NULL\"" );
+            else
+                xappendLiteral( out, "NULL" );
+            return YES;
+        case '{':
+            info = xtypeInfo( type );
+            switch ( info->structKind ) {
+                case xstructInt8: kind = 'c'; break;
+                case xstructInt16: kind = 's'; break;
+                case xstructInt32: kind = 'i'; break;
+                case xstructUInt8: case xstructUInt16: case xstructUInt32:
+                    // Swift's unsigned integers print in decimal, 'C', 'S' and 'I' are hex
+                    widened = info->structKind == xstructUInt8 ? *(unsigned char *)iptr :
+                        info->structKind == xstructUInt16 ? *(unsigned short *)iptr : *(unsigned *)iptr;
+                    iptr = &widened;
+                    kind = 'e'; // "%u"
+                    break;
+                case xstructUnknown: kind = 'I'; break;
+                case xstructCGFloat: kind = sizeof(CGFloat) == sizeof(double) ? 'd' : 'f'; break;
+                case xstructValue:
+                    if ( info->renderable )
+                        break;
+                default:
+                    return NO;
+            }
+            break;
+        case 'V': case 'v':
+        case 'b': case 'B': case 'c': case 'C': case 's': case 'O': case 'e':
+        case 'I': case 'f': case 'd': case 'q': case 'l': case 'Q': case 'L':
+        case ':': case '#':
+            break;
+        default:
+            return NO;
+    }
+
+    if ( json )
+        xappendLiteral( out, "\"" );
+    if ( kind == 'v' || kind == 'V' )
+        xappendLiteral( out, "void" );
+    else if ( kind == '{' ) {
+        const char *clean = info->cleanType.c_str();
+        xrenderStruct( out, clean, (const char *)iptr );
+    }
+    else
+        xrenderScalar( out, iptr, kind == 'b' ? 'B' : kind );
+    if ( json )
+        xappendLiteral( out, "\"" );
+    return YES;
+}
+
+BOOL xrenderIvar( XprobeOutput *out, id self, Ivar ivar, Class aClass, BOOL json ) {
+    void *iptr = (char *)(__bridge void *)self + ivar_getOffset(ivar);
+    return xrenderPointer( out, self, ivar_getName( ivar ), iptr, ivar_getTypeEncodingSwift( ivar, aClass ), json );
+}
+
 #pragma mark HTML representation of type
 
 NSString *xlinkForProtocol( NSString *protolName ) {
@@ -781,9 +1320,20 @@ static NSString *xtype_( const char *type ) {
 }
 
 NSString *xtype( const char *type ) {
+    struct _xtypeinfo *info = (struct _xtypeinfo *)xtypeInfo( type );
+    if ( info && info->name )
+        return info->name;
+
     NSString *typeStr = xtype_( type );
-    return [NSString stringWithFormat:@"<span class=\\'%@\\' title=\\'%s\\'>%@</span>",
-            [typeStr hasSuffix:@"*"] ? @"classStyle" : @"typeStyle", type, typeStr];
+    NSString *name = [NSString stringWithFormat:@"<span class=\\'%@\\' title=\\'%s\\'>%@</span>",
+                      [typeStr hasSuffix:@"*"] ? @"classStyle" : @"typeStyle", type, typeStr];
+    if ( info ) {
+        pthread_mutex_lock( &typeLock );
+        if ( !info->name )
+            info->name = name;
+        pthread_mutex_unlock( &typeLock );
+    }
+    return name;
 }
 
 #endif
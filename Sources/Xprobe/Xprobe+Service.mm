@@ -112,8 +112,9 @@ static int clientSocket;
         }
 
         [self writeString:[[NSBundle mainBundle] bundleIdentifier]];
-        [self writeString:XPROBE_KEY];
+        [self writeString:XPROBE_KEY XPROBE_CAPABILITIES];
         [self performSelectorInBackground:@selector(service) withObject:nil];
+        [self performSelectorInBackground:@selector(indexSymbols) withObject:nil];
     }
 
     [self hackSwiftObject];
@@ -188,51 +189,135 @@ static int clientSocket;
     return str;
 }
 
+static dispatch_queue_t writeQueue;
+static XprobeCompression compressFast, compressBulk;
+
+// frames over the threshold are compressed if it actually saves space
+static BOOL xwriteCompressed( const void *data, uint32_t length ) {
+    XprobeCompression compression = length < XPROBE_COMPRESS_BULK ? compressFast : compressBulk;
+    if ( !compression || length < XPROBE_COMPRESS_MIN )
+        return NO;
+
+    size_t header = sizeof length + sizeof compression, compressed = 0;
+    uint8_t *frame = (uint8_t *)malloc( header + length );
+    if ( frame )
+        compressed = compression_encode_buffer( frame + header, length, (const uint8_t *)data, length,
+                                                NULL, xprobeAlgorithm( compression ) );
+    if ( !compressed ) {
+        free( frame );
+        return NO;
+    }
+
+    memcpy( frame, &length, sizeof length );
+    frame[sizeof length] = compression;
+
+    uint32_t frameLength = (uint32_t)(header + compressed), flagged = frameLength | XPROBE_COMPRESSED;
+    if ( write( clientSocket, &flagged, sizeof flagged ) != sizeof flagged ||
+        write( clientSocket, frame, frameLength ) != frameLength )
+        NSLog( @"Xprobe: Socket write error %s", strerror(errno) );
+
+    free( frame );
+    return YES;
+}
+
+static void xwriteBytes( const void *data, uint32_t length ) {
+    if ( !clientSocket )
+        NSLog( @"Xprobe: Write to closed" );
+    else if ( xwriteCompressed( data, length ) )
+        return;
+    else if ( write( clientSocket, &length, sizeof length ) != sizeof length ||
+             write( clientSocket, data, length ) != length )
+        NSLog( @"Xprobe: Socket write error %s", strerror(errno) );
+}
+
 + (void)writeString:(NSString *)str {
-    static dispatch_queue_t writeQueue;
     if ( !writeQueue )
         writeQueue = dispatch_queue_create("XprobeWrite", DISPATCH_QUEUE_SERIAL);
 
     dispatch_async(writeQueue, ^{
         @autoreleasepool {
             const char *data = [str UTF8String]?:" ";
-            uint32_t length = (uint32_t)strlen(data);
-
-            if ( !clientSocket )
-                NSLog( @"Xprobe: Write to closed" );
-            else if ( write( clientSocket, &length, sizeof length ) != sizeof length ||
-                     write( clientSocket, data, length ) != length )
-                NSLog( @"Xprobe: Socket write error %s", strerror(errno) );
+            xwriteBytes( data, (uint32_t)strlen(data) );
         }
     });
 }
 
+// sends the UTF-8 already built up without re-encoding
++ (void)writeOutput:(XprobeOutput *)output {
+    if ( !writeQueue )
+        writeQueue = dispatch_queue_create("XprobeWrite", DISPATCH_QUEUE_SERIAL);
+
+    NSData *data = [output detachData];
+    dispatch_async(writeQueue, ^{
+        if ( data.length )
+            xwriteBytes( data.bytes, (uint32_t)data.length );
+        else
+            xwriteBytes( " ", 1 );
+    });
+}
+
 + (void)search:(NSString *)pattern {
     [self performSelectorOnMainThread:@selector(_search:) withObject:pattern waitUntilDone:NO];
 }
 
 static int lastPathID;
+static BOOL structuredResponses;
+
+// console renders "json: " messages itself
++ (void)structured:(NSString *)input {
+    structuredResponses = [input intValue];
+}
+
+// algorithms the console can decompress, fastest first
++ (void)compress:(NSString *)input {
+    XprobeCompression available[] = {XprobeCompressionNone, XprobeCompressionNone};
+    int count = 0;
+
+    for ( NSString *name in [input componentsSeparatedByString:@","] )
+        if ( count < 2 ) {
+            if ( [name isEqualToString:@"lz4"] )
+                available[count++] = XprobeCompressionLZ4;
+            else if ( [name isEqualToString:@"lzfse"] )
+                available[count++] = XprobeCompressionLZFSE;
+            else if ( [name isEqualToString:@"zlib"] )
+                available[count++] = XprobeCompressionZLIB;
+        }
+
+    compressFast = available[0];
+    compressBulk = count > 1 ? available[1] : available[0];
+}
 
 + (void)open:(NSString *)input {
     lastPathID = [input intValue];
     XprobePath *path = xprobePaths[lastPathID];
     id obj = [path object];
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
+
+    if ( structuredResponses && obj ) {
+        xappendLiteral( html, "json: " );
+        if ( [obj xjsonForPathID:lastPathID into:html] ) {
+            [self writeOutput:html];
+            if ( ![path isKindOfClass:[XprobeSuper class]] )
+                [self writeString:[path xpath]];
+            return;
+        }
+        [html reset];
+    }
 
     [html appendFormat:@"$('%d').outerHTML = '", lastPathID];
     if ( obj == nil ) {
         NSLog( @"Weakly held object #%d no londer exists", lastPathID );
-        [html appendString:@"nil /* dealloced */"];
+        xappendLiteral( html, "nil /* dealloced */" );
     }
     else {
         [obj xlinkForCommand:@"close" withPathID:lastPathID into:html];
-        [html appendString:@"<br/>"];
+        xappendLiteral( html, "<br/>" );
         [self xopen:obj withPathID:lastPathID into:html];
     }
 
-    [html appendString:@"';"];
+    xappendLiteral( html, "';" );
 //    NSLog( @"HTML: %@", html );
-    [self writeString:html];
+    [self writeOutput:html];
 
     if ( ![path isKindOfClass:[XprobeSuper class]] )
         [self writeString:[path xpath]];
@@ -274,9 +359,9 @@ static int lastPathID;
 
 + (void)complete:(NSString *)input {
     XprobePath *path = xprobePaths[[input intValue]];
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
 
-    [html appendString:@"$(); window.properties = '"];
+    xappendLiteral( html, "$(); window.properties = '" );
 
     if (NSArray *members = [xloadXprobeSwift("") listMembers:[path object]])
         for ( int i=0 ; i<members.count ; i++ )
@@ -296,28 +381,28 @@ static int lastPathID;
         free(props);
     }
 
-    [html appendString:@"'.split(',');"];
-    [self writeString:html];
+    xappendLiteral( html, "'.split(',');" );
+    [self writeOutput:html];
 }
 
 + (void)close:(NSString *)input {
     int pathID = [input intValue];
     id obj = [xprobePaths[pathID] object];
 
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
 
     [html appendFormat:@"$('%d').outerHTML = '", pathID];
     [obj xlinkForCommand:@"open" withPathID:pathID into:html];
 
-    [html appendString:@"';"];
-    [self writeString:html];
+    xappendLiteral( html, "';" );
+    [self writeOutput:html];
 }
 
 + (void)properties:(NSString *)input {
     int pathID = [input intValue];
     Class aClass = [xprobePaths[pathID] aClass];
 
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
     [html appendFormat:@"$('P%d').outerHTML = '<span class=\\'propsStyle\\'><br/><br/>", pathID];
 
     unsigned pc;
@@ -335,8 +420,8 @@ static int lastPathID;
 
     free( props );
 
-    [html appendString:@"</span>';"];
-    [self writeString:html];
+    xappendLiteral( html, "</span>';" );
+    [self writeOutput:html];
 }
 
 #ifndef _IvarAccess_h
@@ -363,7 +448,7 @@ static struct _swift_class *isSwift( Class aClass ) {
     int pathID = [input intValue];
     Class aClass = [xprobePaths[pathID] aClass];
 
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
     [html appendFormat:@"$('M%d').outerHTML = '<br/><span class=\\'methodStyle\\'>"
      "Method Filter: <input type=textfield size=10 onchange=\\'methodFilter(this);\\'>", pathID];
 
@@ -377,12 +462,12 @@ static struct _swift_class *isSwift( Class aClass ) {
     if ( isSwift( aClass ) )
         [xloadXprobeSwift("methods:") dumpMethods:aClass into:html];
 
-    [html appendString:@"</span>';"];
-    [self writeString:html];
+    xappendLiteral( html, "</span>';" );
+    [self writeOutput:html];
 }
 
 + (void)dumpMethodType:(const char *)mtype forClass:(Class)aClass original:(Class)original
-                pathID:(int)pathID into:(NSMutableString *)html {
+                pathID:(int)pathID into:(XprobeOutput *)html {
     unsigned mc;
     Method *methods = class_copyMethodList(aClass, &mc);
     NSString *hide = aClass == original ? @"" :
@@ -390,7 +475,7 @@ static struct _swift_class *isSwift( Class aClass ) {
      NSStringFromClass(aClass)];
 
     if ( mc && ![hide length] )
-        [html appendString:@"<br/>"];
+        xappendLiteral( html, "<br/>" );
 
     for ( unsigned i=0 ; i<mc ; i++ ) {
         const char *name = sel_getName(method_getName(methods[i]));
@@ -416,7 +501,7 @@ static struct _swift_class *isSwift( Class aClass ) {
             [html appendFormat:@"<span onclick=\\'this.id =\"M%d\"; sendClient( \"method:\", \"%d,%@\" );"
              "event.cancelBubble = true;\\'>%@</span> ", pathID, pathID, utf8Name, utf8Name];
 
-        [html appendString:@";</div>"];
+        xappendLiteral( html, ";</div>" );
     }
 
     free( methods );
@@ -428,7 +513,7 @@ static struct _swift_class *isSwift( Class aClass ) {
     if ( [protocolName isEqualToString:@"nil"] )
         protocolName = protoName;
 
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
     [html appendFormat:@"$('%@').outerHTML = '<span id=\\'%@\\'><a href=\\'#\\' onclick=\\'sendClient( \"_protocol:\", \"%@\"); "
         "event.cancelBubble = true; return false;\\'>%@</a><p/><table><tr><td/><td class=\\'indent\\'/><td>"
         "<span class=\\'protoStyle\\'>@protocol %@", protoName, protoName, protoName, protocolName, protocolName];
@@ -436,20 +521,20 @@ static struct _swift_class *isSwift( Class aClass ) {
     unsigned pc;
     Protocol *__unsafe_unretained *protos = protocol_copyProtocolList(protocol, &pc);
     if ( pc ) {
-        [html appendString:@" &lt;"];
+        xappendLiteral( html, " &lt;" );
 
         for ( unsigned i=0 ; i<pc ; i++ ) {
             if ( i )
-                [html appendString:@", "];
+                xappendLiteral( html, ", " );
             NSString *protocolName = NSStringFromProtocol(protos[i]);
             [html appendString:xlinkForProtocol( protocolName )];
         }
 
-        [html appendString:@"&gt;"];
+        xappendLiteral( html, "&gt;" );
         free( protos );
     }
 
-    [html appendString:@"<br/>"];
+    xappendLiteral( html, "<br/>" );
 
     objc_property_t *props = protocol_copyPropertyList(protocol, &pc);
 
@@ -468,14 +553,14 @@ static struct _swift_class *isSwift( Class aClass ) {
     [self dumpMethodsForProtocol:protocol required:YES instance:YES into:html];
     [self dumpMethodsForProtocol:protocol required:NO instance:YES into:html];
 
-    [html appendString:@"<br/>@end<p/></span></td></tr></table></span>';"];
-    [self writeString:html];
+    xappendLiteral( html, "<br/>@end<p/></span></td></tr></table></span>';" );
+    [self writeOutput:html];
 }
 
 // Thanks to http://bou.io/ExtendedTypeInfoInObjC.html !
 extern "C" const char *_protocol_getMethodTypeEncoding(Protocol *,SEL,BOOL,BOOL);
 
-+ (void)dumpMethodsForProtocol:(Protocol *)protocol required:(BOOL)required instance:(BOOL)instance into:(NSMutableString *)html {
++ (void)dumpMethodsForProtocol:(Protocol *)protocol required:(BOOL)required instance:(BOOL)instance into:(XprobeOutput *)html {
 
     unsigned mc;
     objc_method_description *methods = protocol_copyMethodDescriptionList( protocol, required, instance, &mc );
@@ -509,37 +594,37 @@ extern "C" const char *_protocol_getMethodTypeEncoding(Protocol *,SEL,BOOL,BOOL)
         else
             [html appendFormat:@"%@", utf8Name];
 
-        [html appendString:@" ;<br/>"];
+        xappendLiteral( html, " ;<br/>" );
     }
 
     free( methods );
 }
 
 + (void)_protocol:(NSString *)protocolName {
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
     [html appendFormat:@"$('%@').outerHTML = '%@';",
      protocolName, xlinkForProtocol( protocolName )];
-    [self writeString:html];
+    [self writeOutput:html];
 }
 
 + (void)views:(NSString *)input {
     int pathID = [input intValue];
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
 
     [html appendFormat:@"$('V%d').outerHTML = '<br/>", pathID];
     [self subviewswithPathID:pathID indent:0 into:html];
 
-    [html appendString:@"';"];
-    [self writeString:html];
+    xappendLiteral( html, "';" );
+    [self writeOutput:html];
 }
 
-+ (void)subviewswithPathID:(int)pathID indent:(int)indent into:(NSMutableString *)html {
++ (void)subviewswithPathID:(int)pathID indent:(int)indent into:(XprobeOutput *)html {
     id obj = [xprobePaths[pathID] object];
     for ( int i=0 ; i<indent ; i++ )
-        [html appendString:@"&#160; &#160; "];
+        xappendLiteral( html, "&#160; &#160; " );
 
     [obj xlinkForCommand:@"open" withPathID:pathID into:html];
-    [html appendString:@"<br/>"];
+    xappendLiteral( html, "<br/>" );
 
     #if !TARGET_OS_WATCH
     NSArray *subviews = [obj subviews];
@@ -573,25 +658,44 @@ struct _xinfo {
     return info;
 }
 
++ (void)more:(NSString *)input {
+    struct _xinfo info = [self parseInput:input];
+    XprobeOutput *html = [XprobeOutput new];
+
+    [html appendFormat:@"$('MORE%d').outerHTML = '", info.pathID];
+    [info.obj xopenPathID:info.pathID from:[info.name integerValue] into:html];
+
+    xappendLiteral( html, "';" );
+    [self writeOutput:html];
+}
+
 + (void)ivar:(NSString *)input {
     struct _xinfo info = [self parseInput:input];
     Ivar ivar = class_getInstanceVariable( info.aClass, [info.name UTF8String] );
     const char *type = ivar_getTypeEncodingSwift( ivar, info.aClass );
 
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
+
+    if ( structuredResponses ) {
+        [html appendFormat:@"json: {\"op\":\"ivar\",\"pathID\":%d,\"ivar\":", info.pathID];
+        [info.obj xjsonForPathID:info.pathID ivar:ivar type:type into:html];
+        xappendLiteral( html, "}" );
+        [self writeOutput:html];
+        return;
+    }
 
     [html appendFormat:@"$('I%d').outerHTML = '", info.pathID];
     [info.obj xspanForPathID:info.pathID ivar:ivar type:type into:html];
 
-    [html appendString:@"';"];
-    [self writeString:html];
+    xappendLiteral( html, "';" );
+    [self writeOutput:html];
 }
 
 + (void)edit:(NSString *)input {
     struct _xinfo info = [self parseInput:input];
     Ivar ivar = class_getInstanceVariable( info.aClass, [info.name UTF8String] );
 
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
 
     [html appendFormat:@"$('E%d').outerHTML = '"
      "<span id=E%d><input type=textfield size=10 value=\\'%@\\' "
@@ -599,7 +703,7 @@ struct _xinfo {
      info.pathID, info.pathID, xvalueForIvar( info.obj, ivar, info.aClass ),
      info.pathID, info.name];
 
-    [self writeString:html];
+    [self writeOutput:html];
 }
 
 + (void)save:(NSString *)input {
@@ -612,13 +716,13 @@ struct _xinfo {
         if ( !xvalueUpdateIvar( info.obj, ivar, info.value ) )
             NSLog( @"Xprobe: unable to update ivar \"%@\" in %@", info.name, info.obj);
 
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
 
     [html appendFormat:@"$('E%d').outerHTML = '<span onclick=\\'this.id =\"E%d\"; "
      "sendClient( \"edit:\", \"%d,%@\" ); event.cancelBubble = true;\\'><i>%@</i></span>';",
      info.pathID, info.pathID, info.pathID, info.name, xvalueForIvar( info.obj, ivar, info.aClass )];
 
-    [self writeString:html];
+    [self writeOutput:html];
 }
 
 + (void)property:(NSString *)input {
@@ -652,7 +756,7 @@ struct _xinfo {
                prefix:(const char *)prefix command:(const char *)command {
     id result = method ? xvalueForMethod( info.obj, method ) : @"nomethod";
 
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
     [html appendFormat:@"$('%s%d').outerHTML = '<span onclick=\\'"
      "this.id =\"%s%d\"; sendClient( \"%s\", \"%d,%@\" ); event.cancelBubble = true;\\'>%@ = ",
      prefix, info.pathID, prefix, info.pathID, command, info.pathID, info.name, info.name];
@@ -665,8 +769,8 @@ struct _xinfo {
     else
         [html appendFormat:@"%@", result ?: @"nil"];
 
-    [html appendString:@"</span>';"];
-    [self writeString:html];
+    xappendLiteral( html, "</span>';" );
+    [self writeOutput:html];
 }
 
 + (void)render:(NSString *)input {
@@ -696,21 +800,21 @@ struct _xinfo {
 #endif
     });
 
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
     [html appendFormat:@"$('R%d').outerHTML = '<span id=\\'R%d\\'><p/>"
      "<img src=\\'data:image/png;base64,%@\\' onclick=\\'sendClient(\"_render:\", \"%d\"); "
      "event.cancelBubble = true;\\'><p/></span>';", pathID, pathID,
      [data base64EncodedStringWithOptions:0], pathID];
-    [self writeString:html];
+    [self writeOutput:html];
 }
 
 + (void)_render:(NSString *)input {
     int pathID = [input intValue];
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
     [html appendFormat:@"$('R%d').outerHTML = '", pathID];
-    [html xlinkForCommand:@"render" withPathID:pathID into:html];
-    [html appendString:@"';"];
-    [self writeString:html];
+    [[xprobePaths[pathID] object] xlinkForCommand:@"render" withPathID:pathID into:html];
+    xappendLiteral( html, "';" );
+    [self writeOutput:html];
 }
 
 + (void)class:(NSString *)className {
@@ -719,16 +823,16 @@ struct _xinfo {
         return;
     
     int pathID = [path xadd];
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
     
     [html appendFormat:@"$('%@').outerHTML = '", className];
     [path xlinkForCommand:@"close" withPathID:pathID into:html];
     
-    [html appendString:@"<br/><table><tr><td class=\\'indent\\'/><td class=\\'drilldown\\'>"];
+    xappendLiteral( html, "<br/><table><tr><td class=\\'indent\\'/><td class=\\'drilldown\\'>" );
     [path xopenPathID:pathID into:html];
     
-    [html appendString:@"</td></tr></table></span>';"];
-    [self writeString:html];
+    xappendLiteral( html, "</td></tr></table></span>';" );
+    [self writeOutput:html];
 }
 
 + (void)lookup:(NSString *)sym {
@@ -57,11 +57,17 @@
 
 #import <libkern/OSAtomic.h>
 #import <os/lock.h>
+#import <mach/mach_time.h>
+#import <atomic>
 #import <vector>
 #import <map>
+#import <tuple>
+#import <string>
 
 #import "Xprobe.h"
 #import "IvarAccess.h"
+#import "XprobeOutput.h"
+#import "XprobeIndex.h"
 
 static NSString *swiftPrefix = @"_TtC";
 static BOOL logXprobeSweep = NO;
@@ -84,7 +90,20 @@ static struct _xsweep sweepState;
 
 static std::map<__unsafe_unretained id,struct _xsweep> instancesSeen;
 static std::map<__unsafe_unretained Class,std::vector<__unsafe_unretained id> > instancesByClass;
-static std::map<__unsafe_unretained id,BOOL> instancesTraced;
+static std::map<__unsafe_unretained id,BOOL> instancesTraced; // read from traced threads
+static pthread_mutex_t instancesTracedLock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool xinstanceTraced( __unsafe_unretained id obj ) {
+    pthread_mutex_lock( &instancesTracedLock );
+    bool traced = exists( instancesTraced, obj );
+    pthread_mutex_unlock( &instancesTracedLock );
+    return traced;
+}
+
+// element order of sets & dictionaries fixed for the lifetime of the path
+// that opened them, retained only when paths retain the objects they refer to
+static std::map<int,NSPointerArray *> collectionOrder;
+static NSUInteger maxCollectionItemsPerPage = 100, maxCollectionKeysSorted = 1000;
 
 BOOL xprobeRetainObjects = YES;
 NSMutableArray<XprobePath *> *xprobePaths;
@@ -109,17 +128,40 @@ typedef NS_OPTIONS(NSUInteger, XGraphOptions) {
     XGraphAllObjects             = 1 << 2,
     XGraphWithoutExcepton        = 1 << 3,
     XGraphIncludedOnly           = 1 << 4,
+    XGraphByClass                = 1 << 5,
 };
 
 static NSString *graphOutlineColor = @"#000000", *graphHighlightColor = @"#ff0000";
 static unsigned maxArrayItemsForGraphing = 20, currentMaxArrayIndex;
 
 static XGraphOptions graphOptions;
-static NSMutableString *dotGraph;
+static XprobeOutput *dotGraph;
 
 static unsigned graphEdgeID;
 static BOOL graphAnimating;
 
+// instances and references aggregated when graphing by class
+struct _xclassNode {
+    unsigned sequence, instances;
+    BOOL isView, included;
+};
+
+static std::map<__unsafe_unretained Class,struct _xclassNode> classesGraphed;
+static std::map<__unsafe_unretained id,BOOL> instancesGrouped;
+static std::map<std::tuple<__unsafe_unretained Class,std::string,__unsafe_unretained Class>,unsigned> classEdges;
+static void xgraphGroupedClasses();
+
+// graphs are bounded in size and sent in chunks to consoles that accept
+// them so the app never holds the whole dot, the console lays it out once
+// the last chunk arrives
+#define GRAPH_CHUNK_SIZE (64*1024)
+
+static BOOL graphStreaming;
+static unsigned maxGraphNodes = 2000, maxGraphEdges = 5000;
+static unsigned graphNodeCount, graphEdgeCount, edgesOmitted;
+static BOOL graphEdgeOmitted; // last connection was selected but over budget
+static std::map<__unsafe_unretained id,BOOL> instancesOmitted;
+
 #pragma mark snapshot capture
 
 static char snapshotInclude[] =
@@ -196,10 +238,12 @@ function kitswitch(checkbox) {\n\
 <b>Application Memory Snapshot</b>\n\
 (<input type=checkbox onclick='kitswitch(this);' checked/> - Filter out \"kit\" instances)<br/>\n";
 
-@interface SnapshotString : NSObject {
+#define SNAPSHOT_FLUSH_SIZE (256*1024)
+
+@interface SnapshotString : XprobeOutput {
     FILE *out;
 }
-- (void)appendFormat:(NSString *)format, ... NS_FORMAT_FUNCTION(1,2);
+- (void)close;
 @end
 
 @implementation SnapshotString
@@ -214,21 +258,39 @@ function kitswitch(checkbox) {\n\
     return self;
 }
 
-- (int)write:(const char *)chars {
-  return fputs( chars, out );
+- (size_t)write:(const char *)chars length:(size_t)len {
+    return fwrite( chars, 1, len, out );
 }
 
-- (void)appendString:(NSString *)aString {
-    NSString *unescaped = [aString stringByReplacingOccurrencesOfString:@"\\'" withString:@"'"];
-    [self write:[unescaped UTF8String]];
+// written to file as the buffer fills rather than held in memory
+- (void)reserve:(NSUInteger)extra {
+    if ( self.length + extra > SNAPSHOT_FLUSH_SIZE )
+        [self flush];
+    [super reserve:extra];
 }
 
-- (void)appendFormat:(NSString *)format, ... {
-    va_list argp; va_start(argp, format);
-    return [self appendString:[[NSString alloc] initWithFormat:format arguments:argp]];
+// escaped quotes are only required when the HTML is sent as JavaScript
+- (void)flush {
+    const char *chars = self.bytes, *from = chars, *end = chars + self.length;
+    BOOL held = end > chars && end[-1] == '\\';
+    if ( held )
+        end--;
+
+    for ( const char *ptr = chars ; ptr + 1 < end ; ptr++ )
+        if ( ptr[0] == '\\' && ptr[1] == '\'' ) {
+            [self write:from length:ptr - from];
+            from = ++ptr;
+        }
+
+    [self write:from length:end - from];
+    [self reset];
+    if ( held )
+        [super appendBytes:"\\" length:1];
 }
 
 - (void)close {
+    [self flush];
+    [self write:self.bytes length:self.length];
     if ( out )
         fclose( out );
 }
@@ -256,11 +318,13 @@ function kitswitch(checkbox) {\n\
     return self;
 }
 
-- (int)write:(const char *)chars {
-    return gzputs( zout, chars );
+- (size_t)write:(const char *)chars length:(size_t)len {
+    return gzwrite( zout, chars, (unsigned)len );
 }
 
 - (void)close {
+    [self flush];
+    [self write:self.bytes length:self.length];
     if ( zout )
         gzclose( zout );
 }
@@ -414,6 +478,17 @@ static const char *seedName = "seed", *superName = "super";
     return [[xprobePaths[self.pathID] object] allObjects];
 }
 
+- (id)object {
+    auto order = collectionOrder.find(self.pathID);
+    if ( order == collectionOrder.end() )
+        return [super object];
+    if ( self.sub < order->second.count )
+        return (__bridge id)[order->second pointerAtIndex:self.sub];
+    NSLog( @"Xprobe: %@ reference %d beyond end of set %d",
+          xNSStringFromClass([self class]), (int)self.sub, (int)order->second.count );
+    return nil;
+}
+
 @end
 
 @implementation XprobeView
@@ -520,7 +595,7 @@ static const char *seedName = "seed", *superName = "super";
      [NSBundle mainBundle].infoDictionary[@"CFBundleIdentifier"], hostname];
 
     snapshotExclusions = [NSRegularExpression xsimpleRegexp:exclusions];
-    [self filterSweepOutputBy:@"" into:(NSMutableString *)snapshot];
+    [self filterSweepOutputBy:@"" into:snapshot];
     [snapshot appendString:@"</body></html>"];
     [snapshot close];
     snapshot = nil;
@@ -535,6 +610,10 @@ static const char *seedName = "seed", *superName = "super";
     instancesSeen.clear();
     instancesByClass.clear();
     instancesLabeled.clear();
+    collectionOrder.clear();
+    classesGraphed.clear();
+    instancesGrouped.clear();
+    classEdges.clear();
 
     sweepState.sequence = sweepState.depth = 0;
     sweepState.source = seedName;
@@ -546,7 +625,7 @@ static const char *seedName = "seed", *superName = "super";
     NSLog( @"Xprobe: sweep complete, %d objects found", (int)xprobePaths.count );
 }
 
-+ (void)filterSweepOutputBy:(NSString *)pattern into:(NSMutableString *)html {
++ (void)filterSweepOutputBy:(NSString *)pattern into:(XprobeOutput *)html {
     // original search by instance's class name
     NSRegularExpression *classRegexp = [NSRegularExpression xsimpleRegexp:pattern];
     std::map<__unsafe_unretained id,int> matchedObjects;
@@ -573,79 +652,142 @@ static const char *seedName = "seed", *superName = "super";
 
                 struct _xsweep &info = instancesSeen[obj];
                 for ( unsigned i=1 ; i<info.depth ; i++ )
-                    [html appendString:@"&#160; &#160; "];
+                    xappendLiteral( html, "&#160; &#160; " );
 
                 [obj xlinkForCommand:@"open" withPathID:info.sequence into:html];
-                [html appendString:@"</div>"];
+                xappendLiteral( html, "</div>" );
             }
         }
     }
     else
         if ( ![self findClassesMatching:classRegexp into:html] )
-            [html appendString:@"No root objects or classes found, check class name pattern.<br/>"];
+            xappendLiteral( html, "No root objects or classes found, check class name pattern.<br/>" );
 }
 
-+ (NSUInteger)findClassesMatching:(NSRegularExpression *)classRegexp into:(NSMutableString *)html {
-
-    unsigned ccount;
-    Class *classes = objc_copyClassList( &ccount );
-    NSMutableArray *classesFound = [NSMutableArray new];
+// results of the last class or method search, sent a page at a time
+static std::vector<uint32_t> foundClasses;
+static std::map<uint32_t,std::vector<uint32_t> > foundMethods;
+static unichar foundType;
+static NSUInteger foundSearch; // echoed by the "more" link so stale pages are ignored
+static NSUInteger maxSearchResultsPerPage = 500;
 
-    for ( unsigned i=0 ; i<ccount ; i++ ) {
-        NSString *className = xNSStringFromClass(classes[i]);
-        if ( [classRegexp xmatches:className] && ![className hasPrefix:@"__"] )
-            [classesFound addObject:className];
-    }
++ (void)indexSymbols {
+    pthread_mutex_lock( &symbolIndexLock );
+    xsymbolIndex( xNSStringFromClass );
+    pthread_mutex_unlock( &symbolIndexLock );
+}
 
-    free( classes );
++ (NSUInteger)findClassesMatching:(NSRegularExpression *)classRegexp into:(XprobeOutput *)html {
+    if ( !classRegexp )
+        return 0;
 
-    [classesFound sortUsingSelector:@selector(caseInsensitiveCompare:)];
+    pthread_mutex_lock( &symbolIndexLock );
+    XprobeSymbolIndex &index = xsymbolIndex( xNSStringFromClass );
+    std::vector<uint32_t> matched;
+    index.classNames.matching( classRegexp.pattern, classRegexp, matched );
 
-    for ( NSString *className in classesFound ) {
-        XprobeClass *path = [XprobeClass new];
-        path.aClass = NSClassFromString(className);
-        [path xlinkForCommand:@"open" withPathID:[path xadd] into:html];
-        [html appendString:@"<br/>"];
-    }
+    foundClasses.clear();
+    foundMethods.clear();
+    foundType = 0;
+    NSUInteger search = ++foundSearch;
+    for ( uint32_t classID : matched )
+        if ( ![index.classNames.name( classID ) hasPrefix:@"__"] )
+            foundClasses.push_back( classID );
+    index.classNames.sortByName( foundClasses );
+    NSUInteger found = foundClasses.size();
+    pthread_mutex_unlock( &symbolIndexLock );
 
-    return [classesFound count];
+    [self foundFrom:0 ofSearch:search into:html];
+    return found;
 }
 
-+ (void)findMethodsMatching:(NSString *)pattern type:(unichar)firstChar into:(NSMutableString *)html {
++ (void)findMethodsMatching:(NSString *)pattern type:(unichar)firstChar into:(XprobeOutput *)html {
 
     NSRegularExpression *methodRegexp = [NSRegularExpression xsimpleRegexp:pattern];
-    NSMutableDictionary *classesFound = [NSMutableDictionary new];
-
-    unsigned ccount;
-    Class *classes = objc_copyClassList( &ccount );
-    for ( unsigned i=0 ; i<ccount ; i++ ) {
-        Class aClass = firstChar=='+' ? object_getClass(classes[i]) : classes[i];
-        NSMutableString *methodsFound = nil;
-
-        unsigned mc;
-        Method *methods = class_copyMethodList(aClass, &mc);
-        for ( unsigned i=0 ; i<mc ; i++ ) {
-            NSString *methodName = NSStringFromSelector(method_getName(methods[i]));
-            if ( [methodRegexp xmatches:methodName] ) {
-                if ( !methodsFound )
-                    methodsFound = [NSMutableString stringWithString:@"<br/>"];
-                [methodsFound appendFormat:@"&#160; &#160; %@%@<br/>", [NSString stringWithCharacters:&firstChar length:1], methodName];
-            }
+
+    pthread_mutex_lock( &symbolIndexLock );
+    XprobeSymbolIndex &index = xsymbolIndex( xNSStringFromClass );
+    std::vector<uint32_t> selectors;
+    index.selectorNames.matching( pattern, methodRegexp, selectors );
+
+    foundClasses.clear();
+    foundMethods.clear();
+    foundType = firstChar;
+    NSUInteger search = ++foundSearch;
+    for ( uint32_t selectorID : selectors )
+        for ( const auto &implementor : index.implementors[selectorID] )
+            if ( implementor.meta == (firstChar == '+') )
+                foundMethods[implementor.classID].push_back( selectorID );
+
+    for ( auto &found : foundMethods ) {
+        NSString *className = index.classNames.name( found.first );
+        if ( [className length] > 1 && [className characterAtIndex:1] != '_' ) {
+            index.selectorNames.sortByName( found.second );
+            foundClasses.push_back( found.first );
         }
+    }
+    index.classNames.sortByName( foundClasses );
+    pthread_mutex_unlock( &symbolIndexLock );
 
-        if ( methodsFound )
-            classesFound[xNSStringFromClass(classes[i])] = methodsFound;
+    [self foundFrom:0 ofSearch:search into:html];
+}
 
-        free( methods );
+// placeholder replaced by the next page of search results when clicked
+static void xfoundMoreLink( XprobeOutput *html, NSUInteger search, NSUInteger next, NSUInteger count ) {
+    if ( next >= count )
+        return;
+    xappendLiteral( html, "<span id=\\'MOREFOUND\\'> <a href=\\'#\\' onclick=\\'sendClient( \"found:\", \"" );
+    [html appendInt:search];
+    xappendLiteral( html, "," );
+    [html appendInt:next];
+    xappendLiteral( html, "\" ); event.cancelBubble = true; return false;\\'>more&#8230;</a> (" );
+    [html appendInt:count - next];
+    xappendLiteral( html, " remaining)</span>" );
+}
+
+// a page of the results of a search, nothing if a later search replaced them
++ (BOOL)foundFrom:(NSUInteger)start ofSearch:(NSUInteger)search into:(XprobeOutput *)html {
+    pthread_mutex_lock( &symbolIndexLock );
+    if ( search != foundSearch ) {
+        pthread_mutex_unlock( &symbolIndexLock );
+        return NO;
     }
 
-    for ( NSString *className in [[classesFound allKeys] sortedArrayUsingSelector:@selector(caseInsensitiveCompare:)] )
-        if ( [className characterAtIndex:1] != '_' && [html length] < 500000 ) {
-            XprobeClass *path = [XprobeClass new];
-            path.aClass = NSClassFromString(className);
-            [path xlinkForCommand:@"open" withPathID:[path xadd] into:html];
-            [html appendString:classesFound[className]];
-        }
+    NSUInteger count = foundClasses.size();
+    start = MIN( start, count );
+    NSUInteger end = snapshot || count - start <= maxSearchResultsPerPage ? count : start + maxSearchResultsPerPage;
+    char type = (char)foundType;
+
+    for ( NSUInteger i = start ; i < end ; i++ ) {
+        XprobeClass *path = [XprobeClass new];
+        path.aClass = symbolIndex->classes[foundClasses[i]];
+        [path xlinkForCommand:@"open" withPathID:[path xadd] into:html];
+        xappendLiteral( html, "<br/>" );
+
+        if ( type )
+            for ( uint32_t selectorID : foundMethods[foundClasses[i]] ) {
+                xappendLiteral( html, "&#160; &#160; " );
+                [html appendBytes:&type length:1];
+                [html appendString:symbolIndex->selectorNames.name( selectorID )];
+                xappendLiteral( html, "<br/>" );
+            }
+    }
+    pthread_mutex_unlock( &symbolIndexLock );
+
+    xfoundMoreLink( html, search, end, count );
+    return YES;
+}
+
+// input is "search,start" from the link above
++ (void)found:(NSString *)input {
+    NSArray<NSString *> *page = [input componentsSeparatedByString:@","];
+    XprobeOutput *html = [XprobeOutput new];
+    xappendLiteral( html, "$('MOREFOUND').outerHTML = '" );
+    if ( [page count] != 2 || ![self foundFrom:(NSUInteger)MAX( [page[1] integerValue], 0 )
+                                      ofSearch:(NSUInteger)[page[0] integerValue] into:html] )
+        xappendLiteral( html, " (results replaced by a later search)" );
+    xappendLiteral( html, "';" );
+    [self writeOutput:html];
 }
 
 /*************************************************************************
@@ -675,14 +817,14 @@ static NSString *lastPattern;
 
             NSArray *keys = [pattern componentsSeparatedByString:@"."];
             id obj = [xprobePaths[0] object];
+            int pathID = 0;
 
             for ( int i=1 ; i<[keys count] ; i++ ) {
-                obj = [obj xvalueForKey:keys[i]];
+                obj = [obj xvalueForKey:keys[i] pathID:pathID];
 
-                int pathID;
                 if ( !exists( instancesSeen, obj ) ) {
                     XprobeRetained *path = [XprobeRetained new];
-                    path.object = [[xprobePaths[0] object] xvalueForKeyPath:[pattern substringFromIndex:[@"seed." length]]];
+                    path.object = obj;
                     path.name = strdup( [[NSString stringWithFormat:@"%p", (void *)path.object] UTF8String] );
                     pathID = [path xadd];
                 }
@@ -699,8 +841,13 @@ static NSString *lastPattern;
     }
 
     NSLog( @"Xprobe: sweeping memory, filtering by '%@'", pattern );
-    dotGraph = [NSMutableString stringWithString:@"digraph sweep {\n"
-                "    node [href=\"javascript:void(click_node('\\N'))\" id=\"ID\\N\" fontname=\"Arial\"];\n"];
+    dotGraph = [XprobeOutput new];
+    graphNodeCount = graphEdgeCount = edgesOmitted = 0;
+    instancesOmitted.clear();
+    if ( graphStreaming )
+        xappendLiteral( dotGraph, "graph: " );
+    xappendLiteral( dotGraph, "digraph sweep {\n"
+                   "    node [href=\"javascript:void(click_node('\\N'))\" id=\"ID\\N\" fontname=\"Arial\"];\n" );
 
     if ( pattern != lastPattern ) {
         lastPattern = pattern;
@@ -712,14 +859,26 @@ static NSString *lastPattern;
         NSLog( @"Xprobe: no seeds returned from xprobeSeeds category" );
 
     [self performSweep:seeds];
-
-    [dotGraph appendString:@"}\n"];
-    [self writeString:dotGraph];
+    if ( graphOptions & XGraphByClass )
+        xgraphGroupedClasses();
+
+    if ( edgesOmitted )
+        [dotGraph appendFormat:@"    // truncated: %d objects and %u references omitted\n",
+         (int)instancesOmitted.size(), edgesOmitted];
+    xappendLiteral( dotGraph, "}\n" );
+    [self writeOutput:dotGraph];
     dotGraph = nil;
 
-    NSMutableString *html = [NSMutableString new];
-    [html appendString:@"$().innerHTML = '<b>Application Memory Sweep</b> "
-     "(<input type=checkbox onclick=\"kitswitch(this);\" checked> - Filter out \"kit\" instances)<p/>"];
+    if ( graphStreaming )
+        [self writeString:[NSString stringWithFormat:@"graphed: %u %u", graphNodeCount, graphEdgeCount]];
+    if ( edgesOmitted )
+        [self writeString:[NSString stringWithFormat:@"Xprobe: graph truncated to %u objects and %u references, "
+                           "%d objects and %u references omitted", graphNodeCount, graphEdgeCount,
+                           (int)instancesOmitted.size(), edgesOmitted]];
+
+    XprobeOutput *html = [XprobeOutput new];
+    xappendLiteral( html, "$().innerHTML = '<b>Application Memory Sweep</b> "
+     "(<input type=checkbox onclick=\"kitswitch(this);\" checked> - Filter out \"kit\" instances)<p/>" );
 
     // various types of earches
     unichar firstChar = [pattern length] ? [pattern characterAtIndex:0] : 0;
@@ -728,8 +887,8 @@ static NSString *lastPattern;
     else
         [self filterSweepOutputBy:pattern into:html];
 
-    [html appendString:@"';"];
-    [self writeString:html];
+    xappendLiteral( html, "';" );
+    [self writeOutput:html];
 
     if ( graphAnimating )
         [self animate:@"1"];
@@ -740,43 +899,145 @@ static NSString *lastPattern;
     [self search:lastPattern];
 }
 
+// console accepts the graph in "graph: " chunks ending with "graphed: ",
+// laying out what has arrived so far while the rest is being swept
++ (void)streamGraph:(NSString *)input {
+    graphStreaming = [input intValue];
+}
+
+// maximum number of objects and references graphed as "nodes,edges"
++ (void)graphBudget:(NSString *)input {
+    NSArray<NSString *> *limits = [input componentsSeparatedByString:@","];
+    maxGraphNodes = [limits[0] intValue] ?: maxGraphNodes;
+    if ( limits.count > 1 )
+        maxGraphEdges = [limits[1] intValue] ?: maxGraphEdges;
+}
+
 + (void)owners:(NSString *)input {
     int pathID = [input intValue];
     id obj = [xprobePaths[pathID] object];
 
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
     [html appendFormat:@"$('O%d').outerHTML = '<p/>", pathID];
 
     for ( auto owner : instancesSeen[obj].owners ) {
         int pathID = instancesSeen[owner.first].sequence;
         [owner.first xlinkForCommand:@"open" withPathID:pathID into:html];
-        [html appendString:@"&#160; "];
+        xappendLiteral( html, "&#160; " );
     }
 
-    [html appendString:@"<p/>';"];
-    [self writeString:html];
+    xappendLiteral( html, "<p/>';" );
+    [self writeOutput:html];
 }
 
 + (void)siblings:(NSString *)input {
     int pathID = [input intValue];
     Class aClass = [xprobePaths[pathID] aClass];
 
-    NSMutableString *html = [NSMutableString new];
+    XprobeOutput *html = [XprobeOutput new];
     [html appendFormat:@"$('S%d').outerHTML = '<p/>", pathID];
 
     for ( const auto &obj : instancesByClass[aClass] ) {
         XprobeRetained *path = [XprobeRetained new];
         path.object = obj;
         [obj xlinkForCommand:@"open" withPathID:[path xadd] into:html];
-        [html appendString:@" "];
+        xappendLiteral( html, " " );
     }
 
-    [html appendString:@"<p/>';"];
-    [self writeString:html];
+    xappendLiteral( html, "<p/>';" );
+    [self writeOutput:html];
 }
 
 static std::map<unsigned,NSTimeInterval> edgesCalled;
+static std::map<__unsafe_unretained id,BOOL> instancesMessaged;
 static os_unfair_lock edgeLock;
+static double animateTickSeconds;
+
+// messages to animated objects are queued by each thread without
+// locking and only resolved against the graph by +sendUpdates
+#define ANIMATE_EVENTS_PER_THREAD 1024
+#define ANIMATE_STACK_DEPTH 1000
+
+struct _xanimateEvent {
+    const void *obj, *caller;
+    uint64_t time;
+};
+
+struct _xanimateBuffer {
+    std::atomic<unsigned> head, tail;
+    std::atomic<bool> inUse;
+    struct _xanimateBuffer *next;
+    const void *callStack[ANIMATE_STACK_DEPTH];
+    struct _xanimateEvent events[ANIMATE_EVENTS_PER_THREAD];
+};
+
+// buffers are never unlinked so the drain can walk the list without
+// locking, a thread's buffer is released when it exits for reuse
+static std::atomic<struct _xanimateBuffer *> animateBuffers;
+static __thread struct _xanimateBuffer *threadAnimateBuffer;
+static pthread_key_t animateBufferKey;
+
+static void xanimateRelease( void *buffer ) {
+    ((struct _xanimateBuffer *)buffer)->inUse.store( false, std::memory_order_release );
+}
+
+static struct _xanimateBuffer *xanimateBuffer() {
+    if ( !threadAnimateBuffer ) {
+        static dispatch_once_t once;
+        dispatch_once( &once, ^{
+            pthread_key_create( &animateBufferKey, xanimateRelease );
+        } );
+
+        struct _xanimateBuffer *buffer = animateBuffers.load();
+        for ( ; buffer ; buffer = buffer->next ) {
+            bool released = false;
+            if ( buffer->inUse.compare_exchange_strong( released, true, std::memory_order_acquire ) )
+                break;
+        }
+
+        if ( !buffer ) {
+            buffer = new struct _xanimateBuffer();
+            buffer->inUse = true;
+            buffer->next = animateBuffers.load();
+            while ( !animateBuffers.compare_exchange_weak( buffer->next, buffer ) )
+                ;
+        }
+
+        pthread_setspecific( animateBufferKey, buffer );
+        threadAnimateBuffer = buffer;
+    }
+    return threadAnimateBuffer;
+}
+
+// called with edgeLock held, events arriving while a buffer is full are dropped
+static void xanimateDrain() {
+    for ( struct _xanimateBuffer *buffer = animateBuffers.load() ; buffer ; buffer = buffer->next ) {
+        unsigned tail = buffer->tail.load( std::memory_order_relaxed ),
+            head = buffer->head.load( std::memory_order_acquire );
+
+        for ( ; tail != head ; tail++ ) {
+            const struct _xanimateEvent &event = buffer->events[tail % ANIMATE_EVENTS_PER_THREAD];
+            __unsafe_unretained id obj = (__bridge __unsafe_unretained id)event.obj;
+            auto labeled = instancesLabeled.find( obj );
+            if ( labeled == instancesLabeled.end() )
+                continue;
+
+            NSTimeInterval when = event.time * animateTickSeconds;
+            labeled->second.lastMessageTime = when;
+            labeled->second.callCount++;
+            instancesMessaged[obj] = YES;
+
+            auto seen = instancesSeen.find( obj );
+            if ( event.caller && event.caller != event.obj && seen != instancesSeen.end() ) {
+                auto owner = seen->second.owners.find( (__bridge __unsafe_unretained id)event.caller );
+                if ( owner != seen->second.owners.end() )
+                    edgesCalled[owner->second] = when;
+            }
+        }
+
+        buffer->tail.store( tail, std::memory_order_release );
+    }
+}
 
 + (void)traceinstance:(NSString *)input {
     int pathID = [input intValue];
@@ -795,7 +1056,9 @@ static os_unfair_lock edgeLock;
     else {
         [xloadXprobeSwift("traceinstance:") ?: xTrace
          traceInstance:obj class:aClass]; ///
+        pthread_mutex_lock( &instancesTracedLock );
         instancesTraced[obj] = YES;
+        pthread_mutex_unlock( &instancesTracedLock );
         [self writeString:[NSString stringWithFormat:@"Tracing <%@ %p>", xNSStringFromClass(aClass), (void *)obj]];
     }
 }
@@ -815,48 +1078,55 @@ static os_unfair_lock edgeLock;
     [xloadXprobeSwift("tracebundle:") ?: xTrace traceBundle:theBundle];
 }
 
+// through XprobeSwift as the trace was installed
 + (void)untrace:(NSString *)input {
     int pathID = [input intValue];
-    id obj = [xprobePaths[pathID] object];
-    [objc_getClass("Xtrace") notrace:obj];
-    auto i = instancesTraced.find(obj);
-    if ( i != instancesTraced.end() )
-        instancesTraced.erase(i);
+    XprobePath *path = xprobePaths[pathID];
+    id obj = [path object];
+    Class xTrace = xloadXprobeSwift("untrace:") ?: objc_getClass("XprobeSwift");
+    if ( [path class] == [XprobeClass class] )
+        [xTrace untraceClass:[path aClass]];
+    else
+        [xTrace notrace:obj];
+    pthread_mutex_lock( &instancesTracedLock );
+    instancesTraced.erase( obj );
+    pthread_mutex_unlock( &instancesTracedLock );
 }
 
 + (void)xtrace:(NSString *)trace forInstance:(void *)optr indent:(int)indent {
     __unsafe_unretained id obj = (__bridge __unsafe_unretained id)optr;
 
-    if ( !graphAnimating || exists( instancesTraced, obj ) )
+    if ( !graphAnimating || xinstanceTraced( obj ) )
         [self writeString:trace];
 
     if ( graphAnimating && !dotGraph ) {
-        os_unfair_lock_lock(&edgeLock);
-
-        struct _animate &info = instancesLabeled[obj];
-        info.lastMessageTime = [NSDate timeIntervalSinceReferenceDate];
-        info.callCount++;
-
-        static __unsafe_unretained id callStack[1000];
-        if ( indent >= 0 && indent < sizeof callStack / sizeof callStack[0] ) {
-            callStack[indent] = obj;
-
-            __unsafe_unretained id caller = callStack[indent-1];
-            std::map<__unsafe_unretained id,unsigned> &owners = instancesSeen[obj].owners;
-            if ( indent > 0 && obj != caller && exists( owners, caller ) ) {
-                edgesCalled[owners[caller]] = info.lastMessageTime;
-            }
+        struct _xanimateBuffer *buffer = xanimateBuffer();
+        const void *caller = NULL;
+        if ( indent >= 0 && indent < ANIMATE_STACK_DEPTH ) {
+            buffer->callStack[indent] = optr;
+            if ( indent > 0 )
+                caller = buffer->callStack[indent-1];
         }
 
-        os_unfair_lock_unlock(&edgeLock);
+        unsigned head = buffer->head.load( std::memory_order_relaxed );
+        if ( head - buffer->tail.load( std::memory_order_acquire ) < ANIMATE_EVENTS_PER_THREAD ) {
+            struct _xanimateEvent &event = buffer->events[head % ANIMATE_EVENTS_PER_THREAD];
+            event.obj = optr;
+            event.caller = caller;
+            event.time = mach_absolute_time();
+            buffer->head.store( head + 1, std::memory_order_release );
+        }
     }
 }
 
 + (void)animate:(NSString *)input {
     BOOL wasAnimating = graphAnimating;
-    id xTrace = objc_getClass("XprobeSwift");
+    Class xTrace = xloadXprobeSwift("animate:") ?: objc_getClass("XprobeSwift");
     if ( (graphAnimating = [input intValue]) ) {
         edgeLock = OS_UNFAIR_LOCK_INIT;
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info( &timebase );
+        animateTickSeconds = (double)timebase.numer / timebase.denom / NSEC_PER_SEC;
         [xTrace setDelegate:(id)self];
 
         for ( const auto &graphing : instancesLabeled ) {
@@ -874,22 +1144,29 @@ static os_unfair_lock edgeLock;
 
         NSLog( @"Xprobe: traced %d objects", (int)instancesLabeled.size() );
     }
-    else
-        for ( const auto &graphing : instancesLabeled )
-            if ( exists( instancesTraced, graphing.first ) )
-                [xTrace notrace:graphing.first];
+    else if ( wasAnimating ) {
+        // removes the trampolines, tracing set up before animating included
+        [xTrace untraceAll];
+        pthread_mutex_lock( &instancesTracedLock );
+        instancesTraced.clear();
+        pthread_mutex_unlock( &instancesTracedLock );
+        NSLog( @"Xprobe: untraced all to stop animating" );
+    }
 }
 
+// only instances & edges messaged recently are revisited each time
 + (void)sendUpdates {
     while ( graphAnimating ) {
-        NSTimeInterval then = [NSDate timeIntervalSinceReferenceDate];
+        NSTimeInterval then = mach_absolute_time() * animateTickSeconds;
         [NSThread sleepForTimeInterval:MESSAGE_POLL_INTERVAL];
 
         if ( !dotGraph ) {
             NSMutableString *updates = [NSMutableString new];
             std::vector<unsigned> expired;
+            std::vector<__unsafe_unretained id> cooled;
 
             os_unfair_lock_lock(&edgeLock);
+            xanimateDrain();
 
             for ( auto &called : edgesCalled )
                 if ( called.second > then )
@@ -902,23 +1179,36 @@ static os_unfair_lock edgeLock;
             for ( auto &edge : expired )
                 edgesCalled.erase(edge);
 
-            os_unfair_lock_unlock(&edgeLock);
-
             if ( [updates length] ) {
                 [updates insertString:@" startEdge();" atIndex:0];
                 [updates appendString:@" stopEdge();"];
             }
 
-            for ( auto &graphed : instancesLabeled )
-                if ( graphed.second.lastMessageTime > then ) {
+            for ( auto &messaged : instancesMessaged ) {
+                auto labeled = instancesLabeled.find( messaged.first );
+                if ( labeled == instancesLabeled.end() ) {
+                    cooled.push_back( messaged.first );
+                    continue;
+                }
+
+                struct _animate &graphed = labeled->second;
+                if ( graphed.lastMessageTime > then ) {
                     [updates appendFormat:@" $('ID%u').style.color = '%@'; $('ID%u').title = 'Messaged %d times';",
-                     graphed.second.sequence, graphHighlightColor, graphed.second.sequence, graphed.second.callCount];
-                    graphed.second.highlighted = TRUE;
+                     graphed.sequence, graphHighlightColor, graphed.sequence, graphed.callCount];
+                    graphed.highlighted = TRUE;
                 }
-                else if ( graphed.second.highlighted && graphed.second.lastMessageTime < then - HIGHLIGHT_PERSIST_TIME ) {
-                    [updates appendFormat:@" $('ID%u').style.color = '%@';", graphed.second.sequence, graphOutlineColor];
-                    graphed.second.highlighted = FALSE;
+                else if ( graphed.lastMessageTime < then - HIGHLIGHT_PERSIST_TIME ) {
+                    if ( graphed.highlighted )
+                        [updates appendFormat:@" $('ID%u').style.color = '%@';", graphed.sequence, graphOutlineColor];
+                    graphed.highlighted = FALSE;
+                    cooled.push_back( messaged.first );
                 }
+            }
+
+            for ( auto &instance : cooled )
+                instancesMessaged.erase(instance);
+
+            os_unfair_lock_unlock(&edgeLock);
 
             if ( ![updates length] )
                 continue;
@@ -952,10 +1242,13 @@ static os_unfair_lock edgeLock;
 //    if ( ![self isKindOfClass:[NSObject class]] )
 //        return;
 //
-    BOOL didConnect = [from xgraphConnectionTo:self];
+    BOOL didConnect = [from xgraphConnectionTo:self], omitted = !didConnect && graphEdgeOmitted;
 
-    if ( sweptAlready )
+    if ( sweptAlready ) {
+        if ( omitted )
+            edgesOmitted++;
         return;
+    }
 
     XprobeRetained *path = xprobeRetainObjects ? [XprobeRetained new] : (XprobeRetained *)[XprobeWeak new];
     path.pathID = instancesSeen[sweepState.from].sequence;
@@ -1043,11 +1336,16 @@ static os_unfair_lock edgeLock;
     sweepState.from = from;
     sweepState.depth--;
 
-    if ( !didConnect && graphOptions & XGraphInterconnections )
-        [from xgraphConnectionTo:self];
+    // omitted references are counted once whether or not they are retried
+    if ( !didConnect && graphOptions & XGraphInterconnections ) {
+        didConnect = [from xgraphConnectionTo:self];
+        omitted = !didConnect && graphEdgeOmitted;
+    }
+    if ( omitted )
+        edgesOmitted++;
 }
 
-- (void)xopenPathID:(int)pathID into:(NSMutableString *)html
+- (void)xopenPathID:(int)pathID into:(XprobeOutput *)html
 {
     XprobePath *path = xprobePaths[pathID];
     Class aClass = [path aClass];
@@ -1064,27 +1362,27 @@ static os_unfair_lock edgeLock;
         superPath.aClass = [aClass superclass];
         superPath.name = superName;
 
-        [html appendString:@": "];
+        xappendLiteral( html, ": " );
         [self xlinkForCommand:@"open" withPathID:[superPath xadd] into:html];
     }
 
     unsigned c;
     Protocol *__unsafe_unretained *protos = class_copyProtocolList(aClass, &c);
     if ( c ) {
-        [html appendString:@" &lt;"];
+        xappendLiteral( html, " &lt;" );
 
         for ( unsigned i=0 ; i<c ; i++ ) {
             if ( i )
-                [html appendString:@", "];
+                xappendLiteral( html, ", " );
             NSString *protocolName = NSStringFromProtocol(protos[i]);
             [html appendString:snapshot ? protocolName : xlinkForProtocol( protocolName )];
         }
 
-        [html appendString:@"&gt;"];
+        xappendLiteral( html, "&gt;" );
         free( protos );
     }
 
-    [html appendString:@" {<br/>"];
+    xappendLiteral( html, " {<br/>" );
 
 
     static Class xprobeSwift;
@@ -1099,39 +1397,42 @@ static os_unfair_lock edgeLock;
                 __unused const char *name = ivar_getName( ivars[i] );
                 const char *type = ivar_getTypeEncodingSwift( ivars[i], aClass );
                 NSString *typeStr = xtype( type );
-                [html appendFormat:@" &#160; &#160;%@%@", typeStr, [typeStr containsString:@"*<"] ? @"" : @" "];
+                xappendLiteral( html, " &#160; &#160;" );
+                [html appendString:typeStr];
+                if ( ![typeStr containsString:@"*<"] )
+                    xappendLiteral( html, " " );
                 [self xspanForPathID:pathID ivar:ivars[i] type:type into:html];
-                [html appendString:@";<br/>"];
+                xappendLiteral( html, ";<br/>" );
             }
 
             free( ivars );
 //        });
     }
 
-    [html appendString:@"} "];
+    xappendLiteral( html, "} " );
     if ( snapshot )
         return;
 
     [self xlinkForCommand:@"properties" withPathID:pathID into:html];
-    [html appendString:@" "];
+    xappendLiteral( html, " " );
     [self xlinkForCommand:@"methods" withPathID:pathID into:html];
-    [html appendString:@" "];
+    xappendLiteral( html, " " );
     [self xlinkForCommand:@"owners" withPathID:pathID into:html];
-    [html appendString:@" "];
+    xappendLiteral( html, " " );
     [self xlinkForCommand:@"siblings" withPathID:pathID into:html];
-    [html appendString:@" "];
+    xappendLiteral( html, " " );
     [self xlinkForCommand:@"tracebundle" withPathID:pathID into:html];
-    [html appendString:@" "];
+    xappendLiteral( html, " " );
     [self xlinkForCommand:@"traceclass" withPathID:pathID into:html];
-    [html appendString:@" "];
+    xappendLiteral( html, " " );
     [self xlinkForCommand:@"traceinstance" withPathID:pathID into:html];
-    [html appendString:@" "];
+    xappendLiteral( html, " " );
     [self xlinkForCommand:@"untrace" withPathID:pathID into:html];
 
     if ( [self respondsToSelector:@selector(subviews)] ) {
-        [html appendString:@" "];
+        xappendLiteral( html, " " );
         [self xlinkForCommand:@"render" withPathID:pathID into:html];
-        [html appendString:@" "];
+        xappendLiteral( html, " " );
         [self xlinkForCommand:@"views" withPathID:pathID into:html];
     }
 
@@ -1151,53 +1452,184 @@ static os_unfair_lock edgeLock;
     }
 }
 
-- (void)xspanForPathID:(int)pathID ivar:(Ivar)ivar type:(const char *)type into:(NSMutableString *)html {
+- (void)xspanForPathID:(int)pathID ivar:(Ivar)ivar type:(const char *)type into:(XprobeOutput *)html {
     Class aClass = [xprobePaths[pathID] aClass];
     const char *currentIvarName = ivar_getName( ivar );
-    NSString *utf8Name = utf8String( currentIvarName );
 
-    [html appendFormat:@"<span onclick=\\'if ( event.srcElement.tagName != \"INPUT\" ) { this.id =\"I%d\"; "
-        "sendClient( \"ivar:\", \"%d,%@\" ); event.cancelBubble = true; }\\'>%@",
-     pathID, pathID, utf8Name, utf8Name];
+    xappendLiteral( html, "<span onclick=\\'if ( event.srcElement.tagName != \"INPUT\" ) { this.id =\"I" );
+    [html appendInt:pathID];
+    xappendLiteral( html, "\"; sendClient( \"ivar:\", \"" );
+    [html appendInt:pathID];
+    xappendLiteral( html, "," );
+    [html appendUTF8:currentIvarName];
+    xappendLiteral( html, "\" ); event.cancelBubble = true; }\\'>" );
+    [html appendUTF8:currentIvarName];
 
     if ( [xprobePaths[pathID] class] != [XprobeClass class] ) {
-        [html appendString:@" = "];
-
-        if ( !type || type[0] == '@' || isSwiftObject( type ) || isOOType( type ) || isCFType( type ) || isNewRefType( type ) )
-            xprotect( ^{
-                id subObject = xvalueForIvar( self, ivar, aClass );
-                if ( subObject ) {
-                    XprobeIvar *ivarPath = [XprobeIvar withPathID:pathID];
-                    ivarPath.iClass = aClass;
-                    ivarPath.name = currentIvarName;
-                    if ( [subObject respondsToSelector:@selector(xsweep)] )
-                        [subObject xlinkForCommand:@"open" withPathID:[ivarPath xadd:subObject] into:html];
-                    else
-                        [html appendFormat:@"&lt;%@ %p&gt;",
-                         xNSStringFromClass([subObject class]), (void *)subObject];
+        xappendLiteral( html, " = " );
+
+        if ( !type || type[0] == '@' || isSwiftObject( type ) || isOOType( type ) || isCFType( type ) || isNewRefType( type ) ) {
+            id subObject = xvalueForIvar( self, ivar, aClass );
+            if ( subObject ) {
+                XprobeIvar *ivarPath = [XprobeIvar withPathID:pathID];
+                ivarPath.iClass = aClass;
+                ivarPath.name = currentIvarName;
+                if ( [subObject respondsToSelector:@selector(xsweep)] )
+                    [subObject xlinkForCommand:@"open" withPathID:[ivarPath xadd:subObject] into:html];
+                else {
+                    xappendLiteral( html, "&lt;" );
+                    [html appendString:xNSStringFromClass([subObject class])];
+                    xappendLiteral( html, " " );
+                    [html appendPointer:(__bridge void *)subObject];
+                    xappendLiteral( html, "&gt;" );
                 }
-                else
-                    [html appendString:@"nil"];
-            } );
-        else
-            [html appendFormat:@"<span onclick=\\'this.id =\"E%d\"; sendClient( \"edit:\", \"%d,%@\" ); "
-                "event.cancelBubble = true;\\'>%@</span>", pathID, pathID, utf8Name,
-                [xvalueForIvar( self, ivar, aClass) xhtmlEscape]];
+            }
+            else
+                xappendLiteral( html, "nil" );
+        }
+        else {
+            [html appendSpanForID:"E" command:"edit:" pathID:pathID name:currentIvarName];
+            if ( !xrenderIvar( html, self, ivar, aClass, NO ) )
+                [xvalueForIvar( self, ivar, aClass) xhtmlEscapeInto:html];
+            xappendLiteral( html, "</span>" );
+        }
+    }
+
+    xappendLiteral( html, "</span>" );
+}
+
+#pragma mark structured responses rendered by the console
+
+// only objects using the generic ObjC rendering above
+static BOOL xrendersStructured( NSObject *self, Class aClass ) {
+    static IMP generic = [NSObject instanceMethodForSelector:@selector(xopenPathID:into:)];
+    return !isSwift( aClass ) && [self methodForSelector:@selector(xopenPathID:into:)] == generic;
+}
+
+- (BOOL)xjsonForPathID:(int)pathID into:(XprobeOutput *)json {
+    XprobePath *path = xprobePaths[pathID];
+    Class aClass = [path aClass];
+    if ( !xrendersStructured( self, aClass ) )
+        return NO;
+
+    xappendLiteral( json, "{\"op\":\"open\",\"pathID\":" );
+    [json appendInt:pathID];
+    xappendLiteral( json, ",\"className\":" );
+    [json appendJSONMarkup:xNSStringFromClass(aClass)];
+    if ( [self class] == aClass ) {
+        xappendLiteral( json, ",\"address\":\"" );
+        [json appendPointer:(__bridge void *)self];
+        xappendLiteral( json, "\"" );
+    }
+    if ( path.name ) {
+        xappendLiteral( json, ",\"title\":" );
+        [json appendJSON:path.name length:strlen( path.name ) unescapingQuotes:NO];
+    }
+
+    if ( [aClass superclass] ) {
+        XprobeSuper *superPath = [path class] == [XprobeClass class] ? [XprobeClass new] :
+            [XprobeSuper withPathID:[path class] == [XprobeSuper class] ? path.pathID : pathID];
+        superPath.aClass = [aClass superclass];
+        superPath.name = superName;
+
+        xappendLiteral( json, ",\"superPathID\":" );
+        [json appendInt:[superPath xadd]];
+        xappendLiteral( json, ",\"superName\":" );
+        [json appendJSONMarkup:xNSStringFromClass([aClass superclass])];
+    }
+
+    unsigned c;
+    Protocol *__unsafe_unretained *protos = class_copyProtocolList(aClass, &c);
+    xappendLiteral( json, ",\"protocols\":[" );
+    for ( unsigned i=0 ; i<c ; i++ ) {
+        if ( i )
+            xappendLiteral( json, "," );
+        [json appendJSONString:NSStringFromProtocol(protos[i])];
+    }
+    xappendLiteral( json, "]" );
+    free( protos );
+
+    Ivar *ivars = class_copyIvarList(aClass, &c);
+    xappendLiteral( json, ",\"ivars\":[" );
+    for ( unsigned i=0 ; i<c ; i++ ) {
+        if ( i )
+            xappendLiteral( json, "," );
+        [self xjsonForPathID:pathID ivar:ivars[i] type:ivar_getTypeEncodingSwift( ivars[i], aClass ) into:json];
+    }
+    xappendLiteral( json, "]" );
+    free( ivars );
+
+    if ( [self respondsToSelector:@selector(subviews)] )
+        xappendLiteral( json, ",\"views\":true" );
+
+    Class injectionLoader = NSClassFromString(@"BundleInjection");
+    if ( [injectionLoader respondsToSelector:@selector(connectedAddress)] ) {
+        Class myClass = [self class];
+        xappendLiteral( json, ",\"injection\":" );
+        [json appendInt:[injectionLoader connectedAddress] != NULL];
+        xappendLiteral( json, ",\"instanceClass\":" );
+        [json appendJSONMarkup:xNSStringFromClass(myClass)];
+        xappendLiteral( json, ",\"isSwift\":" );
+        [json appendInt:isSwift( myClass ) ? 1 : 0];
     }
 
-    [html appendString:@"</span>"];
+    xappendLiteral( json, "}" );
+    return YES;
+}
+
+- (void)xjsonForPathID:(int)pathID ivar:(Ivar)ivar type:(const char *)type into:(XprobeOutput *)json {
+    Class aClass = [xprobePaths[pathID] aClass];
+    const char *currentIvarName = ivar_getName( ivar );
+
+    xappendLiteral( json, "{\"name\":" );
+    [json appendJSON:currentIvarName length:strlen( currentIvarName ) unescapingQuotes:NO];
+    xappendLiteral( json, ",\"type\":" );
+    [json appendJSONMarkup:xtype( type )];
+
+    if ( [xprobePaths[pathID] class] != [XprobeClass class] ) {
+        if ( !type || type[0] == '@' || isSwiftObject( type ) || isOOType( type ) || isCFType( type ) || isNewRefType( type ) ) {
+            // links can be any object's rendering so are still sent as markup
+            XprobeOutput *link = [XprobeOutput new];
+            id subObject = xvalueForIvar( self, ivar, aClass );
+            if ( subObject ) {
+                XprobeIvar *ivarPath = [XprobeIvar withPathID:pathID];
+                ivarPath.iClass = aClass;
+                ivarPath.name = currentIvarName;
+                if ( [subObject respondsToSelector:@selector(xsweep)] )
+                    [subObject xlinkForCommand:@"open" withPathID:[ivarPath xadd:subObject] into:link];
+                else {
+                    xappendLiteral( link, "&lt;" );
+                    [link appendString:xNSStringFromClass([subObject class])];
+                    xappendLiteral( link, " " );
+                    [link appendPointer:(__bridge void *)subObject];
+                    xappendLiteral( link, "&gt;" );
+                }
+            }
+            else
+                xappendLiteral( link, "nil" );
+            xappendLiteral( json, ",\"link\":" );
+            [json appendJSON:link.bytes length:link.length unescapingQuotes:YES];
+        }
+        else {
+            xappendLiteral( json, ",\"value\":" );
+            if ( !xrenderIvar( json, self, ivar, aClass, YES ) )
+                [json appendJSONString:[xvalueForIvar( self, ivar, aClass ) description]];
+        }
+    }
+
+    xappendLiteral( json, "}" );
 }
 
 static NSString *xclassName( NSObject *self ) {
     return xNSStringFromClass( [self class] );
 }
 
-+ (void)xlinkForCommand:(NSString *)which withPathID:(int)pathID into:(NSMutableString *)html {
++ (void)xlinkForCommand:(NSString *)which withPathID:(int)pathID into:(XprobeOutput *)html {
     [html appendFormat:@"[%@ class]", xNSStringFromClass(self)];
 }
 
 
-- (void)xlinkForCommand:(NSString *)which withPathID:(int)pathID into:(NSMutableString *)html {
+- (void)xlinkForCommand:(NSString *)which withPathID:(int)pathID into:(XprobeOutput *)html {
     if ( self == trapped || self == notype || self == invocationException ) {
         [html appendString:(NSString *)self];
         return;
@@ -1209,7 +1641,7 @@ static NSString *xclassName( NSObject *self ) {
     BOOL basic = [which isEqualToString:@"open"] || [which isEqualToString:@"close"];
     NSString *linkLabel = !basic ? which : [self class] != linkClass ? linkClassName :
         [NSString stringWithFormat:@"&lt;%@&#160;%p&gt;", xclassName( self ), (void *)self];
-    unichar firstChar = toupper( [which characterAtIndex:0] );
+    char firstChar = (char)toupper( [which characterAtIndex:0] );
 
     BOOL notBeenSeen = !exists( instanceIDs[linkClass], self );
     if ( notBeenSeen )
@@ -1222,26 +1654,44 @@ static NSString *xclassName( NSObject *self ) {
 
     if ( excluded ) //|| [linkClassName hasPrefix:@"_TtG"] )
         [html appendString:linkLabel];
-    else
-        [html appendFormat:@"<span id=\\'%@%d\\' onclick=\\'event.cancelBubble = true;\\'>"
-            "<a href=\\'#\\' onclick=\\'sendClient( \"%@:\", \"%d\", %d, %d ); "
-            "this.className = \"linkClicked\"; event.cancelBubble = true; return false;\\'%@>%@</a>%@",
-            basic ? @"" : [NSString stringWithCharacters:&firstChar length:1],
-            pathID, which, pathID, ID, !willExpand, path.name ?
-            [NSString stringWithFormat:@" title=\\'%@\\'", utf8String( path.name )] : @"",
-            linkLabel, [which isEqualToString:@"close"] || willExpand ? @"" : @"</span>"];
+    else {
+        xappendLiteral( html, "<span id=\\'" );
+        if ( !basic )
+            [html appendBytes:&firstChar length:1];
+        [html appendInt:pathID];
+        xappendLiteral( html, "\\' onclick=\\'event.cancelBubble = true;\\'>"
+                       "<a href=\\'#\\' onclick=\\'sendClient( \"" );
+        [html appendString:which];
+        xappendLiteral( html, ":\", \"" );
+        [html appendInt:pathID];
+        xappendLiteral( html, "\", " );
+        [html appendInt:ID];
+        xappendLiteral( html, ", " );
+        [html appendInt:!willExpand];
+        xappendLiteral( html, " ); this.className = \"linkClicked\"; event.cancelBubble = true; return false;\\'" );
+        if ( path.name ) {
+            xappendLiteral( html, " title=\\'" );
+            [html appendUTF8:path.name];
+            xappendLiteral( html, "\\'" );
+        }
+        xappendLiteral( html, ">" );
+        [html appendString:linkLabel];
+        xappendLiteral( html, "</a>" );
+        if ( !([which isEqualToString:@"close"] || willExpand) )
+            xappendLiteral( html, "</span>" );
+    }
 
     if ( willExpand ) {
         [html appendFormat:@"</span></span><span><span><span id='ID%d' class='snapshotStyle'>", ID];
         [Xprobe xopen:self withPathID:pathID into:html];
-        [html appendString:@"</span>"];
+        xappendLiteral( html, "</span>" );
     }
 }
 
-+ (void)xopen:(NSObject *)obj withPathID:(int)pathID into:(NSMutableString *)html {
-    [html appendString:@"<table><tr><td class=\\'indent\\'/><td class=\\'drilldown\\'>"];
++ (void)xopen:(NSObject *)obj withPathID:(int)pathID into:(XprobeOutput *)html {
+    xappendLiteral( html, "<table><tr><td class=\\'indent\\'/><td class=\\'drilldown\\'>" );
     [obj xopenPathID:pathID into:html];
-    [html appendString:@"</td></tr></table></span>"];
+    xappendLiteral( html, "</td></tr></table></span>" );
 }
 
 #pragma dot object graph generation code
@@ -1267,40 +1717,125 @@ static NSString *outlineColorFor( NSObject *self, NSString *className ) {
     return graphOutlineColor;
 }
 
-static void xgraphLabelNode( NSObject *self ) {
+// chunks are only sent at the end of a line so they're valid UTF-8
+static void xgraphStream() {
+    if ( graphStreaming && dotGraph.length > GRAPH_CHUNK_SIZE ) {
+        [Xprobe writeOutput:dotGraph];
+        xappendLiteral( dotGraph, "graph: " );
+    }
+}
+
+// escaped for use inside a quoted dot string
+static NSString *xdotEscape( NSString *label ) {
+    return [[label stringByReplacingOccurrencesOfString:@"\\" withString:@"\\\\"]
+            stringByReplacingOccurrencesOfString:@"\"" withString:@"\\\""];
+}
+
+// already labelled or there is room for it after "pending" other new nodes,
+// "kit" objects can only take up three quarters of the budget
+static BOOL xgraphNodeFits( NSObject *self, unsigned pending ) {
+    if ( exists( instancesLabeled, self ) )
+        return YES;
+    if ( graphNodeCount + pending < (xgraphInclude( self ) ? maxGraphNodes : maxGraphNodes / 4 * 3) )
+        return YES;
+    instancesOmitted[self] = YES;
+    return NO;
+}
+
+static BOOL xgraphLabelNode( NSObject *self ) {
     if ( !exists( instancesLabeled, self ) ) {
+        if ( !xgraphNodeFits( self, 0 ) )
+            return NO;
+        graphNodeCount++;
+
         NSString *className = xNSStringFromClass([self class]);
         os_unfair_lock_lock(&edgeLock);
         instancesLabeled[self].sequence = instancesSeen[self].sequence;
         os_unfair_lock_unlock(&edgeLock);
         NSString *color = instancesLabeled[self].color = outlineColorFor( self, className );
         [dotGraph appendFormat:@"    %d [label=\"%@\" tooltip=\"<%@ %p> #%d\"%s%s color=\"%@\"];\n",
-             instancesSeen[self].sequence, [xclassName( self )
-                        stringByReplacingOccurrencesOfString:@"\"" withString:@"&quot;"],
-             [className stringByReplacingOccurrencesOfString:@"\"" withString:@"&quot;"],
+             instancesSeen[self].sequence, xdotEscape( xclassName( self ) ), xdotEscape( className ),
              (void *)self, instancesSeen[self].sequence,
              [self respondsToSelector:@selector(subviews)] ? " shape=box" : "",
              xgraphInclude( self ) ? " style=\"filled\" fillcolor=\"#e0e0e0\"" : "", color];
+        xgraphStream();
+    }
+    return YES;
+}
+
+static void xgraphGroupNode( NSObject *self ) {
+    if ( !exists( instancesGrouped, self ) ) {
+        instancesGrouped[self] = YES;
+        struct _xclassNode &node = classesGraphed[[self class]];
+        if ( !node.instances++ ) {
+            node.sequence = instancesSeen[self].sequence;
+            node.isView = [self respondsToSelector:@selector(subviews)];
+            node.included = xgraphInclude( self );
+        }
+    }
+}
+
+// include/exclude options common to graphs of instances and of classes
+static BOOL xgraphSelected( NSObject *self, id ivar, BOOL interconnected ) {
+    return (graphOptions & XGraphAllObjects ||
+            (graphOptions & XGraphIncludedOnly ?
+             xgraphInclude( self ) && xgraphInclude( ivar ) :
+             xgraphInclude( self ) || xgraphInclude( ivar )) ||
+            (graphOptions & XGraphInterconnections && interconnected)) &&
+        (graphOptions & XGraphWithoutExcepton || (!xgraphExclude( self ) && !xgraphExclude( ivar )));
+}
+
+// one node per class labelled with its instance count and one edge
+// per (class, ivar, class) labelled with the number of references
+static void xgraphGroupedClasses() {
+    graphNodeCount = (unsigned)classesGraphed.size();
+    graphEdgeCount = (unsigned)classEdges.size();
+
+    for ( const auto &graphed : classesGraphed ) {
+        NSString *className = xdotEscape( xNSStringFromClass( graphed.first ) );
+        [dotGraph appendFormat:@"    %d [label=\"%@ \u00d7%u\" tooltip=\"%u instances of %@\"%s%s color=\"%@\"];\n",
+             graphed.second.sequence, className, graphed.second.instances, graphed.second.instances, className,
+             graphed.second.isView ? " shape=box" : "",
+             graphed.second.included ? " style=\"filled\" fillcolor=\"#e0e0e0\"" : "", graphOutlineColor];
+        xgraphStream();
+    }
+
+    for ( const auto &edge : classEdges ) {
+        [dotGraph appendFormat:@"    %d -> %d [label=\"%@", classesGraphed[std::get<0>( edge.first )].sequence,
+             classesGraphed[std::get<2>( edge.first )].sequence, xdotEscape( utf8String( std::get<1>( edge.first ).c_str() ) )];
+        if ( edge.second > 1 )
+            [dotGraph appendFormat:@" \u00d7%u", edge.second];
+        [dotGraph appendFormat:@"\" color=\"%@\" eid=\"%d\"];\n", graphOutlineColor, graphEdgeID++];
+        xgraphStream();
     }
 }
 
 - (BOOL)xgraphConnectionTo:(id)ivar {
     int edgeID = instancesSeen[ivar].owners[self] = graphEdgeID++;
-    if ( dotGraph && (__bridge CFNullRef)ivar != kCFNull &&
+    graphEdgeOmitted = NO;
+    if ( dotGraph && (__bridge CFNullRef)ivar != kCFNull && graphOptions & XGraphByClass &&
+            xgraphSelected( self, ivar, exists( instancesGrouped, self ) && exists( instancesGrouped, ivar ) ) ) {
+        xgraphGroupNode( self );
+        xgraphGroupNode( ivar );
+        classEdges[std::make_tuple( (Class)[self class], std::string( sweepState.source ?: "" ), (Class)[ivar class] )]++;
+        return YES;
+    }
+    else if ( dotGraph && (__bridge CFNullRef)ivar != kCFNull && !(graphOptions & XGraphByClass) &&
             (graphOptions & XGraphArrayWithoutLmit || currentMaxArrayIndex < maxArrayItemsForGraphing) &&
-            (graphOptions & XGraphAllObjects ||
-                (graphOptions & XGraphIncludedOnly ?
-                 xgraphInclude( self ) && xgraphInclude( ivar ) :
-                 xgraphInclude( self ) || xgraphInclude( ivar )) ||
-                (graphOptions & XGraphInterconnections &&
-                 exists( instancesLabeled, self ) &&
-                 exists( instancesLabeled, ivar ))) &&
-            (graphOptions & XGraphWithoutExcepton || (!xgraphExclude( self ) && !xgraphExclude( ivar ))) ) {
+            xgraphSelected( self, ivar, exists( instancesLabeled, self ) && exists( instancesLabeled, ivar ) ) ) {
+        // both ends must fit before either is labelled or the edge leaves an orphan node
+        unsigned selfIsNew = !exists( instancesLabeled, self ) && ivar != self;
+        if ( graphEdgeCount >= maxGraphEdges || !xgraphNodeFits( self, 0 ) || !xgraphNodeFits( ivar, selfIsNew ) ) {
+            graphEdgeOmitted = YES;
+            return NO;
+        }
         xgraphLabelNode( self );
         xgraphLabelNode( ivar );
+        graphEdgeCount++;
         [dotGraph appendFormat:@"    %d -> %d [label=\"%@\" color=\"%@\" eid=\"%d\"];\n",
-            instancesSeen[self].sequence, instancesSeen[ivar].sequence, utf8String( sweepState.source ),
+            instancesSeen[self].sequence, instancesSeen[ivar].sequence, xdotEscape( utf8String( sweepState.source ) ),
             instancesLabeled[self].color, edgeID];
+        xgraphStream();
         return YES;
     }
     else
@@ -1318,6 +1853,10 @@ static void xgraphLabelNode( NSObject *self ) {
         return [self valueForKey:key];
 }
 
+- (id)xvalueForKey:(NSString *)key pathID:(int)pathID {
+    return [self xvalueForKey:key];
+}
+
 - (id)xvalueForKeyPath:(NSString *)key {
     NSUInteger dotLocation = [key rangeOfString:@"."].location;
     if ( dotLocation == NSNotFound )
@@ -1327,15 +1866,19 @@ static void xgraphLabelNode( NSObject *self ) {
                 xvalueForKeyPath:[key substringFromIndex:dotLocation+1]];
 }
 
+- (void)xopenPathID:(int)pathID from:(NSUInteger)start into:(XprobeOutput *)html {
+    if ( start == 0 )
+        [self xopenPathID:pathID into:html];
+}
+
 - (NSString *)xhtmlEscape {
-    return [[[[[[[[self description]
-                  stringByReplacingOccurrencesOfString:@"&" withString:@"&amp;"]
-                 stringByReplacingOccurrencesOfString:@"<" withString:@"&lt;"]
-                stringByReplacingOccurrencesOfString:@"\n" withString:@"<br/>"]
-               stringByReplacingOccurrencesOfString:@"\\" withString:@"\\\\"]
-              stringByReplacingOccurrencesOfString:@"'" withString:@"\\'"]
-             stringByReplacingOccurrencesOfString:@"  " withString:@" &#160;"]
-            stringByReplacingOccurrencesOfString:@"\t" withString:@" &#160; &#160;"];
+    XprobeOutput *escaped = [XprobeOutput new];
+    [self xhtmlEscapeInto:escaped];
+    return [escaped description];
+}
+
+- (void)xhtmlEscapeInto:(XprobeOutput *)html {
+    [html appendEscapedString:[self description]];
 }
 
 @end
@@ -1343,6 +1886,107 @@ static void xgraphLabelNode( NSObject *self ) {
 /*************************************************************************
  *************************************************************************/
 
+#pragma mark paged rendering of collections
+
+static NSPointerArray *xcollectionOrder( int pathID, NSArray *(^elements)() ) {
+    auto order = collectionOrder.find( pathID );
+    if ( order != collectionOrder.end() )
+        return order->second;
+
+    NSPointerArray *ordered = [NSPointerArray pointerArrayWithOptions:NSPointerFunctionsObjectPointerPersonality |
+                               (xprobeRetainObjects ? NSPointerFunctionsStrongMemory : NSPointerFunctionsOpaqueMemory)];
+    for ( id element in elements() )
+        [ordered addPointer:(__bridge void *)element];
+    return collectionOrder[pathID] = ordered;
+}
+
+// order a set was presented in by the path it was opened from for key paths into it
+static id xcollectionElement( id collection, NSString *key, int pathID ) {
+    auto order = collectionOrder.find( pathID );
+    if ( order == collectionOrder.end() )
+        return [[collection allObjects] objectAtIndex:[key intValue]];
+    NSUInteger index = [key intValue];
+    return index < order->second.count ? (__bridge id)[order->second pointerAtIndex:index] : nil;
+}
+
+static id xelementAt( NSArray *elements, NSUInteger i ) {
+    return elements[i];
+}
+
+static id xelementAt( NSPointerArray *elements, NSUInteger i ) {
+    return (__bridge id)[elements pointerAtIndex:i];
+}
+
+static NSArray *xsortedKeys( NSArray *keys ) {
+    return keys.count <= maxCollectionKeysSorted &&
+        [keys.firstObject respondsToSelector:@selector(compare:)] ?
+        [keys sortedArrayUsingSelector:@selector(compare:)] : keys;
+}
+
+// a page past the end of a collection that has shrunk since is empty
+static NSUInteger xpageEnd( NSUInteger start, NSUInteger count ) {
+    return snapshot || start >= count || count - start <= maxCollectionItemsPerPage ?
+        count : start + maxCollectionItemsPerPage;
+}
+
+// placeholder replaced by the next page when clicked
+static void xmoreLink( XprobeOutput *html, int pathID, NSUInteger next, NSUInteger count ) {
+    if ( next >= count )
+        return;
+    xappendLiteral( html, "<span id=\\'MORE" );
+    [html appendInt:pathID];
+    xappendLiteral( html, "\\'> <a href=\\'#\\' onclick=\\'sendClient( \"more:\", \"" );
+    [html appendInt:pathID];
+    xappendLiteral( html, "," );
+    [html appendInt:next];
+    xappendLiteral( html, "\" ); event.cancelBubble = true; return false;\\'>more&#8230;</a> (" );
+    [html appendInt:count - next];
+    xappendLiteral( html, " remaining)</span>" );
+}
+
+template <typename Elements>
+static void xopenElements( Elements elements, Class pathClass, int pathID,
+                           NSUInteger start, XprobeOutput *html ) {
+    NSUInteger count = elements.count, end = xpageEnd( start, count );
+    if ( start >= count )
+        return;
+
+    for ( NSUInteger i=start ; i < end ; i++ ) {
+        if ( i )
+            xappendLiteral( html, ", " );
+
+        XprobeArray *path = [pathClass withPathID:pathID];
+        path.sub = i;
+        id obj = xelementAt( elements, i );
+        [obj xlinkForCommand:@"open" withPathID:[path xadd:obj] into:html];
+    }
+
+    xmoreLink( html, pathID, end, count );
+}
+
+static void xopenEntries( NSPointerArray *keys, id collection, int pathID,
+                          NSUInteger start, XprobeOutput *html ) {
+    NSUInteger count = keys.count, end = xpageEnd( start, count );
+    if ( start >= count )
+        return;
+
+    for ( NSUInteger i=start ; i < end ; i++ ) {
+        id key = xelementAt( keys, i );
+        xappendLiteral( html, " &#160; &#160;" );
+        [key xhtmlEscapeInto:html];
+        xappendLiteral( html, " : " );
+
+        XprobeDict *path = [XprobeDict withPathID:pathID];
+        path.sub = key;
+
+        id obj = [collection objectForKey:key];
+        [obj xlinkForCommand:@"open" withPathID:[path xadd:obj] into:html];
+        xappendLiteral( html, ",<br/>" );
+    }
+
+    xmoreLink( html, pathID, end, count );
+}
+
 #pragma mark sweep of foundation classes
 
 @implementation NSArray(Xprobe)
@@ -1362,20 +2006,14 @@ static void xgraphLabelNode( NSObject *self ) {
     sweepState.depth--;
 }
 
-- (void)xopenPathID:(int)pathID into:(NSMutableString *)html {
-    [html appendString:@"@["];
-
-    for ( int i=0 ; i < self.count ; i++ ) {
-        if ( i )
-            [html appendString:@", "];
-
-        XprobeArray *path = [XprobeArray withPathID:pathID];
-        path.sub = i;
-        id obj = self[i];
-        [obj xlinkForCommand:@"open" withPathID:[path xadd:obj] into:html];
-    }
+- (void)xopenPathID:(int)pathID into:(XprobeOutput *)html {
+    xappendLiteral( html, "@[" );
+    [self xopenPathID:pathID from:0 into:html];
+    xappendLiteral( html, "]" );
+}
 
-    [html appendString:@"]"];
+- (void)xopenPathID:(int)pathID from:(NSUInteger)start into:(XprobeOutput *)html {
+    xopenElements( self, [XprobeArray class], pathID, start, html );
 }
 
 - (id)xvalueForKey:(NSString *)key {
@@ -1390,26 +2028,27 @@ static void xgraphLabelNode( NSObject *self ) {
     [[self allObjects] xsweep];
 }
 
-- (void)xopenPathID:(int)pathID into:(NSMutableString *)html {
-    [html appendString:@"@["];
-
-    for ( int i=0 ; i < self.count ; i++ ) {
-        if ( i )
-            [html appendString:@", "];
-
-        XprobeSet *path = [XprobeSet withPathID:pathID];
-        path.sub = i;
-        id obj = [self allObjects][i];
-        [obj xlinkForCommand:@"open" withPathID:[path xadd:obj] into:html];
-    }
+- (void)xopenPathID:(int)pathID into:(XprobeOutput *)html {
+    xappendLiteral( html, "@[" );
+    [self xopenPathID:pathID from:0 into:html];
+    xappendLiteral( html, "]" );
+}
 
-    [html appendString:@"]"];
+- (void)xopenPathID:(int)pathID from:(NSUInteger)start into:(XprobeOutput *)html {
+    NSPointerArray *all = xcollectionOrder( pathID, ^{
+        return [self allObjects];
+    } );
+    xopenElements( all, [XprobeSet class], pathID, start, html );
 }
 
 - (id)xvalueForKey:(NSString *)key {
     return [[self allObjects] objectAtIndex:[key intValue]];
 }
 
+- (id)xvalueForKey:(NSString *)key pathID:(int)pathID {
+    return xcollectionElement( self, key, pathID );
+}
+
 @end
 
 @implementation NSDictionary(Xprobe)
@@ -1418,24 +2057,17 @@ static void xgraphLabelNode( NSObject *self ) {
     [[self allValues] xsweep];
 }
 
-- (void)xopenPathID:(int)pathID into:(NSMutableString *)html
-{
-    [html appendString:@"@{<br/>"];
-
-    NSArray *keys = [self allKeys];
-    for ( id key in [keys.firstObject respondsToSelector:@selector(compare:)] ?
-            [keys sortedArrayUsingSelector:@selector(compare:)] : keys) {
-        [html appendFormat:@" &#160; &#160;%@ : ", [key xhtmlEscape]];
-
-        XprobeDict *path = [XprobeDict withPathID:pathID];
-        path.sub = key;
-
-        id obj = self[key];
-        [obj xlinkForCommand:@"open" withPathID:[path xadd:obj] into:html];
-        [html appendString:@",<br/>"];
-    }
+- (void)xopenPathID:(int)pathID into:(XprobeOutput *)html {
+    xappendLiteral( html, "@{<br/>" );
+    [self xopenPathID:pathID from:0 into:html];
+    xappendLiteral( html, "}" );
+}
 
-    [html appendString:@"}"];
+- (void)xopenPathID:(int)pathID from:(NSUInteger)start into:(XprobeOutput *)html {
+    NSPointerArray *keys = xcollectionOrder( pathID, ^{
+        return xsortedKeys( [self allKeys] );
+    } );
+    xopenEntries( keys, self, pathID, start, html );
 }
 
 @end
@@ -1446,21 +2078,17 @@ static void xgraphLabelNode( NSObject *self ) {
     [[[self objectEnumerator] allObjects] xsweep];
 }
 
-- (void)xopenPathID:(int)pathID into:(NSMutableString *)html {
-    [html appendString:@"@{<br/>"];
-
-    for ( id key in [[[self keyEnumerator] allObjects] sortedArrayUsingSelector:@selector(compare:)] ) {
-        [html appendFormat:@" &#160; &#160;%@ : ", [key xhtmlEscape]];
-
-        XprobeDict *path = [XprobeDict withPathID:pathID];
-        path.sub = key;
-
-        id obj = [self objectForKey:key];
-        [obj xlinkForCommand:@"open" withPathID:[path xadd:obj] into:html];
-        [html appendString:@",<br/>"];
-    }
+- (void)xopenPathID:(int)pathID into:(XprobeOutput *)html {
+    xappendLiteral( html, "@{<br/>" );
+    [self xopenPathID:pathID from:0 into:html];
+    xappendLiteral( html, "}" );
+}
 
-    [html appendString:@"}"];
+- (void)xopenPathID:(int)pathID from:(NSUInteger)start into:(XprobeOutput *)html {
+    NSPointerArray *keys = xcollectionOrder( pathID, ^{
+        return xsortedKeys( [[self keyEnumerator] allObjects] );
+    } );
+    xopenEntries( keys, self, pathID, start, html );
 }
 
 @end
@@ -1471,26 +2099,27 @@ static void xgraphLabelNode( NSObject *self ) {
     [[self allObjects] xsweep];
 }
 
-- (void)xopenPathID:(int)pathID into:(NSMutableString *)html {
-    NSArray *all = [self allObjects];
-
-    [html appendString:@"@["];
-    for ( int i=0 ; i<[all count] ; i++ ) {
-        if ( i )
-            [html appendString:@", "];
+- (void)xopenPathID:(int)pathID into:(XprobeOutput *)html {
+    xappendLiteral( html, "@[" );
+    [self xopenPathID:pathID from:0 into:html];
+    xappendLiteral( html, "]" );
+}
 
-        XprobeSet *path = [XprobeSet withPathID:pathID];
-        path.sub = i;
-        id obj = all[i];
-        [obj xlinkForCommand:@"open" withPathID:[path xadd:obj] into:html];
-    }
-    [html appendString:@"]"];
+- (void)xopenPathID:(int)pathID from:(NSUInteger)start into:(XprobeOutput *)html {
+    NSPointerArray *all = xcollectionOrder( pathID, ^{
+        return [self allObjects];
+    } );
+    xopenElements( all, [XprobeSet class], pathID, start, html );
 }
 
 - (id)xvalueForKey:(NSString *)key {
     return [[self allObjects] objectAtIndex:[key intValue]];
 }
 
+- (id)xvalueForKey:(NSString *)key pathID:(int)pathID {
+    return xcollectionElement( self, key, pathID );
+}
+
 @end
 
 @implementation NSString(Xprobe)
@@ -1498,15 +2127,17 @@ static void xgraphLabelNode( NSObject *self ) {
 - (void)xsweep {
 }
 
-- (void)xlinkForCommand:(NSString *)which withPathID:(int)pathID into:(NSMutableString *)html {
+- (void)xlinkForCommand:(NSString *)which withPathID:(int)pathID into:(XprobeOutput *)html {
     if ( self.length < 50 )
         [self xopenPathID:pathID into:html];
     else
         [super xlinkForCommand:which withPathID:pathID into:html];
 }
 
-- (void)xopenPathID:(int)pathID into:(NSMutableString *)html {
-    [html appendFormat:@"@\"%@\"", [self xhtmlEscape]];
+- (void)xopenPathID:(int)pathID into:(XprobeOutput *)html {
+    xappendLiteral( html, "@\"" );
+    [self xhtmlEscapeInto:html];
+    xappendLiteral( html, "\"" );
 }
 
 @end
@@ -1516,9 +2147,9 @@ static void xgraphLabelNode( NSObject *self ) {
 - (void)xsweep {
 }
 
-- (void)xlinkForCommand:(NSString *)which withPathID:(int)pathID into:(NSMutableString *)html {
-    [html appendString:@"@"];
-    [html appendString:[self xhtmlEscape]];
+- (void)xlinkForCommand:(NSString *)which withPathID:(int)pathID into:(XprobeOutput *)html {
+    xappendLiteral( html, "@" );
+    [self xhtmlEscapeInto:html];
 }
 
 @end
@@ -1528,8 +2159,8 @@ static void xgraphLabelNode( NSObject *self ) {
 - (void)xsweep {
 }
 
-- (void)xopenPathID:(int)pathID into:(NSMutableString *)html {
-    [html appendString:[self xhtmlEscape]];
+- (void)xopenPathID:(int)pathID into:(XprobeOutput *)html {
+    [self xhtmlEscapeInto:html];
 }
 
 @end
@@ -1559,7 +2190,7 @@ typedef struct _AspectBlock {
     // imported variables
 } *AspectBlockRef;
 
-- (void)xopenPathID:(int)pathID into:(NSMutableString *)html {
+- (void)xopenPathID:(int)pathID into:(XprobeOutput *)html {
     AspectBlockRef blockInfo = (__bridge AspectBlockRef)self;
     BOOL hasInfo = blockInfo->flags & AspectBlockFlagsHasSignature ? NO : NO;
     [html appendFormat:@"<br/>%p ^( %s ) {<br/>&nbsp &#160; %s<br/>}", (void *)blockInfo->invoke,
@@ -0,0 +1,95 @@
+//
+//  XprobeEscape.h
+//  XprobePlugin
+//
+//  Single pass escaping of UTF-8 for HTML inside JavaScript string
+//  literals. Plain C++ so it can be built and benchmarked on its own
+//  (see Benchmarks/escape_bench.cpp).
+//
+//  $Id: //depot/XprobePlugin/Sources/Xprobe/XprobeEscape.h#1 $
+//
+
+#ifndef _XprobeEscape_h
+#define _XprobeEscape_h
+
+#include <stddef.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// bytes xhtmlEscape substitutes, a space only when followed by another
+static inline bool xneedsEscape( const char *ptr, const char *end ) {
+    switch ( *ptr ) {
+        case '&': case '<': case '\n': case '\\': case '\'': case '\t':
+            return true;
+        case ' ':
+            return ptr + 1 < end && ptr[1] == ' ';
+        default:
+            return false;
+    }
+}
+
+// skip runs of clean bytes sixteen at a time
+static inline const char *xnextEscape( const char *ptr, const char *end ) {
+#if defined(__SSE2__)
+    const __m128i amp = _mm_set1_epi8('&'), lt = _mm_set1_epi8('<'), nl = _mm_set1_epi8('\n'),
+        bs = _mm_set1_epi8('\\'), qt = _mm_set1_epi8('\''), tab = _mm_set1_epi8('\t'), sp = _mm_set1_epi8(' ');
+    for ( ; ptr + 17 <= end ; ptr += 16 ) {
+        __m128i chunk = _mm_loadu_si128( (const __m128i *)ptr ),
+            next = _mm_loadu_si128( (const __m128i *)(ptr + 1) ),
+            hits = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( chunk, amp ), _mm_cmpeq_epi8( chunk, lt ) ),
+                                _mm_or_si128( _mm_cmpeq_epi8( chunk, nl ), _mm_cmpeq_epi8( chunk, bs ) ) );
+        hits = _mm_or_si128( hits, _mm_or_si128( _mm_cmpeq_epi8( chunk, qt ), _mm_cmpeq_epi8( chunk, tab ) ) );
+        hits = _mm_or_si128( hits, _mm_and_si128( _mm_cmpeq_epi8( chunk, sp ), _mm_cmpeq_epi8( next, sp ) ) );
+        if ( int mask = _mm_movemask_epi8( hits ) )
+            return ptr + __builtin_ctz( mask );
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t amp = vdupq_n_u8('&'), lt = vdupq_n_u8('<'), nl = vdupq_n_u8('\n'),
+        bs = vdupq_n_u8('\\'), qt = vdupq_n_u8('\''), tab = vdupq_n_u8('\t'), sp = vdupq_n_u8(' ');
+    for ( ; ptr + 17 <= end ; ptr += 16 ) {
+        uint8x16_t chunk = vld1q_u8( (const uint8_t *)ptr ), next = vld1q_u8( (const uint8_t *)ptr + 1 ),
+            hits = vorrq_u8( vorrq_u8( vceqq_u8( chunk, amp ), vceqq_u8( chunk, lt ) ),
+                            vorrq_u8( vceqq_u8( chunk, nl ), vceqq_u8( chunk, bs ) ) );
+        hits = vorrq_u8( hits, vorrq_u8( vceqq_u8( chunk, qt ), vceqq_u8( chunk, tab ) ) );
+        hits = vorrq_u8( hits, vandq_u8( vceqq_u8( chunk, sp ), vceqq_u8( next, sp ) ) );
+        if ( vmaxvq_u8( hits ) )
+            break; // scalar loop locates it within the block
+    }
+#endif
+    while ( ptr < end && !xneedsEscape( ptr, end ) )
+        ptr++;
+    return ptr;
+}
+
+#define xemitLiteral( _emit, _literal ) _emit( _literal, sizeof _literal - 1 )
+
+// single pass equivalent of the replacements xhtmlEscape used to chain,
+// emit( const char *, size_t ) is called for each run of output
+template <typename Emit>
+static inline void xescapeHTML( const char *chars, size_t len, Emit emit ) {
+    const char *end = chars + len;
+    while ( chars < end ) {
+        const char *special = xnextEscape( chars, end );
+        if ( special > chars )
+            emit( chars, special - chars );
+        if ( special == end )
+            break;
+
+        switch ( *special ) {
+            case '&': xemitLiteral( emit, "&amp;" ); break;
+            case '<': xemitLiteral( emit, "&lt;" ); break;
+            case '\n': xemitLiteral( emit, "<br/>" ); break;
+            case '\\': xemitLiteral( emit, "\\\\" ); break;
+            case '\'': xemitLiteral( emit, "\\'" ); break;
+            case '\t': xemitLiteral( emit, " &#160; &#160;" ); break;
+            case ' ': xemitLiteral( emit, " &#160;" ); special++; break;
+        }
+        chars = special + 1;
+    }
+}
+
+#endif
@@ -0,0 +1,298 @@
+//
+//  XprobeIndex.h
+//  XprobePlugin
+//
+//  Index of the class names and selectors of the images loaded so
+//  class and method searches no longer copy the class and method
+//  lists of the entire runtime each time. Patterns anchored on a
+//  literal prefix use a sorted order, otherwise the trigrams of the
+//  literal runs a pattern requires select the candidate names the
+//  regular expression is evaluated against.
+//
+//  $Id: //depot/XprobePlugin/Sources/Xprobe/XprobeIndex.h#1 $
+//
+
+#if DEBUG || !SWIFT_PACKAGE
+#ifndef _XprobeIndex_h
+#define _XprobeIndex_h
+
+#import "Xprobe.h"
+#import "XprobeLiterals.h"
+
+#import <mach-o/dyld.h>
+#import <dlfcn.h>
+#import <pthread.h>
+#import <string>
+#import <vector>
+#import <unordered_map>
+#import <algorithm>
+
+class XprobeNames {
+public:
+    uint32_t add( NSString *name );
+    void matching( NSString *pattern, NSRegularExpression *regexp, std::vector<uint32_t> &out );
+    void sortByName( std::vector<uint32_t> &ids ) const;
+
+    NSString *name( uint32_t nameID ) const { return names[nameID]; }
+    size_t count() const { return names.size(); }
+
+private:
+    std::vector<NSString *> names;
+    std::vector<std::string> lower;
+    std::unordered_map<uint32_t,std::vector<uint32_t> > trigrams;
+    std::vector<uint32_t> sorted;
+
+    void prefixed( const std::string &prefix, std::vector<uint32_t> &out );
+
+    static uint32_t trigram( const char *chars ) {
+        return (uint8_t)chars[0] << 16 | (uint8_t)chars[1] << 8 | (uint8_t)chars[2];
+    }
+};
+
+inline uint32_t XprobeNames::add( NSString *name ) {
+    uint32_t nameID = (uint32_t)names.size();
+    names.push_back( name );
+    lower.push_back( [[name lowercaseString] UTF8String] ?: "" );
+
+    const std::string &chars = lower.back();
+    for ( size_t i = 0 ; i + 3 <= chars.size() ; i++ ) {
+        std::vector<uint32_t> &postings = trigrams[trigram( &chars[i] )];
+        if ( postings.empty() || postings.back() != nameID )
+            postings.push_back( nameID );
+    }
+
+    return nameID;
+}
+
+inline void XprobeNames::sortByName( std::vector<uint32_t> &ids ) const {
+    std::sort( ids.begin(), ids.end(), [this]( uint32_t a, uint32_t b ) {
+        return lower[a] < lower[b];
+    } );
+}
+
+// names starting with prefix, the sorted order is extended as names are added
+inline void XprobeNames::prefixed( const std::string &prefix, std::vector<uint32_t> &out ) {
+    if ( sorted.size() < names.size() ) {
+        size_t previous = sorted.size();
+        for ( uint32_t nameID = (uint32_t)previous ; nameID < names.size() ; nameID++ )
+            sorted.push_back( nameID );
+        auto byName = [this]( uint32_t a, uint32_t b ) {
+            return lower[a] < lower[b];
+        };
+        std::sort( sorted.begin() + previous, sorted.end(), byName );
+        std::inplace_merge( sorted.begin(), sorted.begin() + previous, sorted.end(), byName );
+    }
+
+    auto first = std::lower_bound( sorted.begin(), sorted.end(), prefix, [this]( uint32_t nameID, const std::string &value ) {
+        return lower[nameID] < value;
+    } );
+    for ( auto match = first ; match != sorted.end() && lower[*match].compare( 0, prefix.size(), prefix ) == 0 ; ++match )
+        out.push_back( *match );
+}
+
+// ids of names matching the pattern in the order they were added
+inline void XprobeNames::matching( NSString *pattern, NSRegularExpression *regexp, std::vector<uint32_t> &out ) {
+    std::string lowered = [[pattern lowercaseString] UTF8String] ?: "";
+    const char *chars = lowered.c_str();
+    bool anchored = chars[0] == '^';
+    bool plain = strspn( chars + anchored, "abcdefghijklmnopqrstuvwxyz0123456789_:" ) == lowered.size() - anchored;
+
+    if ( plain && anchored ) {
+        prefixed( lowered.substr( 1 ), out );
+        std::sort( out.begin(), out.end() );
+        return;
+    }
+    else if ( !plain && !regexp )
+        return;
+
+    // escapes are case sensitive so the pattern is lowered after extraction
+    std::vector<std::string> extracted, required;
+    xregexLiterals( [pattern UTF8String] ?: "", extracted );
+    for ( const std::string &literal : extracted )
+        if ( NSString *run = [NSString stringWithUTF8String:literal.c_str()] )
+            required.push_back( [[run lowercaseString] UTF8String] );
+
+    std::vector<const std::vector<uint32_t> *> lists;
+    for ( const std::string &literal : required )
+        for ( size_t i = 0 ; i + 3 <= literal.size() ; i++ ) {
+            auto found = trigrams.find( trigram( &literal[i] ) );
+            if ( found == trigrams.end() )
+                return;
+            lists.push_back( &found->second );
+        }
+
+    std::vector<uint32_t> candidates, next;
+    if ( lists.empty() )
+        for ( uint32_t nameID = 0 ; nameID < names.size() ; nameID++ )
+            candidates.push_back( nameID );
+    else {
+        std::sort( lists.begin(), lists.end(), []( const std::vector<uint32_t> *a, const std::vector<uint32_t> *b ) {
+            return a->size() < b->size();
+        } );
+        candidates = *lists[0];
+        for ( size_t l = 1 ; l < lists.size() && !candidates.empty() ; l++ ) {
+            next.clear();
+            std::set_intersection( candidates.begin(), candidates.end(), lists[l]->begin(), lists[l]->end(),
+                                  std::back_inserter( next ) );
+            candidates.swap( next );
+        }
+    }
+
+    for ( uint32_t nameID : candidates ) {
+        bool all = true;
+        for ( const std::string &literal : required )
+            if ( !(all = lower[nameID].find( literal ) != std::string::npos) )
+                break;
+        if ( all && (plain || [regexp rangeOfFirstMatchInString:names[nameID] options:0
+                                     range:NSMakeRange( 0, [names[nameID] length] )].location != NSNotFound) )
+            out.push_back( nameID );
+    }
+}
+
+class XprobeSymbolIndex {
+public:
+    struct _ximplementor {
+        uint32_t classID;
+        bool meta;
+    };
+
+    XprobeNames classNames, selectorNames;
+    std::vector<__unsafe_unretained Class> classes;
+    std::vector<std::vector<_ximplementor> > implementors; // by selector
+
+    XprobeSymbolIndex( NSString *(*nameForClass)( Class ) ) : nameForClass( nameForClass ) {}
+    void addImage( const char *imagePath );
+    void reconcile( bool imagesLoaded );
+
+private:
+    NSString *(*nameForClass)( Class );
+    std::unordered_map<uintptr_t,uint32_t> classIDs, selectorIDs;
+    std::vector<std::pair<unsigned,unsigned> > methodCounts; // instance and class, by class
+    int runtimeClassCount = 0;
+
+    void addClass( Class aClass );
+    unsigned addMethods( Class aClass, uint32_t classID, bool meta, unsigned indexed = 0 );
+};
+
+inline void XprobeSymbolIndex::addImage( const char *imagePath ) {
+    unsigned count = 0;
+    const char **names = objc_copyClassNamesForImage( imagePath, &count );
+
+    for ( unsigned i = 0 ; i < count ; i++ )
+        addClass( objc_getClass( names[i] ) );
+
+    free( names );
+}
+
+inline void XprobeSymbolIndex::addClass( Class aClass ) {
+    uintptr_t key = (uintptr_t)(__bridge void *)aClass;
+    if ( !aClass || classIDs.find( key ) != classIDs.end() )
+        return;
+
+    uint32_t classID = classNames.add( nameForClass( aClass ) );
+    classIDs[key] = classID;
+    classes.push_back( aClass );
+    unsigned instanceMethods = addMethods( aClass, classID, false );
+    methodCounts.push_back( {instanceMethods, addMethods( object_getClass( aClass ), classID, true )} );
+}
+
+// Classes the runtime registered outside any image (KVO subclasses,
+// objc_allocateClassPair, Swift generic classes) are found when the
+// number of classes changes, and methods categories in images loaded
+// since the last search added to classes already indexed by recounting.
+inline void XprobeSymbolIndex::reconcile( bool imagesLoaded ) {
+    int count = objc_getClassList( NULL, 0 );
+    if ( count != runtimeClassCount ) {
+        unsigned classCount;
+        if ( Class *all = objc_copyClassList( &classCount ) ) {
+            for ( unsigned i = 0 ; i < classCount ; i++ )
+                addClass( all[i] );
+            free( all );
+        }
+        runtimeClassCount = count;
+    }
+
+    if ( imagesLoaded )
+        for ( uint32_t classID = 0 ; classID < classes.size() ; classID++ ) {
+            std::pair<unsigned,unsigned> &counts = methodCounts[classID];
+            counts.first = addMethods( classes[classID], classID, false, counts.first );
+            counts.second = addMethods( object_getClass( classes[classID] ), classID, true, counts.second );
+        }
+}
+
+// returns the number of methods, only those not already indexed are added
+inline unsigned XprobeSymbolIndex::addMethods( Class aClass, uint32_t classID, bool meta, unsigned indexed ) {
+    unsigned mc;
+    Method *methods = class_copyMethodList( aClass, &mc );
+
+    for ( unsigned i = 0 ; i < mc && mc != indexed ; i++ ) {
+        SEL sel = method_getName( methods[i] );
+        auto found = selectorIDs.find( (uintptr_t)sel );
+        uint32_t selectorID;
+        if ( found != selectorIDs.end() )
+            selectorID = found->second;
+        else {
+            selectorID = selectorIDs[(uintptr_t)sel] = selectorNames.add( NSStringFromSelector( sel ) );
+            implementors.emplace_back();
+        }
+
+        std::vector<_ximplementor> &implementing = implementors[selectorID];
+        if ( indexed && std::find_if( implementing.begin(), implementing.end(), [=]( const _ximplementor &implementor ) {
+            return implementor.classID == classID && implementor.meta == meta;
+        } ) != implementing.end() )
+            continue;
+        implementing.push_back( {classID, meta} );
+    }
+
+    free( methods );
+    return mc;
+}
+
+// Images are queued as dyld loads them and indexed the next time the
+// index is used, or in the background when the service connects, then
+// reconciled with the classes the runtime has.
+
+static XprobeSymbolIndex *symbolIndex;
+static pthread_mutex_t symbolIndexLock = PTHREAD_MUTEX_INITIALIZER, pendingImagesLock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<std::string> pendingImages;
+
+static void xqueueImage( const struct mach_header *header, intptr_t slide ) {
+    Dl_info info;
+    if ( !dladdr( header, &info ) || !info.dli_fname )
+        return;
+
+    pthread_mutex_lock( &pendingImagesLock );
+    pendingImages.push_back( info.dli_fname );
+    pthread_mutex_unlock( &pendingImagesLock );
+}
+
+// call with symbolIndexLock held
+static XprobeSymbolIndex &xsymbolIndex( NSString *(*nameForClass)( Class ) ) {
+    static dispatch_once_t once;
+    dispatch_once( &once, ^{
+        symbolIndex = new XprobeSymbolIndex( nameForClass );
+        _dyld_register_func_for_add_image( xqueueImage );
+    } );
+
+    std::vector<std::string> images;
+    pthread_mutex_lock( &pendingImagesLock );
+    images.swap( pendingImages );
+    pthread_mutex_unlock( &pendingImagesLock );
+
+    for ( const std::string &image : images )
+        @autoreleasepool {
+            symbolIndex->addImage( image.c_str() );
+        }
+
+    // categories of images loaded after the first pass can add to indexed classes
+    static bool indexed;
+    @autoreleasepool {
+        symbolIndex->reconcile( indexed && !images.empty() );
+    }
+    indexed = true;
+
+    return *symbolIndex;
+}
+
+#endif
+#endif
@@ -0,0 +1,163 @@
+//
+//  XprobeLiterals.h
+//  XprobePlugin
+//
+//  Runs of characters any case insensitive match of an ICU regular
+//  expression must contain, used to select candidates from trigram
+//  indexes before the pattern is evaluated: names of classes and
+//  methods in XprobeIndex.h and lines of the console log in
+//  XprobeLog.h. Plain C++ so both targets can include it and it can
+//  be checked on its own against the regular expression engine
+//  (see Benchmarks/literals_check.cpp).
+//
+//  $Id: //depot/XprobePlugin/Sources/Xprobe/XprobeLiterals.h#1 $
+//
+
+#ifndef _XprobeLiterals_h
+#define _XprobeLiterals_h
+
+#include <string>
+#include <vector>
+#include <cctype>
+
+// skip the payload of an alphanumeric escape, ptr is at the letter after the '\'
+static inline const char *xskipEscape( const char *ptr ) {
+    int digits = 0;
+    switch ( *ptr ) {
+        case 'x': case 'p': case 'P': case 'N':
+            if ( ptr[1] == '{' ) {
+                while ( ptr[1] && ptr[1] != '}' )
+                    ptr++;
+                if ( ptr[1] )
+                    ptr++;
+            }
+            else if ( *ptr == 'x' ) {
+                digits = 2;
+                break;
+            }
+            return ptr;
+        case 'k':
+            if ( ptr[1] == '<' ) {
+                while ( ptr[1] && ptr[1] != '>' )
+                    ptr++;
+                if ( ptr[1] )
+                    ptr++;
+            }
+            return ptr;
+        case 'c':
+            return ptr[1] ? ptr + 1 : ptr;
+        case 'u':
+            digits = 4;
+            break;
+        case 'U':
+            digits = 8;
+            break;
+        case '0':
+            while ( digits < 3 && ptr[1] >= '0' && ptr[1] <= '7' )
+                ptr++, digits++;
+            return ptr;
+        default:
+            // back references take as many digits as follow
+            if ( isdigit( (unsigned char)*ptr ) )
+                while ( isdigit( (unsigned char)ptr[1] ) )
+                    ptr++;
+            return ptr;
+    }
+
+    while ( digits-- && isxdigit( (unsigned char)ptr[1] ) )
+        ptr++;
+    return ptr;
+}
+
+// lowercased runs a match must contain, false when there is alternation
+// and nothing can be assumed. Quantified characters, groups, classes and
+// escapes for anything other than a single punctuation character end a run.
+static inline bool xregexLiterals( const char *pattern, std::vector<std::string> &out ) {
+    std::string run;
+    int depth = 0;
+
+    for ( const char *ptr = pattern ; *ptr ; ptr++ ) {
+        char ch = *ptr;
+        switch ( ch ) {
+            case '|':
+                out.clear();
+                return false;
+            case '*': case '?': case '{':
+                // previous character was optional
+                if ( !run.empty() )
+                    run.resize( run.size() - 1 );
+                if ( ch == '{' ) {
+                    while ( ptr[1] && ptr[1] != '}' )
+                        ptr++;
+                    if ( ptr[1] )
+                        ptr++;
+                }
+                // fall through
+            case '+':
+                break;
+            case '(':
+                depth++;
+                break;
+            case ')':
+                depth--;
+                break;
+            case '[': {
+                // sets nest as do POSIX classes, a leading ']' is a member
+                int nested = 1;
+                ptr += ptr[1] == '^' ? 2 : 1;
+                if ( *ptr == ']' )
+                    ptr++;
+                for ( ; *ptr ; ptr++ )
+                    if ( *ptr == '\\' && ptr[1] )
+                        ptr++;
+                    else if ( *ptr == '[' )
+                        nested++;
+                    else if ( *ptr == ']' && !--nested )
+                        break;
+                if ( !*ptr )
+                    ptr--; // unterminated
+                break;
+            }
+            case '\\':
+                if ( ptr[1] == 'Q' ) {
+                    // quoted up to \E, a quantifier after it applies to the last character
+                    for ( ptr += 2 ; *ptr && !(ptr[0] == '\\' && ptr[1] == 'E') ; ptr++ )
+                        if ( depth == 0 )
+                            run += tolower( (unsigned char)*ptr );
+                    if ( *ptr )
+                        ptr++;
+                    else
+                        ptr--; // quoted to the end
+                    if ( depth == 0 )
+                        continue;
+                }
+                else if ( ptr[1] && !isalnum( (unsigned char)ptr[1] ) ) {
+                    ch = *++ptr;
+                    if ( depth == 0 && !(ptr[1] == '*' || ptr[1] == '?' || ptr[1] == '{') ) {
+                        run += tolower( (unsigned char)ch );
+                        continue;
+                    }
+                }
+                else if ( ptr[1] )
+                    ptr = xskipEscape( ptr + 1 );
+                break;
+            case '.': case '^': case '$':
+                break;
+            default:
+                if ( depth == 0 ) {
+                    run += tolower( (unsigned char)ch );
+                    continue;
+                }
+        }
+
+        if ( !run.empty() )
+            out.push_back( run );
+        run.clear();
+    }
+
+    if ( !run.empty() )
+        out.push_back( run );
+    return true;
+}
+
+#endif
@@ -0,0 +1,212 @@
+//
+//  XprobeOutput.h
+//  XprobePlugin
+//
+//  Byte oriented builder for the HTML/JavaScript responses sent
+//  to the console. Renderers append UTF-8 directly into a growable
+//  buffer that is handed to the socket writer without conversion.
+//
+//  $Id: //depot/XprobePlugin/Sources/Xprobe/XprobeOutput.h#1 $
+//
+
+#if DEBUG || !SWIFT_PACKAGE
+#ifndef _XprobeOutput_h
+#define _XprobeOutput_h
+
+#import "Xprobe.h"
+#import "XprobeEscape.h"
+
+@interface XprobeOutput(Reserve)
+- (void)reserve:(NSUInteger)extra;
+@end
+
+@implementation XprobeOutput {
+    char *bytes;
+    NSUInteger length, capacity;
+}
+
+- (void)dealloc {
+    free( bytes );
+}
+
+- (void)reserve:(NSUInteger)extra {
+    if ( length + extra <= capacity )
+        return;
+    NSUInteger newCapacity = capacity ? capacity : 4096;
+    while ( newCapacity < length + extra )
+        newCapacity *= 2;
+    if ( !(bytes = (char *)realloc( bytes, newCapacity )) )
+        [NSException raise:@"XprobeOutput" format:@"Could not allocate %d bytes", (int)newCapacity];
+    capacity = newCapacity;
+}
+
+- (void)appendBytes:(const void *)chars length:(NSUInteger)len {
+    [self reserve:len];
+    memcpy( bytes + length, chars, len );
+    length += len;
+}
+
+- (void)appendUTF8:(const char *)chars {
+    if ( chars )
+        [self appendBytes:chars length:strlen( chars )];
+}
+
+- (void)appendString:(NSString *)aString {
+    if ( !aString )
+        return;
+
+    CFStringRef cfString = (__bridge CFStringRef)aString;
+    if ( const char *chars = CFStringGetCStringPtr( cfString, kCFStringEncodingUTF8 ) ) {
+        [self appendUTF8:chars];
+        return;
+    }
+
+    NSUInteger maxBytes = [aString maximumLengthOfBytesUsingEncoding:NSUTF8StringEncoding], used = 0;
+    [self reserve:maxBytes];
+    [aString getBytes:bytes + length maxLength:maxBytes usedLength:&used encoding:NSUTF8StringEncoding
+              options:0 range:NSMakeRange( 0, [aString length] ) remainingRange:NULL];
+    length += used;
+}
+
+- (void)appendFormat:(NSString *)format, ... {
+    va_list argp; va_start(argp, format);
+    [self appendString:[[NSString alloc] initWithFormat:format arguments:argp]];
+    va_end(argp);
+}
+
+- (void)appendInt:(long long)value {
+    char buff[24], *end = buff + sizeof buff, *ptr = end;
+    unsigned long long uvalue = value < 0 ? 0ULL - (unsigned long long)value : value;
+    do
+        *--ptr = '0' + uvalue % 10;
+    while ( uvalue /= 10 );
+    if ( value < 0 )
+        *--ptr = '-';
+    [self appendBytes:ptr length:end - ptr];
+}
+
+- (void)appendPointer:(const void *)pointer {
+    static const char hexDigits[] = "0123456789abcdef";
+    char buff[2+sizeof(uintptr_t)*2], *end = buff + sizeof buff, *ptr = end;
+    uintptr_t uvalue = (uintptr_t)pointer;
+    do
+        *--ptr = hexDigits[uvalue & 0xf];
+    while ( uvalue >>= 4 );
+    *--ptr = 'x';
+    *--ptr = '0';
+    [self appendBytes:ptr length:end - ptr];
+}
+
+- (void)appendEscaped:(const char *)chars length:(NSUInteger)len {
+    xescapeHTML( chars, len, [self]( const char *run, size_t runLength ) {
+        [self appendBytes:run length:runLength];
+    } );
+}
+
+- (void)appendEscapedString:(NSString *)aString {
+    CFStringRef cfString = (__bridge CFStringRef)aString;
+    const char *chars = cfString ? CFStringGetCStringPtr( cfString, kCFStringEncodingUTF8 ) : NULL;
+    if ( !chars )
+        chars = [aString UTF8String];
+    if ( chars )
+        [self appendEscaped:chars length:strlen( chars )];
+}
+
+// JSON string literal, optionally undoing the \' and \\ of markup built for JavaScript
+- (void)appendJSON:(const char *)chars length:(NSUInteger)len unescapingQuotes:(BOOL)unescape {
+    static const char hexDigits[] = "0123456789abcdef";
+    const char *end = chars + len, *from = chars;
+
+    xappendLiteral( self, "\"" );
+    for ( const char *ptr = chars ; ptr < end ; ptr++ ) {
+        unsigned char ch = *ptr;
+        if ( ch >= ' ' && ch != '"' && ch != '\\' && ch != 0xe2 )
+            continue;
+
+        [self appendBytes:from length:ptr - from];
+        from = ptr + 1;
+
+        if ( ch == '"' )
+            xappendLiteral( self, "\\\"" );
+        else if ( ch == '\\' ) {
+            char next = ptr + 1 < end ? ptr[1] : 0;
+            if ( unescape && next == '\'' )
+                continue; // quote is copied with the next run
+            if ( unescape && next == '\\' )
+                from = ++ptr + 1;
+            xappendLiteral( self, "\\\\" );
+        }
+        else if ( ch == 0xe2 ) {
+            // U+2028 & U+2029 terminate JavaScript string literals
+            if ( ptr + 2 < end && (unsigned char)ptr[1] == 0x80 && ((unsigned char)ptr[2] & 0xfe) == 0xa8 ) {
+                [self appendUTF8:(unsigned char)ptr[2] == 0xa8 ? "\\u2028" : "\\u2029"];
+                from = (ptr += 2) + 1;
+            }
+            else
+                from = ptr;
+        }
+        else {
+            char escape[] = {'\\', 'u', '0', '0', hexDigits[ch >> 4], hexDigits[ch & 0xf]};
+            [self appendBytes:escape length:sizeof escape];
+        }
+    }
+
+    [self appendBytes:from length:end - from];
+    xappendLiteral( self, "\"" );
+}
+
+- (void)appendJSONString:(NSString *)aString {
+    if ( const char *chars = [aString UTF8String] )
+        [self appendJSON:chars length:strlen( chars ) unescapingQuotes:NO];
+    else
+        xappendLiteral( self, "null" );
+}
+
+- (void)appendJSONMarkup:(NSString *)markup {
+    if ( const char *chars = [markup UTF8String] )
+        [self appendJSON:chars length:strlen( chars ) unescapingQuotes:YES];
+    else
+        xappendLiteral( self, "\"\"" );
+}
+
+- (void)appendSpanForID:(const char *)prefix command:(const char *)command
+                 pathID:(int)pathID name:(const char *)name {
+    xappendLiteral( self, "<span onclick=\\'this.id =\"" );
+    [self appendUTF8:prefix];
+    [self appendInt:pathID];
+    xappendLiteral( self, "\"; sendClient( \"" );
+    [self appendUTF8:command];
+    xappendLiteral( self, "\", \"" );
+    [self appendInt:pathID];
+    xappendLiteral( self, "," );
+    [self appendUTF8:name];
+    xappendLiteral( self, "\" ); event.cancelBubble = true;\\'>" );
+}
+
+- (NSUInteger)length {
+    return length;
+}
+
+- (const char *)bytes {
+    return bytes;
+}
+
+- (NSData *)detachData {
+    NSData *data = bytes ? [NSData dataWithBytesNoCopy:bytes length:length freeWhenDone:YES] : [NSData data];
+    bytes = NULL;
+    length = capacity = 0;
+    return data;
+}
+
+- (void)reset {
+    length = 0;
+}
+
+- (NSString *)description {
+    return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+}
+
+@end
+
+#endif
+#endif
@@ -23,6 +23,7 @@
 
 #import <Foundation/Foundation.h>
 #import <objc/runtime.h>
+#import <compression.h>
 
 #if TARGET_OS_IPHONE
 #import <UIKit/UIKit.h>
@@ -35,9 +36,35 @@
 #endif
 #define XPROBE_MAGIC -XPROBE_PORT*XPROBE_PORT
 #define XPROBE_KEY @__FILE__
+// features this version of Xprobe understands, sent after the key
+#define XPROBE_CAPABILITIES "?structured,compress,stream"
+
+// frames sent once the console replies "compress:" have the top bit of
+// the length set followed by the uncompressed length and an algorithm byte
+#define XPROBE_COMPRESSED 0x80000000U
+#define XPROBE_COMPRESS_MIN 4096
+#define XPROBE_COMPRESS_BULK (256*1024)
+
+typedef NS_ENUM(uint8_t, XprobeCompression) {
+    XprobeCompressionNone,
+    XprobeCompressionLZ4,
+    XprobeCompressionLZFSE,
+    XprobeCompressionZLIB,
+};
+
+static inline compression_algorithm xprobeAlgorithm( XprobeCompression compression ) {
+    switch ( compression ) {
+        case XprobeCompressionLZ4: return COMPRESSION_LZ4;
+        case XprobeCompressionLZFSE: return COMPRESSION_LZFSE;
+        case XprobeCompressionZLIB: return COMPRESSION_ZLIB;
+        default: return (compression_algorithm)0;
+    }
+}
 
 #pragma primary interface
 
+@class XprobeOutput;
+
 @interface Xprobe : NSObject
 
 // specify pattern of classes to avoid in sweep
@@ -70,24 +97,66 @@
 + (void)connectTo:(const char *)ipAddress retainObjects:(BOOL)shouldRetain;
 + (void)search:(NSString *)classNamePattern;
 + (void)writeString:(NSString *)str;
++ (void)writeOutput:(XprobeOutput *)output;
 + (void)open:(NSString *)input;
++ (void)more:(NSString *)input;
++ (void)found:(NSString *)input;
++ (void)indexSymbols;
++ (void)structured:(NSString *)input;
++ (void)compress:(NSString *)input;
 
 @end
 
+#pragma mark output builder
+
+// UTF-8 buffer renderers append HTML/JavaScript into
+// rather than an NSMutableString so it can be sent
+// to the console without conversion from UTF-16.
+
+@interface XprobeOutput : NSObject
+
+- (void)appendString:(NSString *)aString;
+- (void)appendFormat:(NSString *)format, ... NS_FORMAT_FUNCTION(1,2);
+- (void)appendBytes:(const void *)bytes length:(NSUInteger)length;
+- (void)appendUTF8:(const char *)chars;
+- (void)appendInt:(long long)value;
+- (void)appendPointer:(const void *)pointer;
+- (void)appendEscaped:(const char *)chars length:(NSUInteger)len;
+- (void)appendEscapedString:(NSString *)aString;
+- (void)appendJSON:(const char *)chars length:(NSUInteger)len unescapingQuotes:(BOOL)unescape;
+- (void)appendJSONString:(NSString *)aString;
+- (void)appendJSONMarkup:(NSString *)markup;
+- (void)appendSpanForID:(const char *)prefix command:(const char *)command
+                 pathID:(int)pathID name:(const char *)name;
+
+- (NSUInteger)length;
+- (const char *)bytes;
+- (NSData *)detachData;
+- (void)reset;
+
+@end
+
+#define xappendLiteral( _out, _literal ) [_out appendBytes:_literal length:sizeof _literal - 1]
+
 @interface NSObject(Xprobe)
 
 #pragma mark internal references
 
-+ (void)xopen:(NSObject *)obj withPathID:(int)pathID into:(NSMutableString *)html;
++ (void)xopen:(NSObject *)obj withPathID:(int)pathID into:(XprobeOutput *)html;
 
 - (void)xsweep;
-- (void)xopenPathID:(int)pathID into:(NSMutableString *)html;
-- (void)xlinkForCommand:(NSString *)which withPathID:(int)pathID into:(NSMutableString *)html;
-- (void)xspanForPathID:(int)pathID ivar:(Ivar)ivar type:(const char *)type into:(NSMutableString *)html;
+- (void)xopenPathID:(int)pathID into:(XprobeOutput *)html;
+- (void)xopenPathID:(int)pathID from:(NSUInteger)start into:(XprobeOutput *)html;
+- (void)xlinkForCommand:(NSString *)which withPathID:(int)pathID into:(XprobeOutput *)html;
+- (void)xspanForPathID:(int)pathID ivar:(Ivar)ivar type:(const char *)type into:(XprobeOutput *)html;
+- (BOOL)xjsonForPathID:(int)pathID into:(XprobeOutput *)json;
+- (void)xjsonForPathID:(int)pathID ivar:(Ivar)ivar type:(const char *)type into:(XprobeOutput *)json;
 
 - (id)xvalueForKeyPath:(NSString *)key;
 - (id)xvalueForKey:(NSString *)key;
+- (id)xvalueForKey:(NSString *)key pathID:(int)pathID;
 - (NSString *)xhtmlEscape;
+- (void)xhtmlEscapeInto:(XprobeOutput *)html;
 
 @end
 
@@ -170,14 +239,16 @@ extern BOOL xprobeRetainObjects;
 + (NSString *)arrayOpt:(const void *)arrayPtr;
 + (NSString *)demangle:(NSString *)name;
 + (NSArray<NSString *> *)listMembers:(id)instance;
-+ (void)dumpMethods:(Class)aClass into:(NSMutableString *)into;
-+ (void)dumpIvars:(id)instance into:(NSMutableString *)into;
++ (void)dumpMethods:(Class)aClass into:(XprobeOutput *)into;
++ (void)dumpIvars:(id)instance into:(XprobeOutput *)into;
 + (void)traceBundle:(NSBundle *)bundle;
 + (void)traceClass:(Class)aClass;
 + (void)traceInstance:(id)instance;
 + (void)traceInstance:(id)instance class:(Class)aClass;
 + (void)notrace:(id)instance;
-+ (void)dumpIvars:(id)instance forClass:(Class)aClass into:(NSMutableString *)into;
++ (void)untraceClass:(Class)aClass;
++ (void)untraceAll;
++ (void)dumpIvars:(id)instance forClass:(Class)aClass into:(XprobeOutput *)into;
 + (void)xprobeSweep:(id)instance forClass:(Class)aClass;
 @end
 #endif
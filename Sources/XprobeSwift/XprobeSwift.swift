@@ -133,6 +133,16 @@ class XprobeSwift: NSObject {
         print("⚠️ XprobeSwift: untrace not implemented")
     }
 
+    @objc class func untraceClass(_ aClass: AnyClass) {
+        // SwiftTrace's swizzles can only be removed all together
+        untraceAll()
+    }
+
+    @objc class func untraceAll() {
+        _ = SwiftTrace.removeAllTraces()
+        _ = SwiftTrace.revertInterposes()
+    }
+
     @objc class func xprobeSweep(_ instance: AnyObject, forClass: AnyClass) {
         var out: IvarOutputStream? = nil
         dumpMembers(instance, target: &out, indent: "", aClass: forClass, processInstance: {
@@ -141,7 +151,7 @@ class XprobeSwift: NSObject {
         })
     }
 
-    @objc class func dumpMethods(_ aClass: AnyClass, into: NSMutableString) {
+    @objc class func dumpMethods(_ aClass: AnyClass, into: XprobeOutput) {
         var first = true
         SwiftTrace.iterateMethods(ofClass: aClass) {
             (demangled, slot, symbol, stop) in
@@ -154,15 +164,15 @@ class XprobeSwift: NSObject {
         }
     }
 
-    @objc class func dumpIvars(_ instance: AnyObject, forClass: AnyClass, into: NSMutableString) {
+    @objc class func dumpIvars(_ instance: AnyObject, forClass: AnyClass, into: XprobeOutput) {
         var out: IvarOutputStream? = IvarOutputStream()
         dumpMembers(instance, target: &out, indent: "", aClass: forClass, processInstance: {
             (obj, out) in
             let path = XprobeRetained()
             path.setObject(obj)
-            let link = NSMutableString()
+            let link = XprobeOutput()
             obj.xlink(forCommand: "open", withPathID: path.xadd(), into: link)
-            out.write("\(link)")
+            out.write(link.description)
         })
         into.append(out!.out
             .replacingOccurrences(of: "= '", with: "= \\'")
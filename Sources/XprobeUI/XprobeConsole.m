@@ -11,6 +11,7 @@
 #import "XprobePluginMenuController.h"
 #import "BundleProtocol.h"
 #import "XprobeConsole.h"
+#import "XprobeLog.h"
 #import "Xprobe.h"
 
 #import <netinet/tcp.h>
@@ -21,6 +22,10 @@
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wdeprecated-declarations"
 
+#define LOG_MAX_BYTES (256*1024*1024)
+#define LOG_MAX_DISPLAYED 50000
+#define GRAPH_PARTIAL_INTERVAL 2.0
+
 __weak XprobeConsole *dotConsole;
 
 static NSMutableDictionary *packagesOpen;
@@ -39,10 +44,14 @@ static NSMutableDictionary *packagesOpen;
 @property (nonatomic,strong) IBOutlet NSButton *graph;
 @property (nonatomic,strong) IBOutlet NSButton *print;
 
-@property (strong) NSMutableArray *lineBuffer;
+@property (strong) XprobeLog *log;
 @property (strong) NSMutableString *incoming;
 @property (strong) NSLock *lock;
+@property NSUInteger displayedLines;
 @property int clientSocket;
+@property BOOL structured, compress, stream;
+@property (strong) NSFileHandle *graphFile;
+@property NSTimeInterval graphLaidOut;
 
 @end
 
@@ -130,25 +139,57 @@ static int serverSocket;
         return nil;
     }
 
+    uint32_t frameLength = length & ~XPROBE_COMPRESSED;
     ssize_t sofar = 0, bytes;
-    char *buff = (char *)malloc(length+1);
+    char *buff = (char *)malloc(frameLength+1);
 
-    while ( buff && sofar < length && (bytes = read(self.clientSocket, buff+sofar, length-sofar )) > 0 )
+    while ( buff && sofar < frameLength && (bytes = read(self.clientSocket, buff+sofar, frameLength-sofar )) > 0 )
         sofar += bytes;
 
-    if ( sofar < length ) {
-        NSLog( @"XprobeConsole: Socket read error %d/%d: %s", (int)sofar, length, strerror(errno) );
+    if ( sofar < frameLength ) {
+        NSLog( @"XprobeConsole: Socket read error %d/%d: %s", (int)sofar, frameLength, strerror(errno) );
+        free( buff );
         return nil;
     }
 
     if ( buff )
         buff[sofar] = '\000';
 
-    NSString *str = [NSString stringWithUTF8String:buff];
+    if ( buff && length & XPROBE_COMPRESSED )
+        buff = [self decompress:buff length:length & ~XPROBE_COMPRESSED];
+
+    NSString *str = buff ? [NSString stringWithUTF8String:buff] : nil;
     free( buff );
     return str;
 }
 
+- (char *)decompress:(char *)frame length:(uint32_t)length {
+    uint32_t rawLength;
+    size_t header = sizeof rawLength + sizeof(XprobeCompression);
+    if ( length < header ) {
+        free( frame );
+        return NULL;
+    }
+
+    memcpy( &rawLength, frame, sizeof rawLength );
+    XprobeCompression compression = (XprobeCompression)frame[sizeof rawLength];
+
+    char *buff = (char *)malloc( rawLength + 1 );
+    size_t decoded = buff ? compression_decode_buffer( (uint8_t *)buff, rawLength,
+                        (const uint8_t *)frame + header, length - header,
+                        NULL, xprobeAlgorithm( compression ) ) : 0;
+    free( frame );
+
+    if ( decoded != rawLength ) {
+        NSLog( @"XprobeConsole: Could not decompress frame %d/%d", (int)decoded, rawLength );
+        free( buff );
+        return NULL;
+    }
+
+    buff[rawLength] = '\000';
+    return buff;
+}
+
 - (void)writeString:(NSString *)str {
     const char *data = [str UTF8String];
     uint32_t length = (uint32_t)strlen(data);
@@ -172,7 +213,7 @@ static int serverSocket;
     if  ( !self.package )
         return nil;
 
-    (void)[self readString];
+    NSString *key = [self readString];
 
     if ( !packagesOpen )
         packagesOpen = [NSMutableDictionary new];
@@ -231,6 +272,11 @@ static int serverSocket;
         self.clientSocket = clientSocket; ////
     }
 
+    // older versions of Xprobe only render HTML, don't compress or stream
+    self.structured = [key containsString:@"?structured"];
+    self.compress = [key containsString:@",compress"];
+    self.stream = [key containsString:@",stream"];
+
     dispatch_sync(dispatch_get_main_queue(), ^{
         self.window.title = [NSString stringWithFormat:@"Connected to: %@", self.package];
 
@@ -244,7 +290,8 @@ static int serverSocket;
 
         [self.window makeFirstResponder:self.search];
         [self.window makeKeyAndOrderFront:self];
-        self.lineBuffer = [NSMutableArray new];
+        self.log = [[XprobeLog alloc] initWithMaxBytes:LOG_MAX_BYTES spillPath:
+                    [[NSUserDefaults standardUserDefaults] stringForKey:@"XprobeLogSpillPath"]];
         [NSApp activateIgnoringOtherApps:YES];
     });
 
@@ -265,6 +312,11 @@ static int serverSocket;
             dispatch_async(dispatch_get_main_queue(), ^{
                 [self execJS:dhtmlOrDotOrTrace];
             });
+        else if ( [dhtmlOrDotOrTrace hasPrefix:@"json: "] )
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self execJS:[NSString stringWithFormat:@"renderObject(%@);",
+                              [dhtmlOrDotOrTrace substringFromIndex:6]]];
+            });
         else if ( [dhtmlOrDotOrTrace hasPrefix:@"digraph "] ) {
             xprobePlugin.dotTmp = [NSTemporaryDirectory() stringByAppendingPathComponent:@"graph.gv"];
             [dhtmlOrDotOrTrace writeToFile:xprobePlugin.dotTmp atomically:NO
@@ -274,6 +326,34 @@ static int serverSocket;
                 [xprobePlugin graph:nil];
             });
         }
+        else if ( [dhtmlOrDotOrTrace hasPrefix:@"graph: "] ) {
+            // streamed graph is written to graph.gv as it arrives, what has
+            // arrived so far is laid out straight away then every couple of
+            // seconds until "graphed: " says it is complete
+            NSString *dotFile = [NSTemporaryDirectory() stringByAppendingPathComponent:@"graph.gv"];
+            if ( [dhtmlOrDotOrTrace hasPrefix:@"graph: digraph "] ) {
+                [[NSFileManager defaultManager] createFileAtPath:dotFile contents:nil attributes:nil];
+                self.graphFile = [NSFileHandle fileHandleForWritingAtPath:dotFile];
+                self.graphLaidOut = 0.;
+            }
+            [self.graphFile writeData:[[dhtmlOrDotOrTrace substringFromIndex:7]
+                                       dataUsingEncoding:NSUTF8StringEncoding]];
+
+            NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+            if ( self.graphFile && now - self.graphLaidOut > GRAPH_PARTIAL_INTERVAL ) {
+                self.graphLaidOut = now;
+                [self layoutPartialGraph:dotFile];
+            }
+        }
+        else if ( [dhtmlOrDotOrTrace hasPrefix:@"graphed: "] ) {
+            [self.graphFile closeFile];
+            self.graphFile = nil;
+            dotConsole = self;
+            dispatch_async(dispatch_get_main_queue(), ^{
+                xprobePlugin.dotTmp = [NSTemporaryDirectory() stringByAppendingPathComponent:@"graph.gv"];
+                [xprobePlugin graph:nil];
+            });
+        }
         else if ( [dhtmlOrDotOrTrace hasPrefix:@"updates: "] )
             dispatch_async(dispatch_get_main_queue(), ^{
                 [xprobePlugin execJS:[dhtmlOrDotOrTrace substringFromIndex:9]];
@@ -307,12 +387,40 @@ static int serverSocket;
     self.clientSocket = 0;
 }
 
+// chunks end at a line so closing the digraph gives something dot can lay out,
+// written atomically as a previous layout may still be reading the last one
+- (void)layoutPartialGraph:(NSString *)dotFile {
+    NSString *partial = [NSTemporaryDirectory() stringByAppendingPathComponent:@"partial.gv"];
+    NSMutableData *dot = [NSMutableData dataWithContentsOfFile:dotFile];
+    [dot appendBytes:"}\n" length:2];
+    if ( ![dot writeToFile:partial atomically:YES] )
+        return;
+
+    dotConsole = self;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        xprobePlugin.dotTmp = partial;
+        [xprobePlugin graph:nil];
+    });
+}
+
 - (NSMenu *)windowMenu {
     return [[[NSApp mainMenu] itemWithTitle:@"Window"] submenu];
 }
 
 - (void)webView:(WebView *)aWebView didFinishLoadForFrame:(WebFrame *)frame {
     self.webView.frameLoadDelegate = nil;
+    if ( self.structured ) {
+        [self writeString:@"structured:"];
+        [self writeString:@"1"];
+    }
+    if ( self.compress ) {
+        [self writeString:@"compress:"];
+        [self writeString:@"lz4,lzfse"];
+    }
+    if ( self.stream ) {
+        [self writeString:@"streamGraph:"];
+        [self writeString:@"1"];
+    }
     [self performSelectorInBackground:@selector(serviceClient) withObject:nil];
 }
 
@@ -376,29 +484,30 @@ static int serverSocket;
     return nil;
 }
 
-- (NSString *)filterLinesByCurrentRegularExpression:(NSArray *)lines {
-    NSMutableString *out = [[NSMutableString alloc] init];
-    NSRegularExpression *filterRegexp = [NSRegularExpression regularExpressionWithPattern:self.filter.stringValue
-                                                            options:NSRegularExpressionCaseInsensitive error:NULL];
-    for ( NSString *line in lines ) {
-        if ( !filterRegexp ||
-            [filterRegexp rangeOfFirstMatchInString:line options:0
-                                              range:NSMakeRange(0, [line length])].location != NSNotFound ) {
-                [out appendString:line];
-                [out appendString:@"\n"];
-            }
-    }
-
-    return out;
-}
-
 - (IBAction)search:(NSSearchField *)sender {
     [self writeString:@"search:"];
     [self writeString:sender.stringValue];
 }
 
 - (IBAction)filterChange:sender {
-    self.console.string = [self filterLinesByCurrentRegularExpression:self.lineBuffer];
+    NSString *matching = [self.log linesMatching:self.filter.stringValue limit:LOG_MAX_DISPLAYED];
+    self.console.string = matching;
+    self.displayedLines = [[matching componentsSeparatedByString:@"\n"] count] - 1;
+}
+
+// the console shows at most LOG_MAX_DISPLAYED lines, oldest removed first
+- (void)trimConsole {
+    if ( self.displayedLines <= LOG_MAX_DISPLAYED )
+        return;
+
+    NSTextStorage *storage = self.console.textStorage;
+    NSString *text = storage.string;
+    NSUInteger excess = self.displayedLines - LOG_MAX_DISPLAYED, end = 0;
+    while ( excess-- && end < text.length )
+        end = NSMaxRange( [text lineRangeForRange:NSMakeRange( end, 0 )] );
+
+    [storage deleteCharactersInRange:NSMakeRange( 0, end )];
+    self.displayedLines = LOG_MAX_DISPLAYED;
 }
 
 - (void)insertText:(NSString *)output {
@@ -429,13 +538,15 @@ static int serverSocket;
     if ( lineCount && [newLlines[lineCount-1] length] == 0 )
         [newLlines removeObjectAtIndex:lineCount-1];
 
-    [self.lineBuffer addObjectsFromArray:newLlines];
+    [self.log appendLines:newLlines];
 
     if ( ![self.paused state] ) {
-        NSString *filtered = [self filterLinesByCurrentRegularExpression:newLlines];
+        NSString *filtered = [self.log lines:newLlines matching:self.filter.stringValue];
         if ( [filtered length] ) {
             [self.console setSelectedRange:NSMakeRange([self.console.string length], 0)];
             [self.console insertText:filtered];
+            self.displayedLines += [[filtered componentsSeparatedByString:@"\n"] count] - 1;
+            [self trimConsole];
         }
     }
 }
@@ -0,0 +1,864 @@
+//
+//  XprobeLayout.h
+//  XprobePlugin
+//
+//  In process layered ("Sugiyama") layout of the object graphs
+//  produced by a sweep so they can be displayed by canviz without
+//  running Graphviz. Parses the subset of dot Xprobe.mm generates
+//  and writes back the xdot drawing attributes canviz.js renders.
+//
+//  $Id: //depot/XprobePlugin/Sources/XprobeUI/XprobeLayout.h#1 $
+//
+
+#ifndef _XprobeLayout_h
+#define _XprobeLayout_h
+
+#ifdef __OBJC__
+#import "XprobePluginMenuController.h"
+
+@interface XprobePluginMenuController(Layout)
+- (BOOL)layoutGraph:(NSString *)dotPath into:(NSString *)xdotPath;
+@end
+#endif
+
+#ifdef __cplusplus
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#define XLAYOUT_NODE_HEIGHT 36.
+#define XLAYOUT_RANK_SEP 88.
+#define XLAYOUT_NODE_SEP 18.
+#define XLAYOUT_MARGIN 4.
+#define XLAYOUT_FONT_SIZE 14.
+#define XLAYOUT_RANK_SWEEPS 8
+#define XLAYOUT_ORDER_SWEEPS 12
+#define XLAYOUT_POSITION_SWEEPS 8
+// edges spanning more ranks than this are drawn directly rather than
+// through a dummy per rank, as are all long edges if the dummies would
+// take the layered vertices over the budget
+#define XLAYOUT_MAX_SPAN 8
+#define XLAYOUT_MAX_VERTICES 50000
+
+class XprobeLayout {
+public:
+    typedef std::vector<std::pair<std::string,std::string> > xattrs;
+
+    struct _xpoint {
+        double x, y;
+    };
+
+    struct _xnode {
+        std::string name, label;
+        xattrs attrs;
+        bool box, filled, loop;
+        double width;
+    };
+
+    struct _xedge {
+        int from, to;
+        std::string label;
+        xattrs attrs;
+        bool reversed;
+        std::vector<int> chain; // layered vertices tail to head
+    };
+
+    // vertices are the nodes followed by the dummies of long edges
+    struct _xvertex {
+        int rank, order;
+        double x, width;
+        std::vector<int> up, down;
+    };
+
+    std::vector<_xnode> nodes;
+    std::vector<_xedge> edges;
+    xattrs graphAttrs, nodeDefaults, edgeDefaults;
+    std::string graphName;
+
+    bool parse( const char *dot, size_t len );
+    void layout();
+    void xdot( std::string &out );
+
+    size_t rankCount() const { return ranks.size(); }
+    size_t vertexCount() const { return vertices.size(); }
+
+private:
+    std::map<std::string,int> nodeIndex;
+    std::vector<_xvertex> vertices;
+    std::vector<std::vector<int> > ranks;
+    double width, height;
+
+    const char *ptr, *end;
+    bool token( std::string &tok, bool &quoted );
+    static bool identifier( const std::string &tok, bool quoted );
+    bool parseAttrs( xattrs &attrs );
+    int nodeNamed( const std::string &name );
+
+    void breakCycles();
+    void assignRanks();
+    void insertDummies();
+    void orderRanks();
+    void positionRanks();
+    void placeRank( std::vector<int> &rank, std::vector<double> &desired );
+
+    static const std::string *attr( const xattrs &attrs, const char *name );
+    static std::string decode( const std::string &label );
+    static double textWidth( const std::string &text );
+    _xpoint center( int vertex );
+    _xpoint boundary( int node, _xpoint toward );
+    void appendName( std::string &out, const std::string &name );
+    void appendAttrs( std::string &out, const xattrs &attrs );
+    void appendNumber( std::string &out, double value );
+    void appendPoint( std::string &out, _xpoint point );
+    void appendText( std::string &out, const char *draw, const std::string &font,
+                    _xpoint at, const std::string &text );
+    void appendArrow( std::string &out, const std::string &color, _xpoint from, _xpoint tip );
+};
+
+// dot tokens: identifiers, numbers and quoted strings or single punctuation
+inline bool XprobeLayout::token( std::string &tok, bool &quoted ) {
+    quoted = false;
+    while ( ptr < end ) {
+        if ( isspace( (unsigned char)*ptr ) )
+            ptr++;
+        else if ( *ptr == '#' || (*ptr == '/' && ptr + 1 < end && ptr[1] == '/') )
+            while ( ptr < end && *ptr != '\n' )
+                ptr++;
+        else
+            break;
+    }
+    if ( ptr >= end )
+        return false;
+
+    const char *start = ptr;
+    if ( *ptr == '"' ) {
+        quoted = true;
+        for ( ptr++ ; ptr < end && *ptr != '"' ; ptr++ )
+            if ( *ptr == '\\' && ptr + 1 < end )
+                ptr++;
+        tok.assign( start + 1, ptr - start - 1 );
+        ptr++;
+    }
+    else if ( *ptr == '-' && ptr + 1 < end && ptr[1] == '>' )
+        tok.assign( ptr, 2 ), ptr += 2;
+    else if ( isalnum( (unsigned char)*ptr ) || *ptr == '_' || *ptr == '.' ||
+             *ptr == '-' || (unsigned char)*ptr >= 0x80 ) {
+        while ( ++ptr < end && (isalnum( (unsigned char)*ptr ) || *ptr == '_' ||
+                                *ptr == '.' || (unsigned char)*ptr >= 0x80) )
+            ;
+        tok.assign( start, ptr - start );
+    }
+    else
+        tok.assign( ptr++, 1 );
+    return true;
+}
+
+// node names are identifiers, numbers or quoted strings, never punctuation
+inline bool XprobeLayout::identifier( const std::string &tok, bool quoted ) {
+    if ( quoted )
+        return true;
+    unsigned char first = tok.empty() ? 0 : tok[0];
+    return tok != "->" && (isalnum( first ) || first == '_' || first == '.' || first == '-' || first >= 0x80);
+}
+
+inline bool XprobeLayout::parseAttrs( xattrs &attrs ) {
+    std::string name, value, sep;
+    bool quoted;
+    while ( token( name, quoted ) ) {
+        if ( !quoted && name == "]" )
+            return true;
+        if ( !quoted && name == "," )
+            continue;
+        if ( !token( sep, quoted ) || sep != "=" || !token( value, quoted ) )
+            return false;
+        attrs.push_back( std::make_pair( name, value ) );
+    }
+    return false;
+}
+
+inline int XprobeLayout::nodeNamed( const std::string &name ) {
+    std::map<std::string,int>::iterator found = nodeIndex.find( name );
+    if ( found != nodeIndex.end() )
+        return found->second;
+    _xnode node;
+    node.name = node.label = name;
+    node.box = node.filled = node.loop = false;
+    nodes.push_back( node );
+    return nodeIndex[name] = (int)nodes.size() - 1;
+}
+
+inline bool XprobeLayout::parse( const char *dot, size_t len ) {
+    ptr = dot;
+    end = dot + len;
+
+    std::string tok;
+    bool quoted;
+    if ( !token( tok, quoted ) || (tok == "strict" && !token( tok, quoted )) || tok != "digraph" )
+        return false;
+    bool opened = false, closed = false;
+    while ( token( tok, quoted ) && !(opened = !quoted && tok == "{") )
+        graphName = tok;
+    if ( !opened )
+        return false;
+
+    std::vector<std::string> chain;
+    std::string next;
+    while ( token( tok, quoted ) ) {
+        if ( !quoted && (tok == ";" || tok == ",") )
+            continue;
+        if ( (closed = !quoted && tok == "}") )
+            break;
+        if ( !identifier( tok, quoted ) )
+            return false;
+
+        const char *mark = ptr;
+        if ( !quoted && (tok == "graph" || tok == "node" || tok == "edge") &&
+            token( next, quoted ) && next == "[" ) {
+            if ( !parseAttrs( tok == "graph" ? graphAttrs : tok == "node" ? nodeDefaults : edgeDefaults ) )
+                return false;
+            continue;
+        }
+        ptr = mark;
+
+        chain.clear();
+        chain.push_back( tok );
+        xattrs attrs;
+        while ( true ) {
+            mark = ptr;
+            if ( !token( next, quoted ) )
+                break;
+            if ( !quoted && next == "->" ) {
+                if ( !token( next, quoted ) || !identifier( next, quoted ) )
+                    return false;
+                chain.push_back( next );
+            }
+            else if ( !quoted && next == "=" && chain.size() == 1 ) {
+                if ( !token( next, quoted ) )
+                    return false;
+                graphAttrs.push_back( std::make_pair( tok, next ) );
+                chain.clear();
+                break;
+            }
+            else if ( !quoted && next == "[" ) {
+                if ( !parseAttrs( attrs ) )
+                    return false;
+            }
+            else {
+                ptr = mark;
+                break;
+            }
+        }
+
+        if ( chain.size() == 1 ) {
+            _xnode &node = nodes[nodeNamed( chain[0] )];
+            node.attrs.insert( node.attrs.end(), attrs.begin(), attrs.end() );
+        }
+        else
+            for ( size_t i = 1 ; i < chain.size() ; i++ ) {
+                _xedge edge;
+                edge.from = nodeNamed( chain[i-1] );
+                edge.to = nodeNamed( chain[i] );
+                edge.attrs = attrs;
+                edge.reversed = false;
+                if ( const std::string *label = attr( attrs, "label" ) )
+                    edge.label = decode( *label );
+                edges.push_back( edge );
+            }
+    }
+    if ( !closed )
+        return false;
+
+    for ( std::vector<_xnode>::iterator node = nodes.begin() ; node != nodes.end() ; ++node ) {
+        const std::string *value = attr( node->attrs, "label" );
+        node->label = decode( value ? *value : node->name );
+        value = attr( node->attrs, "shape" );
+        node->box = value && (*value == "box" || *value == "rect" || *value == "rectangle");
+        value = attr( node->attrs, "style" );
+        node->filled = value && value->find( "filled" ) != std::string::npos;
+    }
+    return true;
+}
+
+// iterative depth first search reversing edges back to the current path
+inline void XprobeLayout::breakCycles() {
+    std::vector<std::vector<int> > out( nodes.size() );
+    for ( size_t e = 0 ; e < edges.size() ; e++ )
+        if ( edges[e].from != edges[e].to )
+            out[edges[e].from].push_back( (int)e );
+        else
+            nodes[edges[e].from].loop = true;
+
+    std::vector<char> state( nodes.size(), 0 );
+    std::vector<std::pair<int,size_t> > stack;
+    for ( size_t root = 0 ; root < nodes.size() ; root++ ) {
+        if ( state[root] )
+            continue;
+        stack.push_back( std::make_pair( (int)root, 0 ) );
+        state[root] = 1;
+        while ( !stack.empty() ) {
+            std::pair<int,size_t> &top = stack.back();
+            if ( top.second == out[top.first].size() ) {
+                state[top.first] = 2;
+                stack.pop_back();
+                continue;
+            }
+            _xedge &edge = edges[out[top.first][top.second++]];
+            if ( state[edge.to] == 1 )
+                edge.reversed = true;
+            else if ( !state[edge.to] ) {
+                state[edge.to] = 1;
+                stack.push_back( std::make_pair( edge.to, 0 ) );
+            }
+        }
+    }
+}
+
+// longest path ranking then compacted moving each node toward the side
+// it has more edges to, as far as its neighbours allow
+inline void XprobeLayout::assignRanks() {
+    size_t n = nodes.size();
+    std::vector<std::vector<int> > out( n ), in( n );
+    std::vector<int> inDegree( n, 0 ), topo;
+    for ( size_t e = 0 ; e < edges.size() ; e++ ) {
+        _xedge &edge = edges[e];
+        if ( edge.from == edge.to )
+            continue;
+        int from = edge.reversed ? edge.to : edge.from, to = edge.reversed ? edge.from : edge.to;
+        out[from].push_back( to );
+        in[to].push_back( from );
+        inDegree[to]++;
+    }
+
+    vertices.assign( n, _xvertex() );
+    for ( size_t v = 0 ; v < n ; v++ )
+        if ( !inDegree[v] )
+            topo.push_back( (int)v );
+    for ( size_t i = 0 ; i < topo.size() ; i++ )
+        for ( int to : out[topo[i]] ) {
+            vertices[to].rank = std::max( vertices[to].rank, vertices[topo[i]].rank + 1 );
+            if ( !--inDegree[to] )
+                topo.push_back( to );
+        }
+
+    for ( int sweep = 0 ; sweep < XLAYOUT_RANK_SWEEPS ; sweep++ ) {
+        bool moved = false;
+        for ( size_t i = 0 ; i < topo.size() ; i++ ) {
+            int v = topo[sweep % 2 ? i : topo.size() - 1 - i], rank = vertices[v].rank;
+            if ( out[v].size() > in[v].size() ) {
+                rank = INT_MAX;
+                for ( int to : out[v] )
+                    rank = std::min( rank, vertices[to].rank - 1 );
+            }
+            else if ( in[v].size() > out[v].size() ) {
+                rank = INT_MIN;
+                for ( int from : in[v] )
+                    rank = std::max( rank, vertices[from].rank + 1 );
+            }
+            if ( rank != vertices[v].rank ) {
+                vertices[v].rank = rank;
+                moved = true;
+            }
+        }
+        if ( !moved )
+            break;
+    }
+
+    int minRank = INT_MAX;
+    for ( _xvertex &vertex : vertices )
+        minRank = std::min( minRank, vertex.rank );
+    for ( _xvertex &vertex : vertices )
+        vertex.rank -= minRank;
+}
+
+// edges spanning several ranks are routed through a dummy vertex per rank
+// unless they are longer than XLAYOUT_MAX_SPAN or there would be too many
+inline void XprobeLayout::insertDummies() {
+    for ( size_t v = 0 ; v < nodes.size() ; v++ ) {
+        _xnode &node = nodes[v];
+        double labelWidth = textWidth( node.label ) + 16.;
+        node.width = node.box ? std::max( 54., labelWidth ) : std::max( 54., labelWidth * 1.2 );
+        vertices[v].width = node.width + (node.loop ? 36. : 0.);
+    }
+
+    size_t dummies = 0;
+    for ( _xedge &edge : edges ) {
+        int span = abs( vertices[edge.to].rank - vertices[edge.from].rank );
+        if ( span <= XLAYOUT_MAX_SPAN )
+            dummies += std::max( span - 1, 0 );
+    }
+    int maxSpan = nodes.size() + dummies > XLAYOUT_MAX_VERTICES ? 1 : XLAYOUT_MAX_SPAN;
+
+    for ( size_t e = 0 ; e < edges.size() ; e++ ) {
+        _xedge &edge = edges[e];
+        if ( edge.from == edge.to )
+            continue;
+        int from = edge.reversed ? edge.to : edge.from, to = edge.reversed ? edge.from : edge.to;
+        bool direct = vertices[to].rank - vertices[from].rank > maxSpan;
+        edge.chain.push_back( from );
+        for ( int rank = vertices[from].rank + 1 ; !direct && rank < vertices[to].rank ; rank++ ) {
+            _xvertex dummy = _xvertex();
+            dummy.rank = rank;
+            dummy.width = edge.label.empty() ? 2. : textWidth( edge.label );
+            vertices.push_back( dummy );
+            edge.chain.push_back( (int)vertices.size() - 1 );
+        }
+        edge.chain.push_back( to );
+        for ( size_t i = 1 ; i < edge.chain.size() ; i++ ) {
+            vertices[edge.chain[i-1]].down.push_back( edge.chain[i] );
+            vertices[edge.chain[i]].up.push_back( edge.chain[i-1] );
+        }
+    }
+
+    int maxRank = 0;
+    for ( _xvertex &vertex : vertices )
+        maxRank = std::max( maxRank, vertex.rank );
+    ranks.assign( maxRank + 1, std::vector<int>() );
+}
+
+// initial order from a depth first walk then barycentric sweeps
+inline void XprobeLayout::orderRanks() {
+    std::vector<char> visited( vertices.size(), 0 );
+    std::vector<int> stack;
+    for ( size_t root = 0 ; root < vertices.size() ; root++ ) {
+        if ( visited[root] || !vertices[root].up.empty() )
+            continue;
+        stack.push_back( (int)root );
+        visited[root] = 1;
+        while ( !stack.empty() ) {
+            int v = stack.back();
+            stack.pop_back();
+            vertices[v].order = (int)ranks[vertices[v].rank].size();
+            ranks[vertices[v].rank].push_back( v );
+            for ( size_t i = vertices[v].down.size() ; i-- ; ) {
+                int to = vertices[v].down[i];
+                if ( !visited[to] ) {
+                    visited[to] = 1;
+                    stack.push_back( to );
+                }
+            }
+        }
+    }
+
+    std::vector<std::pair<double,int> > keyed;
+    for ( int sweep = 0 ; sweep < XLAYOUT_ORDER_SWEEPS ; sweep++ ) {
+        bool downward = sweep % 2 == 0;
+        for ( size_t r = 1 ; r < ranks.size() ; r++ ) {
+            std::vector<int> &rank = ranks[downward ? r : ranks.size() - 1 - r];
+            keyed.clear();
+            for ( int v : rank ) {
+                const std::vector<int> &adjacent = downward ? vertices[v].up : vertices[v].down;
+                double sum = 0.;
+                for ( int a : adjacent )
+                    sum += vertices[a].order;
+                keyed.push_back( std::make_pair( adjacent.empty() ? vertices[v].order :
+                                                sum / adjacent.size(), v ) );
+            }
+            std::stable_sort( keyed.begin(), keyed.end(),
+                             []( const std::pair<double,int> &a, const std::pair<double,int> &b ) {
+                                 return a.first < b.first;
+                             } );
+            for ( size_t i = 0 ; i < keyed.size() ; i++ ) {
+                rank[i] = keyed[i].second;
+                vertices[rank[i]].order = (int)i;
+            }
+        }
+    }
+}
+
+// closest placement to the desired positions keeping vertices apart
+// (pool adjacent violators on positions less their minimum offsets)
+inline void XprobeLayout::placeRank( std::vector<int> &rank, std::vector<double> &desired ) {
+    std::vector<double> offset( rank.size() ), blockSum, blockValue;
+    std::vector<int> blockCount;
+    for ( size_t i = 1 ; i < rank.size() ; i++ )
+        offset[i] = offset[i-1] + (vertices[rank[i-1]].width + vertices[rank[i]].width) / 2. + XLAYOUT_NODE_SEP;
+
+    for ( size_t i = 0 ; i < rank.size() ; i++ ) {
+        blockSum.push_back( desired[i] - offset[i] );
+        blockCount.push_back( 1 );
+        blockValue.push_back( blockSum.back() );
+        while ( blockValue.size() > 1 && blockValue[blockValue.size()-2] > blockValue.back() ) {
+            blockSum[blockSum.size()-2] += blockSum.back();
+            blockCount[blockCount.size()-2] += blockCount.back();
+            blockSum.pop_back(); blockCount.pop_back(); blockValue.pop_back();
+            blockValue.back() = blockSum.back() / blockCount.back();
+        }
+    }
+
+    for ( size_t b = 0, i = 0 ; b < blockValue.size() ; b++ )
+        for ( int c = 0 ; c < blockCount[b] ; c++, i++ )
+            vertices[rank[i]].x = blockValue[b] + offset[i];
+}
+
+inline void XprobeLayout::positionRanks() {
+    std::vector<double> desired;
+    for ( std::vector<int> &rank : ranks ) {
+        desired.assign( rank.size(), 0. );
+        placeRank( rank, desired );
+    }
+
+    for ( int sweep = 0 ; sweep < XLAYOUT_POSITION_SWEEPS ; sweep++ ) {
+        bool downward = sweep % 2 == 0, both = sweep == XLAYOUT_POSITION_SWEEPS - 1;
+        for ( size_t r = 0 ; r < ranks.size() ; r++ ) {
+            std::vector<int> &rank = ranks[downward ? r : ranks.size() - 1 - r];
+            desired.clear();
+            for ( int v : rank ) {
+                double sum = 0.;
+                size_t count = 0;
+                if ( downward || both ) {
+                    for ( int a : vertices[v].up )
+                        sum += vertices[a].x;
+                    count += vertices[v].up.size();
+                }
+                if ( !downward || both ) {
+                    for ( int a : vertices[v].down )
+                        sum += vertices[a].x;
+                    count += vertices[v].down.size();
+                }
+                desired.push_back( count ? sum / count : vertices[v].x );
+            }
+            placeRank( rank, desired );
+        }
+    }
+
+    double minX = HUGE_VAL, maxX = -HUGE_VAL;
+    for ( _xvertex &vertex : vertices ) {
+        minX = std::min( minX, vertex.x - vertex.width / 2. );
+        maxX = std::max( maxX, vertex.x + vertex.width / 2. );
+    }
+    for ( _xvertex &vertex : vertices )
+        vertex.x += XLAYOUT_MARGIN - minX;
+    width = vertices.empty() ? 0. : maxX - minX + 2. * XLAYOUT_MARGIN;
+    height = ranks.empty() ? 0. : (ranks.size() - 1) * XLAYOUT_RANK_SEP + XLAYOUT_NODE_HEIGHT + 2. * XLAYOUT_MARGIN;
+}
+
+inline void XprobeLayout::layout() {
+    vertices.clear();
+    ranks.clear();
+    for ( _xedge &edge : edges ) {
+        edge.reversed = false;
+        edge.chain.clear();
+    }
+    breakCycles();
+    assignRanks();
+    insertDummies();
+    orderRanks();
+    positionRanks();
+}
+
+inline const std::string *XprobeLayout::attr( const xattrs &attrs, const char *name ) {
+    for ( size_t i = attrs.size() ; i-- ; )
+        if ( attrs[i].first == name )
+            return &attrs[i].second;
+    return NULL;
+}
+
+// labels arrive as dot string contents with &quot; standing for "
+inline std::string XprobeLayout::decode( const std::string &label ) {
+    static const struct { const char *entity, *replacement; } entities[] = {
+        {"&quot;", "\""}, {"&lt;", "<"}, {"&gt;", ">"}, {"&amp;", "&"}, {"\\\"", "\""}, {"\\\\", "\\"}
+    };
+    std::string decoded;
+    for ( size_t i = 0 ; i < label.size() ; ) {
+        bool matched = false;
+        for ( const auto &entity : entities ) {
+            size_t len = strlen( entity.entity );
+            if ( label.compare( i, len, entity.entity ) == 0 ) {
+                decoded += entity.replacement;
+                i += len;
+                matched = true;
+                break;
+            }
+        }
+        if ( !matched )
+            decoded += label[i++];
+    }
+    return decoded;
+}
+
+// approximate advance of a 14 point proportional font counting characters not bytes
+inline double XprobeLayout::textWidth( const std::string &text ) {
+    size_t chars = 0;
+    for ( unsigned char ch : text )
+        if ( (ch & 0xc0) != 0x80 )
+            chars++;
+    return chars * XLAYOUT_FONT_SIZE * .55;
+}
+
+inline XprobeLayout::_xpoint XprobeLayout::center( int vertex ) {
+    _xpoint point = {vertices[vertex].x, height - XLAYOUT_MARGIN - XLAYOUT_NODE_HEIGHT / 2. -
+        vertices[vertex].rank * XLAYOUT_RANK_SEP};
+    return point;
+}
+
+// where the line from a node's centre toward a point leaves its outline
+inline XprobeLayout::_xpoint XprobeLayout::boundary( int node, _xpoint toward ) {
+    _xpoint from = center( node );
+    double dx = toward.x - from.x, dy = toward.y - from.y,
+        rx = nodes[node].width / 2., ry = XLAYOUT_NODE_HEIGHT / 2., t;
+    if ( dx == 0. && dy == 0. )
+        return from;
+    if ( nodes[node].box )
+        t = std::min( dx ? rx / fabs( dx ) : HUGE_VAL, dy ? ry / fabs( dy ) : HUGE_VAL );
+    else
+        t = 1. / sqrt( dx * dx / (rx * rx) + dy * dy / (ry * ry) );
+    _xpoint point = {from.x + dx * t, from.y + dy * t};
+    return point;
+}
+
+// canviz takes node names literally so only quote when dot requires it
+inline void XprobeLayout::appendName( std::string &out, const std::string &name ) {
+    bool plain = !name.empty();
+    for ( char ch : name )
+        plain = plain && (isalnum( (unsigned char)ch ) || ch == '_' || ch == '.');
+    if ( plain ) {
+        out += name;
+        return;
+    }
+    out += '"';
+    for ( char ch : name ) {
+        if ( ch == '"' )
+            out += '\\';
+        if ( ch != '\n' )
+            out += ch;
+    }
+    out += '"';
+}
+
+// pass through attributes quoted as they were parsed
+inline void XprobeLayout::appendAttrs( std::string &out, const xattrs &attrs ) {
+    for ( const auto &attr : attrs ) {
+        out += attr.first;
+        out += "=\"";
+        out += attr.second;
+        out += "\", ";
+    }
+}
+
+// fixed point to two places without the cost of snprintf
+inline void XprobeLayout::appendNumber( std::string &out, double value ) {
+    long long hundredths = llround( value * 100. );
+    if ( hundredths < 0 ) {
+        out += '-';
+        hundredths = -hundredths;
+    }
+    char buff[24], *end = buff + sizeof buff, *ptr = end;
+    int fraction = hundredths % 100;
+    if ( fraction ) {
+        if ( fraction % 10 )
+            *--ptr = '0' + fraction % 10;
+        *--ptr = '0' + fraction / 10;
+        *--ptr = '.';
+    }
+    hundredths /= 100;
+    do
+        *--ptr = '0' + hundredths % 10;
+    while ( hundredths /= 10 );
+    out.append( ptr, end - ptr );
+}
+
+inline void XprobeLayout::appendPoint( std::string &out, _xpoint point ) {
+    appendNumber( out, point.x );
+    out += ' ';
+    appendNumber( out, point.y );
+    out += ' ';
+}
+
+// xdot strings are prefixed by their length in bytes
+inline void XprobeLayout::appendText( std::string &out, const char *draw, const std::string &font,
+                                     _xpoint at, const std::string &text ) {
+    out += draw;
+    out += "=\"F ";
+    appendNumber( out, XLAYOUT_FONT_SIZE );
+    out += ' ' + std::to_string( font.size() ) + " -" + font + " c 7 -#000000 T ";
+    at.y -= XLAYOUT_FONT_SIZE * .3;
+    appendPoint( out, at );
+    out += "0 ";
+    appendNumber( out, textWidth( text ) );
+    out += ' ' + std::to_string( text.size() ) + " -";
+    for ( char ch : text ) {
+        if ( ch == '"' )
+            out += '\\';
+        out += ch;
+    }
+    out += " \", ";
+}
+
+inline void XprobeLayout::appendArrow( std::string &out, const std::string &color, _xpoint from, _xpoint tip ) {
+    double dx = tip.x - from.x, dy = tip.y - from.y, len = sqrt( dx * dx + dy * dy );
+    if ( len == 0. )
+        dy = len = 1.;
+    dx /= len; dy /= len;
+    _xpoint base = {tip.x - dx * 10., tip.y - dy * 10.},
+        left = {base.x - dy * 3.5, base.y + dx * 3.5}, right = {base.x + dy * 3.5, base.y - dx * 3.5};
+    out += "_hdraw_=\"S 5 -solid c " + std::to_string( color.size() ) + " -" + color +
+        " C " + std::to_string( color.size() ) + " -" + color + " P 3 ";
+    appendPoint( out, left );
+    appendPoint( out, tip );
+    appendPoint( out, right );
+    out += "\", ";
+}
+
+inline void XprobeLayout::xdot( std::string &out ) {
+    const std::string *fontname = attr( nodeDefaults, "fontname" );
+    std::string nodeFont = fontname ? *fontname : "Times-Roman", edgeFont = "Times-Roman";
+    if ( (fontname = attr( edgeDefaults, "fontname" )) )
+        edgeFont = *fontname;
+
+    out += "digraph " + (graphName.empty() ? std::string( "sweep" ) : graphName) + " {\n";
+    out += "\tgraph [";
+    appendAttrs( out, graphAttrs );
+    out += "bb=\"0,0,";
+    appendNumber( out, width );
+    out += ',';
+    appendNumber( out, height );
+    out += "\", xdotversion=\"1.6\"];\n";
+    if ( !nodeDefaults.empty() ) {
+        out += "\tnode [";
+        appendAttrs( out, nodeDefaults );
+        out.resize( out.size() - 2 );
+        out += "];\n";
+    }
+    if ( !edgeDefaults.empty() ) {
+        out += "\tedge [";
+        appendAttrs( out, edgeDefaults );
+        out.resize( out.size() - 2 );
+        out += "];\n";
+    }
+
+    for ( size_t v = 0 ; v < nodes.size() ; v++ ) {
+        _xnode &node = nodes[v];
+        _xpoint at = center( (int)v );
+        const std::string *color = attr( node.attrs, "color" ), *fill = attr( node.attrs, "fillcolor" );
+        std::string pen = color ? *color : "#000000", filler = fill ? *fill : "#d3d3d3";
+        double rx = node.width / 2., ry = XLAYOUT_NODE_HEIGHT / 2.;
+
+        out += '\t';
+        appendName( out, node.name );
+        out += " [";
+        appendAttrs( out, node.attrs );
+        out += "pos=\"";
+        appendNumber( out, at.x );
+        out += ',';
+        appendNumber( out, at.y );
+        out += "\", width=\"";
+        appendNumber( out, node.width / 72. );
+        out += "\", height=\"0.5\", _draw_=\"c " + std::to_string( pen.size() ) + " -" + pen + ' ';
+        if ( node.filled )
+            out += "C " + std::to_string( filler.size() ) + " -" + filler + ' ';
+        if ( node.box ) {
+            out += node.filled ? "P 4 " : "p 4 ";
+            appendPoint( out, {at.x - rx, at.y - ry} );
+            appendPoint( out, {at.x - rx, at.y + ry} );
+            appendPoint( out, {at.x + rx, at.y + ry} );
+            appendPoint( out, {at.x + rx, at.y - ry} );
+        }
+        else {
+            out += node.filled ? "E " : "e ";
+            appendPoint( out, at );
+            appendNumber( out, rx );
+            out += ' ';
+            appendNumber( out, ry );
+            out += ' ';
+        }
+        out += "\", ";
+        appendText( out, "_ldraw_", nodeFont, at, node.label );
+        out.resize( out.size() - 2 );
+        out += "];\n";
+    }
+
+    std::vector<_xpoint> points, spline;
+    for ( _xedge &edge : edges ) {
+        const std::string *value = attr( edge.attrs, "color" );
+        std::string color = value ? *value : "#000000";
+        _xpoint labelAt, tip;
+
+        spline.clear();
+        if ( edge.from == edge.to ) {
+            _xpoint at = center( edge.from );
+            double rx = nodes[edge.from].width / 2., ry = XLAYOUT_NODE_HEIGHT / 2.;
+            spline.push_back( {at.x + rx * .7, at.y + ry * .7} );
+            spline.push_back( {at.x + rx + 30., at.y + ry + 18.} );
+            spline.push_back( {at.x + rx + 30., at.y - ry - 18.} );
+            spline.push_back( {at.x + rx * .7 + 6., at.y - ry * .7 - 5.} );
+            tip = {at.x + rx * .7, at.y - ry * .7};
+            labelAt = {at.x + rx + 32. + textWidth( edge.label ) / 2., at.y};
+        }
+        else {
+            points.clear();
+            for ( int v : edge.chain )
+                points.push_back( center( v ) );
+            if ( edge.reversed )
+                std::reverse( points.begin(), points.end() );
+            points.front() = boundary( edge.from, points[1] );
+            points.back() = boundary( edge.to, points[points.size()-2] );
+
+            // pull the end back to leave room for the arrowhead
+            tip = points.back();
+            _xpoint before = points[points.size()-2];
+            double dx = tip.x - before.x, dy = tip.y - before.y, len = sqrt( dx * dx + dy * dy );
+            if ( len > 10. ) {
+                points.back().x -= dx / len * 10.;
+                points.back().y -= dy / len * 10.;
+            }
+
+            // Catmull-Rom through the dummies as cubic Beziers
+            spline.push_back( points[0] );
+            for ( size_t i = 0 ; i + 1 < points.size() ; i++ ) {
+                _xpoint p0 = points[i ? i - 1 : i], p1 = points[i], p2 = points[i+1],
+                    p3 = points[i + 2 < points.size() ? i + 2 : i + 1];
+                spline.push_back( {p1.x + (p2.x - p0.x) / 6., p1.y + (p2.y - p0.y) / 6.} );
+                spline.push_back( {p2.x - (p3.x - p1.x) / 6., p2.y - (p3.y - p1.y) / 6.} );
+                spline.push_back( p2 );
+            }
+
+            size_t middle = points.size() / 2;
+            _xpoint a = points[middle-1], b = points[middle];
+            labelAt = {(a.x + b.x) / 2. + textWidth( edge.label ) / 2. + 4., (a.y + b.y) / 2.};
+        }
+
+        out += '\t';
+        appendName( out, nodes[edge.from].name );
+        out += " -> ";
+        appendName( out, nodes[edge.to].name );
+        out += " [";
+        appendAttrs( out, edge.attrs );
+        out += "pos=\"e,";
+        appendNumber( out, tip.x );
+        out += ',';
+        appendNumber( out, tip.y );
+        for ( _xpoint &point : spline ) {
+            out += ' ';
+            appendNumber( out, point.x );
+            out += ',';
+            appendNumber( out, point.y );
+        }
+        out += "\", _draw_=\"c " + std::to_string( color.size() ) + " -" + color +
+            " B " + std::to_string( spline.size() ) + ' ';
+        for ( _xpoint &point : spline )
+            appendPoint( out, point );
+        out += "\", ";
+        appendArrow( out, color, spline.back(), tip );
+        if ( !edge.label.empty() ) {
+            out += "lp=\"";
+            appendNumber( out, labelAt.x );
+            out += ',';
+            appendNumber( out, labelAt.y );
+            out += "\", ";
+            appendText( out, "_ldraw_", edgeFont, labelAt, edge.label );
+        }
+        out.resize( out.size() - 2 );
+        out += "];\n";
+    }
+
+    out += "}\n";
+}
+
+#endif
+#endif
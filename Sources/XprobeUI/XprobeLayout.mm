@@ -0,0 +1,30 @@
+//
+//  XprobeLayout.mm
+//  XprobePlugin
+//
+//  Lays out the last graph received from the app in process
+//  writing the xdot canviz.html loads in place of running dot.
+//
+//  $Id: //depot/XprobePlugin/Sources/XprobeUI/XprobeLayout.mm#1 $
+//
+
+#import "XprobeLayout.h"
+
+@implementation XprobePluginMenuController(Layout)
+
+- (BOOL)layoutGraph:(NSString *)dotPath into:(NSString *)xdotPath {
+    NSData *dot = [NSData dataWithContentsOfFile:dotPath];
+    XprobeLayout layout;
+    if ( !dot || !layout.parse( (const char *)dot.bytes, dot.length ) ) {
+        NSLog( @"XprobeLayout: could not parse graph %@", dotPath );
+        return NO;
+    }
+
+    layout.layout();
+    std::string xdot;
+    layout.xdot( xdot );
+    return [[NSData dataWithBytesNoCopy:(void *)xdot.data() length:xdot.size() freeWhenDone:NO]
+            writeToFile:xdotPath atomically:NO];
+}
+
+@end
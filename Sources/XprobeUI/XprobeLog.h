@@ -0,0 +1,207 @@
+//
+//  XprobeLog.h
+//  XprobePlugin
+//
+//  Bounded store of the trace lines received by the console with
+//  a trigram index per segment so the filter field only needs to
+//  run its regular expression over lines that could match. Trigrams
+//  are posted per block of lines to keep the index small. Oldest
+//  segments are dropped (or appended to a spill file) when full.
+//
+//  $Id: //depot/XprobePlugin/Sources/XprobeUI/XprobeLog.h#1 $
+//
+
+#ifndef _XprobeLog_h
+#define _XprobeLog_h
+
+#ifdef __OBJC__
+#import <Foundation/Foundation.h>
+
+@interface XprobeLog : NSObject
+- (instancetype)initWithMaxBytes:(NSUInteger)maxBytes spillPath:(NSString *)spillPath;
+- (void)appendLines:(NSArray<NSString *> *)lines;
+- (NSString *)linesMatching:(NSString *)pattern limit:(NSUInteger)limit;
+- (NSString *)lines:(NSArray<NSString *> *)lines matching:(NSString *)pattern;
+@property (readonly) NSUInteger lineCount;
+@end
+#endif
+
+#ifdef __cplusplus
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+
+#include "../Xprobe/XprobeLiterals.h"
+
+#define XLOG_SEGMENT_BYTES (256*1024)
+#define XLOG_SEGMENT_LINES 65535
+#define XLOG_BLOCK_SHIFT 3 // lines per posting 1<<shift
+#define XLOG_TRIGRAM_OVERHEAD 48 // approximate cost of a hash table entry
+
+class XprobeLogIndex {
+public:
+    typedef std::pair<const char *,size_t> xline;
+
+    struct _xsegment {
+        std::string text;
+        std::vector<uint32_t> starts;
+        std::unordered_map<uint32_t,std::vector<uint16_t> > trigrams;
+        size_t indexBytes = 0;
+    };
+
+    XprobeLogIndex( size_t maxBytes, const char *spillPath );
+    ~XprobeLogIndex();
+
+    void append( const char *line, size_t len );
+    void matching( const std::vector<std::string> &literals, size_t limit, std::vector<xline> &out,
+                  const std::function<bool (const xline &)> &accept = nullptr );
+    static bool contains( const char *chars, size_t len, const std::string &literal );
+
+    size_t lineCount, bytes;
+
+private:
+    std::deque<_xsegment> segments;
+    size_t maxBytes;
+    FILE *spill;
+
+    void evict();
+    void candidates( _xsegment &segment, const std::vector<std::string> &literals, std::vector<uint16_t> &out );
+
+    static uint32_t trigram( const char *chars ) {
+        return (uint8_t)chars[0] << 16 | (uint8_t)chars[1] << 8 | (uint8_t)chars[2];
+    }
+};
+
+inline XprobeLogIndex::XprobeLogIndex( size_t maxBytes, const char *spillPath ) :
+    lineCount( 0 ), bytes( 0 ), maxBytes( maxBytes ) {
+    spill = spillPath ? fopen( spillPath, "a" ) : NULL;
+}
+
+inline XprobeLogIndex::~XprobeLogIndex() {
+    if ( spill )
+        fclose( spill );
+}
+
+inline void XprobeLogIndex::append( const char *line, size_t len ) {
+    if ( segments.empty() || segments.back().text.size() + len >= XLOG_SEGMENT_BYTES ||
+        segments.back().starts.size() >= XLOG_SEGMENT_LINES )
+        segments.emplace_back();
+
+    _xsegment &segment = segments.back();
+    if ( segment.trigrams.empty() )
+        segment.trigrams.reserve( 4096 );
+    uint16_t block = segment.starts.size() >> XLOG_BLOCK_SHIFT;
+    segment.starts.push_back( (uint32_t)segment.text.size() );
+    segment.text.append( line, len );
+    segment.text += '\n';
+
+    size_t indexBytes = segment.indexBytes;
+    char lower[3] = {0, 0, 0};
+    for ( size_t i = 0 ; i < len ; i++ ) {
+        lower[0] = lower[1];
+        lower[1] = lower[2];
+        lower[2] = tolower( (unsigned char)line[i] );
+        if ( i < 2 )
+            continue;
+
+        std::vector<uint16_t> &postings = segment.trigrams[trigram( lower )];
+        if ( postings.empty() )
+            segment.indexBytes += XLOG_TRIGRAM_OVERHEAD;
+        if ( postings.empty() || postings.back() != block ) {
+            postings.push_back( block );
+            segment.indexBytes += sizeof block;
+        }
+    }
+
+    bytes += len + 1 + sizeof(uint32_t) + segment.indexBytes - indexBytes;
+    lineCount++;
+    while ( bytes > maxBytes && segments.size() > 1 )
+        evict();
+}
+
+inline void XprobeLogIndex::evict() {
+    _xsegment &oldest = segments.front();
+    if ( spill )
+        fwrite( oldest.text.data(), 1, oldest.text.size(), spill );
+    bytes -= oldest.text.size() + oldest.starts.size() * sizeof(uint32_t) + oldest.indexBytes;
+    lineCount -= oldest.starts.size();
+    segments.pop_front();
+}
+
+inline bool XprobeLogIndex::contains( const char *chars, size_t len, const std::string &literal ) {
+    return std::search( chars, chars + len, literal.begin(), literal.end(), []( char ch, char lower ) {
+        return tolower( (unsigned char)ch ) == lower;
+    } ) != chars + len;
+}
+
+// blocks of lines of a segment containing every trigram of the literals
+inline void XprobeLogIndex::candidates( _xsegment &segment, const std::vector<std::string> &literals,
+                                       std::vector<uint16_t> &out ) {
+    std::vector<const std::vector<uint16_t> *> lists;
+    for ( const std::string &literal : literals )
+        for ( size_t i = 0 ; i + 3 <= literal.size() ; i++ ) {
+            auto found = segment.trigrams.find( trigram( &literal[i] ) );
+            if ( found == segment.trigrams.end() )
+                return;
+            lists.push_back( &found->second );
+        }
+
+    if ( lists.empty() ) {
+        for ( size_t i = 0 ; i <= (segment.starts.size() - 1) >> XLOG_BLOCK_SHIFT ; i++ )
+            out.push_back( i );
+        return;
+    }
+
+    std::sort( lists.begin(), lists.end(), []( const std::vector<uint16_t> *a, const std::vector<uint16_t> *b ) {
+        return a->size() < b->size();
+    } );
+
+    out = *lists[0];
+    std::vector<uint16_t> next;
+    for ( size_t l = 1 ; l < lists.size() && !out.empty() ; l++ ) {
+        next.clear();
+        std::set_intersection( out.begin(), out.end(), lists[l]->begin(), lists[l]->end(),
+                              std::back_inserter( next ) );
+        out.swap( next );
+    }
+}
+
+// the most recent "limit" lines containing all the literals and
+// accepted, newest first, by the optional filter, returned oldest first
+inline void XprobeLogIndex::matching( const std::vector<std::string> &literals, size_t limit,
+                                     std::vector<xline> &out, const std::function<bool (const xline &)> &accept ) {
+    std::vector<uint16_t> blocks;
+    for ( auto segment = segments.rbegin() ; segment != segments.rend() && out.size() < limit ; ++segment ) {
+        blocks.clear();
+        candidates( *segment, literals, blocks );
+
+        for ( auto block = blocks.rbegin() ; block != blocks.rend() && out.size() < limit ; ++block ) {
+            size_t first = (size_t)*block << XLOG_BLOCK_SHIFT,
+                lineno = std::min( first + (1 << XLOG_BLOCK_SHIFT), segment->starts.size() );
+            while ( lineno-- > first && out.size() < limit ) {
+                uint32_t start = segment->starts[lineno];
+                size_t len = (lineno + 1 < segment->starts.size() ?
+                              segment->starts[lineno + 1] : segment->text.size()) - start - 1;
+
+                bool all = true;
+                for ( const std::string &literal : literals )
+                    if ( !(all = contains( &segment->text[start], len, literal )) )
+                        break;
+                xline line( &segment->text[start], len );
+                if ( all && (!accept || accept( line )) )
+                    out.push_back( line );
+            }
+        }
+    }
+
+    std::reverse( out.begin(), out.end() );
+}
+
+#endif
+#endif
@@ -0,0 +1,96 @@
+//
+//  XprobeLog.mm
+//  XprobePlugin
+//
+//  Console trace history, the filter's regular expression is only
+//  evaluated for lines the trigram index says contain its literals.
+//
+//  $Id: //depot/XprobePlugin/Sources/XprobeUI/XprobeLog.mm#1 $
+//
+
+#import "XprobeLog.h"
+
+@implementation XprobeLog {
+    XprobeLogIndex *index;
+    NSString *lastPattern;
+    NSRegularExpression *regexp;
+    std::vector<std::string> literals;
+}
+
+- (instancetype)initWithMaxBytes:(NSUInteger)maxBytes spillPath:(NSString *)spillPath {
+    if ( (self = [super init]) )
+        index = new XprobeLogIndex( maxBytes, [spillPath fileSystemRepresentation] );
+    return self;
+}
+
+- (void)dealloc {
+    delete index;
+}
+
+- (NSUInteger)lineCount {
+    return index->lineCount;
+}
+
+- (void)appendLines:(NSArray<NSString *> *)lines {
+    for ( NSString *line in lines ) {
+        const char *chars = [line UTF8String];
+        if ( chars )
+            index->append( chars, strlen( chars ) );
+    }
+}
+
+// filters are case insensitive, an invalid pattern matches everything
+- (void)compile:(NSString *)pattern {
+    if ( [pattern isEqualToString:lastPattern] )
+        return;
+
+    lastPattern = pattern;
+    regexp = [pattern length] ? [NSRegularExpression regularExpressionWithPattern:pattern
+                                                     options:NSRegularExpressionCaseInsensitive error:NULL] : nil;
+    literals.clear();
+    if ( regexp )
+        xregexLiterals( [pattern UTF8String], literals );
+}
+
+- (BOOL)line:(NSString *)line matches:(NSRegularExpression *)filterRegexp {
+    return !filterRegexp || [filterRegexp rangeOfFirstMatchInString:line options:0
+                                                              range:NSMakeRange(0, [line length])].location != NSNotFound;
+}
+
+- (NSString *)linesMatching:(NSString *)pattern limit:(NSUInteger)limit {
+    [self compile:pattern];
+    NSMutableArray<NSString *> *matched = [NSMutableArray new];
+    std::vector<XprobeLogIndex::xline> lines;
+
+    // the regular expression is only run until "limit" of the newest lines match
+    index->matching( literals, limit, lines, [&]( const XprobeLogIndex::xline &candidate ) {
+        NSString *line = [[NSString alloc] initWithBytesNoCopy:(void *)candidate.first length:candidate.second
+                                                      encoding:NSUTF8StringEncoding freeWhenDone:NO];
+        if ( !line || ![self line:line matches:regexp] )
+            return false;
+        [matched addObject:line];
+        return true;
+    } );
+
+    NSMutableString *out = [[NSMutableString alloc] init];
+    for ( NSString *line in [matched reverseObjectEnumerator] ) {
+        [out appendString:line];
+        [out appendString:@"\n"];
+    }
+
+    return out;
+}
+
+- (NSString *)lines:(NSArray<NSString *> *)lines matching:(NSString *)pattern {
+    [self compile:pattern];
+    NSMutableString *out = [[NSMutableString alloc] init];
+    for ( NSString *line in lines )
+        if ( [self line:line matches:regexp] ) {
+            [out appendString:line];
+            [out appendString:@"\n"];
+        }
+
+    return out;
+}
+
+@end
@@ -11,6 +11,7 @@
 #import "XprobePluginMenuController.h"
 #import "BundleProtocol.h"
 #import "XprobeConsole.h"
+#import "XprobeLayout.h"
 #if XPROBE_PLUGIN
 #import "Xprobe.h"
 #endif
@@ -173,6 +174,32 @@ static id lastKeyWindow;
     else if ( ![self.webWindow isVisible] )
         return;
 
+    self.gvPath = [[self resourcePath]
+                   stringByAppendingPathComponent:@"canviz.gv"];
+
+    // layout in a serial background queue so large graphs don't block the UI
+    static dispatch_queue_t layoutQueue;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        layoutQueue = dispatch_queue_create("XprobeLayout", DISPATCH_QUEUE_SERIAL);
+    });
+
+    NSString *dotTmp = self.dotTmp, *gvPath = self.gvPath;
+    dispatch_async(layoutQueue, ^{
+        BOOL laidOut = [self layoutGraph:dotTmp into:gvPath];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if ( !laidOut && [self findDot] )
+                [self runDot:@[dotTmp, @"-Txdot",
+                               [@"-o" stringByAppendingString:gvPath]]];
+
+            NSURL *url = [NSURL fileURLWithPath:[[self resourcePath] stringByAppendingPathComponent:@"canviz.html"]];
+            [[self.webView mainFrame] loadRequest:[NSURLRequest requestWithURL:url]];
+            //[self.webView.mainFrame.frameView.documentView setWantsLayer:YES];
+        });
+    });
+}
+
+- (BOOL)findDot {
     if ([[NSFileManager defaultManager] isExecutableFileAtPath:DOT_PATH])
         self.dotPath = DOT_PATH;
     else if ([[NSFileManager defaultManager] isExecutableFileAtPath:DOT_PATH2])
@@ -184,20 +211,12 @@ static id lastKeyWindow;
         injectionIII = @" Please also download an un-sandboxed InjectionIII release from https://github.com/johnno1962/InjectionIII/releases";
 #endif
         if ( [[NSAlert alertWithMessageText:@"XprobePlugin" defaultButton:@"OK" alternateButton:@"Go to site"
-                                otherButton:nil informativeTextWithFormat:@"Object Graphs of your application "
-               "can be displayed if you install \"dot\" from http://www.graphviz.org/ or type: brew install graphviz.%@", injectionIII] runModal] == NSAlertAlternateReturn )
+                                otherButton:nil informativeTextWithFormat:@"Object Graphs can be exported "
+               "if you install \"dot\" from http://www.graphviz.org/ or type: brew install graphviz.%@", injectionIII] runModal] == NSAlertAlternateReturn )
             [[NSWorkspace sharedWorkspace] openURL:[NSURL URLWithString:@"http://www.graphviz.org/download/"]];
     }
-    else {
-        self.gvPath = [[self resourcePath]
-                       stringByAppendingPathComponent:@"canviz.gv"];
-        [self runDot:@[self.dotTmp, @"-Txdot",
-                       [@"-o" stringByAppendingString:self.gvPath]]];
-    }
 
-    NSURL *url = [NSURL fileURLWithPath:[[self resourcePath] stringByAppendingPathComponent:@"canviz.html"]];
-    [[self.webView mainFrame] loadRequest:[NSURLRequest requestWithURL:url]];
-    //[self.webView.mainFrame.frameView.documentView setWantsLayer:YES];
+    return self.dotPath != nil;
 }
 
 - (int)runDot:(NSArray *)args {
@@ -246,6 +265,8 @@ static id lastKeyWindow;
 }
 
 - (IBAction)graphpdf:(id)sender {
+    if ( ![self findDot] )
+        return;
     [self runDot:@[@"-Tpdf", self.dotTmp, @"-o", @"/tmp/graph.pdf"]];
     [self openResourceFile:@"/tmp/graph.pdf"];
 }